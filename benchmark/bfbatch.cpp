@@ -0,0 +1,45 @@
+#include "bf.h"
+#include <chrono>
+
+using namespace sketch;
+
+// Bloom filter bulk insertion and membership queries: one key at a time versus addh_batch()/may_contain(ptr, n, mask),
+// which hash blocks of 64 keys per seed and prefetch their words before touching them.
+// Half of the queried keys are present. The table defaults to 2^30 bits (128 MiB), so nearly every probe misses cache.
+// Usage: bfbatch [n=20000000] [l2sz=30] [nhashes=4]
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 20000000;
+    const unsigned l2sz = argc > 2 ? std::atoi(argv[2]): 30;
+    const unsigned nh = argc > 3 ? std::atoi(argv[3]): 4;
+    std::vector<uint64_t> keys(n), queries(n);
+    wy::WyRand<uint64_t> rng(n);
+    for(auto &x: keys) x = rng();
+    for(size_t i = 0; i < n; ++i) queries[i] = i & 1 ? keys[i]: rng();
+    std::fprintf(stdout, "#layout\tserial_inserts_per_sec\tbatch_inserts_per_sec\tserial_queries_per_sec\tbatch_queries_per_sec\n");
+    for(const bool blocked: {false, true}) {
+        bf_t serial = blocked ? bf_t::blocked(l2sz, nh, 137): bf_t(l2sz, nh, 137), batch = serial;
+        const double sit = seconds([&]() {for(const auto x: keys) serial.addh(x);});
+        const double bit = seconds([&]() {batch.addh_batch(keys);});
+        size_t shits = 0, bhits = 0;
+        const double sqt = seconds([&]() {for(const auto x: queries) shits += serial.may_contain(x);});
+        std::vector<uint64_t> mask;
+        const double bqt = seconds([&]() {
+            batch.may_contain(queries, mask);
+            for(const auto w: mask) bhits += popcount(w);
+        });
+        if(!(serial == batch) || shits != bhits) {
+            std::fprintf(stderr, "Serial and batched results differ\n");
+            return EXIT_FAILURE;
+        }
+        std::fprintf(stdout, "%s\t%g\t%g\t%g\t%g\n", blocked ? "blocked": "standard", n / sit, n / bit, n / sqt, n / bqt);
+    }
+    return EXIT_SUCCESS;
+}
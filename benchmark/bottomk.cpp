@@ -0,0 +1,49 @@
+#include "mh.h"
+#include <chrono>
+
+using namespace sketch;
+
+// Insertions per second (millions) into bottom-k sketches of several sizes:
+// the std::set-based update RangeMinHash used to perform, versus RangeMinHash, CountingRangeMinHash and BottomKHasher.
+// Half the stream repeats earlier values, so that duplicate checks are exercised as in k-mer streams.
+// Usage: bottomk [n=4000000]
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 4000000;
+    std::vector<uint64_t> in(n);
+    wy::WyRand<uint64_t> rng(13);
+    for(size_t i = 0; i < n; ++i) in[i] = i && (rng() & 1) ? in[rng() % i]: rng();
+    std::fprintf(stdout, "#k\tstd::set\tRangeMinHash\tCountingRangeMinHash\tBottomKHasher\n");
+    for(const size_t k: {size_t(128), size_t(1024), size_t(16384), size_t(131072)}) {
+        std::set<uint64_t, std::greater<uint64_t>> ref;
+        const double tset = seconds([&]() {
+            for(const auto v: in) {
+                if(ref.size() == k) {
+                    if(*ref.begin() > v) {
+                        ref.insert(v);
+                        if(ref.size() > k) ref.erase(ref.begin());
+                    }
+                } else ref.insert(v);
+            }
+        });
+        RangeMinHash<uint64_t> rmh(k);
+        const double trmh = seconds([&]() {for(const auto v: in) rmh.add(v); rmh.begin();});
+        CountingRangeMinHash<uint64_t> crmh(k);
+        const double tcrmh = seconds([&]() {for(const auto v: in) crmh.add(v); crmh.begin();});
+        BottomKHasher<> bk(k);
+        const double tbk = seconds([&]() {for(const auto v: in) bk.add(v);});
+        if(!std::equal(rmh.begin(), rmh.end(), ref.begin(), ref.end())) {
+            std::fprintf(stderr, "RangeMinHash differs from the std::set reference at k = %zu\n", k);
+            std::exit(EXIT_FAILURE);
+        }
+        std::fprintf(stdout, "%zu\t%0.2f\t%0.2f\t%0.2f\t%0.2f\n", k, n / tset / 1e6, n / trmh / 1e6, n / tcrmh / 1e6, n / tbk / 1e6);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+#include "cbf.h"
+#include <chrono>
+
+using namespace sketch;
+
+// Counting bloom filter insertion and count-query throughput: the previous layout, a vector of separately
+// allocated bloom filters walked one at a time, versus the contiguous blocked cbf_t.
+// Keys follow a Zipf-like distribution, so that counts span the levels.
+// Usage: cbfbench [n=4000000] [nlevels=8] [l2sz=26] [nhashes=4]
+
+// The previous cbfbase_t insertion and count estimation.
+struct legacy_cbf_t {
+    std::vector<bf_t> bfs_;
+    common::DefaultRNGType rng_;
+    uint64_t gen_;
+    uint8_t nbits_;
+    legacy_cbf_t(size_t nbfs, size_t l2sz, unsigned nhashes, uint64_t seed): rng_{seed}, gen_(rng_()), nbits_(64) {
+        for(const auto l: bf::detail::pcbf_bf_mgen(nbfs, l2sz)) bfs_.emplace_back(l, nhashes, rng_());
+    }
+    unsigned addh(const uint64_t val) {
+        auto it(bfs_.begin());
+        if(!it->may_contain_and_addh(val))
+            return 1u;
+        FOREVER {
+            ++it;
+            if(it == bfs_.end()) return 1u << bfs_.size();
+            if(!it->may_contain(val)) {
+                const auto dist = static_cast<unsigned>(std::distance(bfs_.begin(), it));
+                if(HEDLEY_UNLIKELY(nbits_ < dist)) gen_ = rng_(), nbits_ = 64;
+                if((gen_ & (UINT64_C(-1) >> (64 - dist))) == 0) it->addh(val);
+                gen_ >>= dist, nbits_ -= dist;
+            }
+        }
+    }
+    unsigned est_count(const uint64_t val) const {
+        auto it(bfs_.cbegin());
+        if(!it->may_contain(val)) return 0;
+        for(++it;it < bfs_.end() && it->may_contain(val); ++it);
+        return 1u << (std::distance(bfs_.cbegin(), it) - 1);
+    }
+};
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template<typename CBF>
+void run(const char *name, CBF &cbf, const std::vector<uint64_t> &items) {
+    size_t isum = 0, qsum = 0;
+    const double it = seconds([&]() {for(const auto x: items) isum += cbf.addh(x);});
+    const double qt = seconds([&]() {for(const auto x: items) qsum += cbf.est_count(x);});
+    std::fprintf(stdout, "%s\t%g\t%g\t%g\n", name, items.size() / it, items.size() / qt, double(qsum) / items.size());
+}
+
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 4000000;
+    const unsigned nlevels = argc > 2 ? std::atoi(argv[2]): 8;
+    const unsigned l2sz = argc > 3 ? std::atoi(argv[3]): 26;
+    const unsigned nh = argc > 4 ? std::atoi(argv[4]): 4;
+    std::vector<uint64_t> items(n);
+    wy::WyRand<uint64_t> rng(13);
+    for(auto &x: items) x = rng() % (uint64_t(1) << (rng() % 24));
+    std::fprintf(stdout, "#layout\tinserts_per_sec\tcount_queries_per_sec\tmean_est_count\n");
+    legacy_cbf_t legacy(nlevels, l2sz, nh, 137);
+    run("legacy", legacy, items);
+    bf::cbf_t contiguous(nlevels, l2sz, nh, 137);
+    run("contiguous", contiguous, items);
+    return EXIT_SUCCESS;
+}
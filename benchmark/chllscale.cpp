@@ -0,0 +1,43 @@
+#include "hll.h"
+#include <chrono>
+
+using namespace sketch;
+
+// Insert throughput from 1 to 64 threads for a single shared hll_t (CAS on every update)
+// versus concurrent_hll_t (one private shard per thread), including the cost of the final merge.
+// Usage: chllscale [p=10] [nelem=1<<26]
+
+template<typename F>
+double time_threads(unsigned nthreads, const F &func) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::high_resolution_clock::now();
+    for(unsigned t = 0; t < nthreads; ++t) threads.emplace_back(func, t);
+    for(auto &t: threads) t.join();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    const unsigned p = argc > 1 ? std::atoi(argv[1]): 10;
+    const size_t nelem = argc > 2 ? std::strtoull(argv[2], nullptr, 10): size_t(1) << 26;
+    std::fprintf(stdout, "#threads\tshared_inserts_per_sec\tsharded_inserts_per_sec\tmerge_sec\n");
+    for(unsigned nthreads = 1; nthreads <= 64; nthreads <<= 1) {
+        const size_t per = nelem / nthreads;
+        hll_t shared(p);
+        const double shared_time = time_threads(nthreads, [&](unsigned t) {
+            for(size_t i = t * per, e = i + per; i < e; shared.addh(i++));
+        });
+        concurrent_hll_t sharded(p, nthreads);
+        const double sharded_time = time_threads(nthreads, [&](unsigned t) {
+            for(size_t i = t * per, e = i + per; i < e; sharded.addh(i++, t));
+        });
+        auto start = std::chrono::high_resolution_clock::now();
+        const double est = sharded.report();
+        const double merge_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        if(sharded.merged() != shared) {
+            std::fprintf(stderr, "Sharded and shared sketches differ with %u threads. est: %g\n", nthreads, est);
+            return EXIT_FAILURE;
+        }
+        std::fprintf(stdout, "%u\t%g\t%g\t%g\n", nthreads, per * nthreads / shared_time, per * nthreads / sharded_time, merge_time);
+    }
+    return EXIT_SUCCESS;
+}
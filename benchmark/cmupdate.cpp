@@ -0,0 +1,64 @@
+#include "ccm.h"
+#include <chrono>
+
+using namespace sketch;
+
+// Conservative-update count-min insertion throughput for 1-16 hash rows:
+// the previous add(), which built two std::vectors per item, versus the current allocation-free add().
+// Usage: cmupdate [n=4000000] [l2sz=16] [nbits=16]
+
+// Exposes the previous conservative-update path for comparison.
+struct legacy_ccm_t: public ccm_t {
+    template<typename... Args> legacy_ccm_t(Args &&... args): ccm_t(std::forward<Args>(args)...) {}
+    ssize_t legacy_add(const uint64_t val) {
+        std::vector<uint64_t> indices, best_indices;
+        indices.reserve(nhashes_);
+        for(unsigned nhdone = 0; nhdone < nhashes_; ++nhdone)
+            indices.push_back(subtbl_sz_ * nhdone + (hash(val, nhdone) & mask_));
+        best_indices.push_back(indices[0]);
+        ssize_t minval = data_.operator[](indices[0]);
+        for(size_t i(1); i < indices.size(); ++i) {
+            unsigned score;
+            if((score = data_.operator[](indices[i])) == minval) {
+                best_indices.push_back(indices[i]);
+            } else if(score < minval) {
+                best_indices.clear();
+                best_indices.push_back(indices[i]);
+                minval = score;
+            }
+        }
+        updater_(best_indices, data_, nbits_);
+        return minval + 1;
+    }
+    const DefaultCompactVectorType &data() const {return data_;}
+};
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 4000000;
+    const int l2sz = argc > 2 ? std::atoi(argv[2]): 16;
+    const int nbits = argc > 3 ? std::atoi(argv[3]): 16;
+    // Zipf-like stream, so that counters collide as they would for heavy hitters.
+    std::vector<uint64_t> items(n);
+    wy::WyRand<uint64_t> rng(13);
+    for(auto &x: items) x = rng() % (uint64_t(1) << (rng() % 24));
+    std::fprintf(stdout, "#nhashes\tlegacy_per_sec\tcurrent_per_sec\tspeedup\n");
+    for(int nh = 1; nh <= 16; ++nh) {
+        legacy_ccm_t legacy(nbits, l2sz, nh), current(nbits, l2sz, nh);
+        ssize_t lsum = 0, csum = 0;
+        const double lt = seconds([&]() {for(const auto x: items) lsum += legacy.legacy_add(x);});
+        const double ct = seconds([&]() {for(const auto x: items) csum += current.add(x);});
+        if(lsum != csum || !std::equal(legacy.data().cbegin(), legacy.data().cend(), current.data().cbegin())) {
+            std::fprintf(stderr, "Legacy and current conservative updates differ for %d hashes\n", nh);
+            return EXIT_FAILURE;
+        }
+        std::fprintf(stdout, "%d\t%g\t%g\t%0.3f\n", nh, n / lt, n / ct, lt / ct);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+#include "dd.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+using namespace sketch;
+
+// Records per second (millions) from several threads into one DDSketch, behind a mutex versus ConcurrentDDSketch collectors,
+// then the latency of merging two full stores: bin by bin, as Store::operator+= used to, versus the bin-add kernel at each
+// instruction set level.
+// Usage: ddmerge [threads=8] [records_per_thread=2000000] [bins=2048]
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template<typename F>
+double run_threads(size_t nthreads, const F &func) {
+    return seconds([&]() {
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < nthreads; ++t) threads.emplace_back(func, t);
+        for(auto &t: threads) t.join();
+    });
+}
+
+int main(int argc, char *argv[]) {
+    const size_t nthreads = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 8;
+    const size_t n = argc > 2 ? std::strtoull(argv[2], nullptr, 10): 2000000;
+    const size_t nbins = argc > 3 ? std::strtoull(argv[3], nullptr, 10): 2048;
+    // Latencies in microseconds, log-normally distributed.
+    std::vector<double> values(n);
+    std::mt19937_64 mt(13);
+    std::lognormal_distribution<double> dist(5., 1.5);
+    for(auto &v: values) v = dist(mt);
+
+    ddd locked;
+    std::mutex mut;
+    const double tlocked = run_threads(nthreads, [&](size_t) {
+        for(const auto v: values) {
+            std::lock_guard<std::mutex> lock(mut);
+            locked.addh(v);
+        }
+    });
+    concurrent_ddd cdd;
+    const double tcollect = run_threads(nthreads, [&](size_t) {
+        auto c = cdd.collector();
+        for(const auto v: values) c.addh(v);
+    });
+    const auto merged = cdd.merged();
+    if(merged.count() != locked.count() || merged.quantile(.99) != locked.quantile(.99)) {
+        std::fprintf(stderr, "Collectors disagree with the locked sketch\n");
+        std::exit(EXIT_FAILURE);
+    }
+    std::fprintf(stdout, "#threads\tmutex_M_records_per_sec\tcollector_M_records_per_sec\tmerges\n");
+    std::fprintf(stdout, "%zu\t%0.2f\t%0.2f\t%zu\n", nthreads, nthreads * n / tlocked / 1e6, nthreads * n / tcollect / 1e6, size_t(cdd.nmerges()));
+
+    // Full stores, the second offset by a quarter and with its ring wrapped around.
+    Store<> a(nbins), b(nbins);
+    for(size_t i = 0; i < nbins; ++i) a.addh(int64_t(i), 1 + (i & 7));
+    for(size_t i = nbins / 4; i < nbins; ++i) b.addh(int64_t(i), 2);
+    for(size_t i = nbins / 4; i-- > 0;) b.addh(int64_t(i), 3);
+    const size_t reps = 200000000 / nbins;
+    auto dst = a;
+    const double tbybin = seconds([&]() {
+        for(size_t r = 0; r < reps; ++r)
+            for(int64_t k = b.min_key(); k <= b.max_key(); ++k) dst[k - dst.min_key()] += b[k - b.min_key()];
+    });
+    std::fprintf(stdout, "#bins\tkernel\tmerge_ns\n%zu\tbin_by_bin\t%0.1f\n", nbins, tbybin / reps * 1e9);
+    for(const isa_t isa: {isa_t::SCALAR, isa_t::AVX2, isa_t::AVX512}) {
+        if(isa > detect_isa()) continue;
+        std::vector<int64_t> x(nbins), y(nbins, 1);
+        const double t = seconds([&]() {for(size_t r = 0; r < reps; ++r) dd::detail::add_bins_isa(x.data(), y.data(), nbins, isa);});
+        if(size_t(x[0]) != reps) std::exit(EXIT_FAILURE);
+        std::fprintf(stdout, "%zu\t%s\t%0.1f\n", nbins, isa_name(isa), t / reps * 1e9);
+    }
+    const double tstore = seconds([&]() {for(size_t r = 0; r < reps; ++r) dst += b;});
+    std::fprintf(stdout, "%zu\tStore::operator+=\t%0.1f\n", nbins, tstore / reps * 1e9);
+    return EXIT_SUCCESS;
+}
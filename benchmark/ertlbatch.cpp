@@ -0,0 +1,49 @@
+#include "hll.h"
+#include <chrono>
+
+using namespace sketch;
+using namespace sketch::hll;
+
+// Histograms per second for ertl_ml_estimate one at a time versus the batched estimator at each instruction set level,
+// over union histograms of random pairs, as in all-pairs comparisons.
+// Usage: ertlbatch [p=14] [nhistograms=4096] [reps=20]
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    const unsigned p = argc > 1 ? std::atoi(argv[1]): 14, q = 64 - p;
+    const size_t n = argc > 2 ? std::strtoull(argv[2], nullptr, 10): 4096;
+    const size_t reps = argc > 3 ? std::strtoull(argv[3], nullptr, 10): 20;
+    wy::WyRand<uint64_t> rng(13);
+    std::vector<hll_t> sketches;
+    for(size_t i = 0; i < 64; ++i) {
+        sketches.emplace_back(p);
+        for(size_t j = 0, e = size_t(1) << (8 + rng() % 14); j < e; ++j) sketches.back().addh(rng());
+    }
+    std::vector<CountArrayType> counts(n);
+    for(auto &c: counts) c = union_counts(sketches[rng() % sketches.size()], sketches[rng() % sketches.size()]);
+    std::vector<double> expected(n), out(n);
+    const double loop_time = seconds([&]() {
+        for(size_t r = 0; r < reps; ++r)
+            for(size_t i = 0; i < n; ++i) expected[i] = hll::detail::ertl_ml_estimate(counts[i], p, q);
+    });
+    std::fprintf(stdout, "#kernel\thistograms_per_sec\n");
+    std::fprintf(stdout, "loop\t%g\n", n * reps / loop_time);
+    for(const isa_t isa: {isa_t::AVX2, isa_t::AVX512}) {
+        if(isa > detect_isa()) continue;
+        const double t = seconds([&]() {
+            for(size_t r = 0; r < reps; ++r) hll::detail::ertl_ml_estimate_batch_isa(counts.data(), n, p, q, out.data(), isa);
+        });
+        if(out != expected) {
+            std::fprintf(stderr, "Batched estimates (%s) differ from ertl_ml_estimate\n", isa_name(isa));
+            return EXIT_FAILURE;
+        }
+        std::fprintf(stdout, "%s\t%g\n", isa_name(isa), n * reps / t);
+    }
+    return EXIT_SUCCESS;
+}
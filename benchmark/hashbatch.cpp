@@ -0,0 +1,61 @@
+#include "common.h"
+#include "hash.h"
+#include <chrono>
+
+using namespace sketch;
+
+// Array hashing throughput in GB/s of input per hasher: a loop over operator()(uint64_t)
+// versus the batch kernel for each instruction set this CPU supports.
+// The buffer is sized to stay in L2, so that hashing rather than memory bandwidth is measured.
+// Usage: hashbatch [n=32768] [reps=2000]
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template<typename H>
+void run(const char *name, const H &h, const std::vector<uint64_t> &in, size_t reps) {
+    std::vector<uint64_t> expected(in.size()), out(in.size());
+    const double gb = double(in.size()) * sizeof(uint64_t) * reps / 1e9;
+    const double loop_time = seconds([&]() {
+        for(size_t r = 0; r < reps; ++r) {
+            for(size_t i = 0; i < in.size(); ++i) expected[i] = h(in[i]);
+            asm volatile("" ::: "memory");
+        }
+    });
+    std::fprintf(stdout, "%s\tloop\t%0.3f\n", name, gb / loop_time);
+    for(const isa_t isa: {isa_t::SCALAR, isa_t::AVX2, isa_t::AVX512}) {
+        if(isa > detect_isa()) continue;
+        const double t = seconds([&]() {
+            for(size_t r = 0; r < reps; ++r) {
+                batch::kernel_isa(h, in.data(), out.data(), in.size(), isa);
+                asm volatile("" ::: "memory");
+            }
+        });
+        if(out != expected) {
+            std::fprintf(stderr, "Batch kernel (%s) differs from the scalar hasher for %s\n", isa_name(isa), name);
+            std::exit(EXIT_FAILURE);
+        }
+        std::fprintf(stdout, "%s\t%s\t%0.3f\n", name, isa_name(isa), gb / t);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 32768;
+    const size_t reps = argc > 2 ? std::strtoull(argv[2], nullptr, 10): 2000;
+    std::vector<uint64_t> in(n);
+    wy::WyRand<uint64_t> rng(13);
+    for(auto &x: in) x = rng();
+    std::fprintf(stdout, "#hasher\tkernel\tGB_per_sec\n");
+    run("WangHash", WangHash(), in, reps);
+    run("MurFinHash", MurFinHash(), in, reps);
+    run("CEHasher", CEHasher(), in, reps);
+    run("XorMultiply", XorMultiply(), in, reps);
+    run("MultiplyAdd", MultiplyAdd(), in, reps);
+    run("MultiplyAddXor", MultiplyAddXor(), in, reps);
+    run("MultiplyAddXoRot<31>", MultiplyAddXoRot<31>(), in, reps);
+    return EXIT_SUCCESS;
+}
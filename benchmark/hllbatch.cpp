@@ -0,0 +1,35 @@
+#include "hll.h"
+#include <chrono>
+
+using namespace sketch;
+
+// Compares scalar addh against addh_batch, reporting inserts/sec.
+// Usage: hllbatch [nelem=1<<24]
+
+template<typename F>
+double time_inserts(const F &func, size_t nelem) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    auto end = std::chrono::high_resolution_clock::now();
+    return nelem / std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    const size_t nelem = argc > 1 ? std::strtoull(argv[1], nullptr, 10): size_t(1) << 24;
+    std::vector<uint64_t> keys(nelem);
+    wy::WyHash<uint64_t, 2> gen(1337);
+    for(auto &k: keys) k = gen();
+    std::fprintf(stdout, "#p\tscalar_inserts_per_sec\tbatch_inserts_per_sec\tbatch_st_inserts_per_sec\tspeedup_st\n");
+    for(unsigned p = 10; p <= 20; ++p) {
+        hll_t scalar(p), batch(p), batch_st(p);
+        const double s = time_inserts([&]() {for(const auto k: keys) scalar.addh(k);}, nelem);
+        const double b = time_inserts([&]() {batch.addh_batch(keys.data(), keys.size(), false);}, nelem);
+        const double bst = time_inserts([&]() {batch_st.addh_batch(keys.data(), keys.size(), true);}, nelem);
+        if(scalar != batch || scalar != batch_st) {
+            std::fprintf(stderr, "Batched and scalar sketches differ at p = %u\n", p);
+            return EXIT_FAILURE;
+        }
+        std::fprintf(stdout, "%u\t%g\t%g\t%g\t%0.3f\n", p, s, b, bst, bst / s);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+#include "mh.h"
+#include <chrono>
+
+using namespace sketch;
+
+// Comparisons per second (millions) between sorted bottom-k arrays: the scalar merge isz::intersection_size used to run,
+// versus count_common and the Jaccard numerator count_common_prefix at each instruction set level.
+// The last line pairs a set with one 64 times larger, both hashed in full, where count_common gallops.
+// Usage: isz [k=1024] [reps=20000]
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template<typename T>
+uint64_t merge_count(const std::vector<T> &a, const std::vector<T> &b) {
+    uint64_t ret = 0;
+    for(auto i1 = a.begin(), i2 = b.begin(); i1 != a.end() && i2 != b.end();) {
+        if(*i1 == *i2) ++ret, ++i1, ++i2;
+        else if(*i1 < *i2) ++i1;
+        else ++i2;
+    }
+    return ret;
+}
+
+template<typename T>
+std::vector<T> sketch_of(size_t k, size_t start, size_t n) {
+    std::set<T> s;
+    WangHash hf;
+    for(size_t i = start; i < start + n; ++i) {
+        s.insert(T(hf(uint64_t(i))));
+        if(s.size() > k) s.erase(std::prev(s.end()));
+    }
+    return std::vector<T>(s.begin(), s.end());
+}
+
+template<typename T>
+void run(const char *name, const std::vector<T> &a, const std::vector<T> &b, size_t reps) {
+    uint64_t expected = 0, sink = 0;
+    const double tmerge = seconds([&]() {for(size_t r = 0; r < reps; ++r) expected += merge_count(a, b);});
+    std::fprintf(stdout, "%s\tmerge\t%0.3f\n", name, reps / tmerge / 1e6);
+    for(const isa_t isa: {isa_t::SCALAR, isa_t::AVX2, isa_t::AVX512}) {
+        if(isa > detect_isa()) continue;
+        uint64_t got = 0;
+        const double t = seconds([&]() {for(size_t r = 0; r < reps; ++r) got += isz::count_common_isa(a.data(), a.size(), b.data(), b.size(), isa);});
+        const double tp = seconds([&]() {for(size_t r = 0; r < reps; ++r) sink += isz::count_common_prefix_isa(a.data(), a.size(), b.data(), b.size(), a.size(), isa);});
+        if(got != expected) {
+            std::fprintf(stderr, "count_common (%s) differs from the merge for %s\n", isa_name(isa), name);
+            std::exit(EXIT_FAILURE);
+        }
+        std::fprintf(stdout, "%s\t%s\t%0.3f\t%0.3f\n", name, isa_name(isa), reps / t / 1e6, reps / tp / 1e6);
+    }
+    if(!sink) std::fprintf(stderr, "No shared elements\n");
+}
+
+int main(int argc, char *argv[]) {
+    const size_t k = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 1024;
+    const size_t reps = argc > 2 ? std::strtoull(argv[2], nullptr, 10): 20000;
+    std::fprintf(stdout, "#arrays\tkernel\tcommon_M_per_sec\tprefix_M_per_sec\n");
+    // Sets of 100k elements overlapping by half, so that about a third of each sketch is shared.
+    run("u64", sketch_of<uint64_t>(k, 0, 100000), sketch_of<uint64_t>(k, 50000, 100000), reps);
+    run("u32", sketch_of<uint32_t>(k, 0, 100000), sketch_of<uint32_t>(k, 50000, 100000), reps);
+    run("u64_skewed", sketch_of<uint64_t>(k, 0, k), sketch_of<uint64_t>(64 * k, k / 2, 64 * k), reps / 16);
+    return EXIT_SUCCESS;
+}
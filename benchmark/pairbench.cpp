@@ -0,0 +1,65 @@
+#include "pairwise.h"
+#include "hll.h"
+#include "bbmh.h"
+#include "setsketch.h"
+#include <chrono>
+
+using namespace sketch;
+
+// All-pairs Jaccard over n sketches: a plain loop over pairs (as in python/pysketch.h's CmpFunc)
+// versus the tiled pairwise_matrix engine, reporting comparisons/sec.
+// Usage: pairbench [n=10000] [nthreads=1]
+// Build with `make pairbench EXTRA=-fopenmp` for multithreaded runs.
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template<typename Sketch>
+void run(const char *name, const std::vector<Sketch> &sketches, int nthreads) {
+    const size_t n = sketches.size(), nc2 = n * (n - 1) / 2;
+    std::vector<float> naive(nc2), tiled(nc2);
+    pairwise_matrix<Sketch> pm(sketches);
+    const double naive_time = seconds([&]() {
+        for(size_t i = 0; i < n; ++i) {
+            OMP_PRAGMA("omp parallel for num_threads(nthreads)")
+            for(size_t j = i + 1; j < n; ++j)
+                naive[pm.condensed_index(i, j, n)] = sketches[i].jaccard_index(sketches[j]);
+        }
+    });
+    const double tiled_time = seconds([&]() {pm.condensed(tiled.data(), nthreads);});
+    if(naive != tiled) {
+        std::fprintf(stderr, "Tiled and naive results differ for %s\n", name);
+        std::exit(EXIT_FAILURE);
+    }
+    std::fprintf(stdout, "%s\t%zu\t%zu\t%g\t%g\t%0.3f\n", name, n, pm.block_size(), nc2 / naive_time, nc2 / tiled_time, naive_time / tiled_time);
+}
+
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 10000;
+    const int nthreads = argc > 2 ? std::atoi(argv[2]): 1;
+    std::vector<hll_t> hlls;
+    std::vector<SetSketch<uint16_t>> sets;
+    std::vector<FinalBBitMinHash> bbs;
+    hlls.reserve(n); sets.reserve(n); bbs.reserve(n);
+    wy::WyHash<uint64_t, 2> gen(13);
+    for(size_t i = 0; i < n; ++i) {
+        hlls.emplace_back(12);
+        sets.emplace_back(2048, 1.0006, 20., 62000);
+        BBitMinHasher<uint64_t> bb(12, 16);
+        for(size_t j = 0; j < 2000; ++j) {
+            // Draw from a shared pool so that pairs overlap.
+            const uint64_t v = gen() % (n * 200);
+            hlls.back().addh(v); sets.back().update(v); bb.addh(v);
+        }
+        bbs.push_back(bb.finalize());
+    }
+    std::fprintf(stdout, "#sketch\tn\tblock\tnaive_cmps_per_sec\ttiled_cmps_per_sec\tspeedup\n");
+    run("hll_t", hlls, nthreads);
+    run("SetSketch", sets, nthreads);
+    run("FinalBBitMinHash", bbs, nthreads);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+#include "hll.h"
+#include "pairwise.h"
+#include <chrono>
+
+using namespace sketch;
+
+// Scaling of sketch workloads on thread_pool with 1..maxthreads workers:
+// all-pairs Jaccard over HLLs (nested parallel_for over block rows and tiles), parallel bulk insertion into one HLL,
+// and parsum on a large HLL, the last also through kt_for for comparison.
+// Usage: poolscale [maxthreads=hardware_concurrency] [nsketches=2000] [nitems=50000000]
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    const unsigned maxthreads = argc > 1 ? std::atoi(argv[1]): std::max(std::thread::hardware_concurrency(), 1u);
+    const size_t nsketches = argc > 2 ? std::strtoull(argv[2], nullptr, 10): 2000;
+    const size_t nitems = argc > 3 ? std::strtoull(argv[3], nullptr, 10): 50000000;
+    std::vector<hll_t> sketches;
+    for(size_t i = 0; i < nsketches; ++i) {
+        sketches.emplace_back(10);
+        for(uint64_t j = i * 100; j < i * 100 + 5000; ++j) sketches.back().addh(j);
+    }
+    pairwise_matrix<hll_t> pm(sketches);
+    std::vector<uint64_t> items(nitems);
+    wy::WyRand<uint64_t> rng(13);
+    for(auto &x: items) x = rng();
+    hll_t big(24);
+    big.addh_batch(items);
+    std::vector<float> out(pm.condensed_size());
+    std::fprintf(stdout, "#workload\tthreads\tseconds\tspeedup\n");
+    double pw1 = 0, add1 = 0, ps1 = 0, kt1 = 0;
+    for(unsigned nt = 1; nt <= maxthreads; nt <<= 1) {
+        thread_pool pool(nt);
+        const double pw = seconds([&]() {pm.condensed(out.data(), pool);});
+        hll_t h(20);
+        const double add = seconds([&]() {h.addh_batch(items.data(), items.size(), pool);});
+        const double ps = seconds([&]() {for(int i = 0; i < 10; ++i) big.parsum(pool);});
+        const double kt = seconds([&]() {for(int i = 0; i < 10; ++i) big.parsum(nt);});
+        if(nt == 1) pw1 = pw, add1 = add, ps1 = ps, kt1 = kt;
+        std::fprintf(stdout, "pairwise\t%u\t%g\t%0.3f\n", nt, pw, pw1 / pw);
+        std::fprintf(stdout, "addh_batch\t%u\t%g\t%0.3f\n", nt, add, add1 / add);
+        std::fprintf(stdout, "parsum_pool\t%u\t%g\t%0.3f\n", nt, ps, ps1 / ps);
+        std::fprintf(stdout, "parsum_kt_for\t%u\t%g\t%0.3f\n", nt, kt, kt1 / kt);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,52 @@
+#include "sketch/ssi.h"
+#include "aesctr/wy.h"
+#include <chrono>
+#include <thread>
+
+using namespace sketch;
+
+// SetSketchIndex build throughput: single-threaded (no locking) versus make_concurrent() with 1..maxthreads threads.
+// Items are noisy copies of 10007 centers, so many buckets are shared, as for real sketch collections.
+// Usage: ssibuild [n=1000000] [maxthreads=16] [m=64]
+
+static void make_item(uint64_t i, size_t m, std::vector<uint64_t> &item) {
+    wy::WyRand<uint64_t> rng(i);
+    const uint64_t center = i % 10007;
+    for(size_t j = 0; j < m; ++j) item[j] = rng() % 8 ? center * m + j: rng();
+}
+
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 1000000;
+    const unsigned maxthreads = argc > 2 ? std::atoi(argv[2]): 16;
+    const size_t m = argc > 3 ? std::strtoull(argv[3], nullptr, 10): 64;
+    const std::vector<uint32_t> nperhashes{8, 16, 32};
+    auto time_build = [&](unsigned nthreads) {
+        SetSketchIndex<uint64_t, uint32_t> idx(m, nperhashes);
+        if(nthreads) idx.make_concurrent();
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        auto work = [&](unsigned tid, unsigned stride) {
+            std::vector<uint64_t> item(m);
+            for(size_t i = tid; i < n; i += stride) {
+                make_item(i, m, item);
+                idx.update(item);
+            }
+        };
+        if(!nthreads) work(0, 1);
+        else {
+            for(unsigned t = 0; t < nthreads; ++t) threads.emplace_back(work, t, nthreads);
+            for(auto &t: threads) t.join();
+        }
+        const double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        if(idx.size() != n) {
+            std::fprintf(stderr, "Expected %zu items, found %zu\n", n, idx.size());
+            std::exit(EXIT_FAILURE);
+        }
+        return n / elapsed;
+    };
+    std::fprintf(stdout, "#mode\tthreads\tinserts_per_sec\n");
+    std::fprintf(stdout, "serial\t1\t%g\n", time_build(0));
+    for(unsigned nt = 1; nt <= maxthreads; nt <<= 1)
+        std::fprintf(stdout, "concurrent\t%u\t%g\n", nt, time_build(nt));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+#include "sketch/ssi.h"
+#include "aesctr/wy.h"
+#include <chrono>
+#include <fstream>
+
+using namespace sketch;
+
+// SetSketchIndex query throughput and resident memory, with hash tables versus after freeze(),
+// answering queries one at a time (query_candidates) or together (query_candidates_batch).
+// Items are noisy copies of 10007 centers, as in ssibuild.
+// Usage: ssifreeze [n=1000000] [nqueries=10000] [m=64] [maxcand=1000]
+
+static void make_item(uint64_t i, size_t m, std::vector<uint64_t> &item) {
+    wy::WyRand<uint64_t> rng(i);
+    const uint64_t center = i % 10007;
+    for(size_t j = 0; j < m; ++j) item[j] = rng() % 8 ? center * m + j: rng();
+}
+
+static size_t rss_kb() {
+    std::ifstream ifs("/proc/self/statm");
+    size_t vsz = 0, rss = 0;
+    ifs >> vsz >> rss;
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 1000000;
+    const size_t nq = argc > 2 ? std::strtoull(argv[2], nullptr, 10): 10000;
+    const size_t m = argc > 3 ? std::strtoull(argv[3], nullptr, 10): 64;
+    const size_t maxcand = argc > 4 ? std::strtoull(argv[4], nullptr, 10): 1000;
+    const std::vector<uint32_t> nperhashes{8, 16, 32};
+    const size_t base = rss_kb();
+    SetSketchIndex<uint64_t, uint32_t> idx(m, nperhashes);
+    std::vector<uint64_t> item(m);
+    for(size_t i = 0; i < n; ++i) {
+        make_item(i, m, item);
+        idx.update(item);
+    }
+    const size_t hashed_kb = rss_kb() - base;
+    std::vector<std::vector<uint64_t>> queries(nq, std::vector<uint64_t>(m));
+    for(size_t i = 0; i < nq; ++i) make_item(n + i, m, queries[i]);
+    size_t expected = 0;
+    auto check = [&](size_t total) {
+        if(!expected) expected = total;
+        else if(total != expected) {
+            std::fprintf(stderr, "Query modes returned different numbers of candidates\n");
+            std::exit(EXIT_FAILURE);
+        }
+    };
+    auto time_queries = [&](bool batch) {
+        size_t total = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        if(batch) {
+            for(const auto &res: idx.query_candidates_batch(queries, maxcand)) total += std::get<0>(res).size();
+        } else {
+            for(const auto &q: queries) total += std::get<0>(idx.query_candidates(q, maxcand)).size();
+        }
+        const double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        check(total);
+        return nq / elapsed;
+    };
+    std::fprintf(stdout, "#layout\tmode\tqueries_per_sec\tmemory_kB\n");
+    std::fprintf(stdout, "hashed\tsingle\t%g\t%zu\n", time_queries(false), hashed_kb);
+    std::fprintf(stdout, "hashed\tbatch\t%g\t%zu\n", time_queries(true), hashed_kb);
+    idx.freeze();
+    // Freed hash tables may stay resident, so the frozen footprint is taken from the buffer size instead of RSS.
+    std::fprintf(stdout, "frozen\tsingle\t%g\t%zu\n", time_queries(false), idx.frozen_nbytes() / 1024);
+    std::fprintf(stdout, "frozen\tbatch\t%g\t%zu\n", time_queries(true), idx.frozen_nbytes() / 1024);
+    return EXIT_SUCCESS;
+}
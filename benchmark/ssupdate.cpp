@@ -0,0 +1,41 @@
+#include "setsketch.h"
+#include <chrono>
+#include <numeric>
+
+using namespace sketch;
+
+// SetSketch/CSetSketch insertion throughput: update() per item versus update_batch().
+// Batches skip the serial path for items whose first sample cannot enter the sketch,
+// which is nearly all of them once the sketch is saturated (n >> m).
+// Usage: ssupdate [n=10000000] [m=1024]
+
+template<typename F>
+double seconds(const F &func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template<typename Sketch>
+void run(const char *name, const Sketch &proto, const std::vector<uint64_t> &ids) {
+    Sketch serial(proto), batch(proto);
+    const double serial_time = seconds([&]() {for(const auto id: ids) serial.update(id);});
+    const double batch_time = seconds([&]() {batch.update_batch(ids);});
+    if(!(serial == batch)) {
+        std::fprintf(stderr, "Serial and batched updates differ for %s\n", name);
+        std::exit(EXIT_FAILURE);
+    }
+    std::fprintf(stdout, "%s\t%zu\t%g\t%g\t%0.3f\n", name, ids.size(), ids.size() / serial_time, ids.size() / batch_time, serial_time / batch_time);
+}
+
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10): 10000000;
+    const size_t m = argc > 2 ? std::strtoull(argv[2], nullptr, 10): 1024;
+    std::vector<uint64_t> ids(n);
+    std::iota(ids.begin(), ids.end(), uint64_t(0));
+    std::fprintf(stdout, "#sketch\tn\tserial_per_sec\tbatch_per_sec\tspeedup\n");
+    run("CSetSketch<double>", CSetSketch<double>(m), ids);
+    run("SetSketch<uint16_t>", SetSketch<uint16_t>(m, 1.0006, 20., 62000), ids);
+    run("ByteSetS", ByteSetS(m), ids);
+    return EXIT_SUCCESS;
+}
@@ -423,7 +423,7 @@ public:
                     vp2 += b_;
                     lsum = _mm512_add_epi64(detail::matching_bits(vp1, vp2, b_), lsum);
                 }
-                assert((value_type*)vp1 == &core_[core_.size()]);
+                assert((const value_type *)(vp1 + b_) == pe);
                 sum = common::sum_of_u64s(lsum);
                 break;
             }
@@ -1469,7 +1469,7 @@ public:
                     vp2 += b_;
                     sum = _mm512_add_epi64(detail::matching_bits(vp1, vp2, b_), sum);
                 }
-                assert((value_type*)vp1 == &core_[core_.size()]);
+                assert((const value_type *)(vp1 + b_) == &core_[core_.size()]);
                 return common::sum_of_u64s(sum);
             }
 #    else /* has avx2 not not 512 */
@@ -1919,7 +1919,7 @@ struct FinalCountingBBitMinHash: public FinalBBitMinHash {
                         offset += 64;
                     }
                 }
-                assert((value_type*)vp1 == &core_[core_.size()]);
+                assert((const value_type *)(vp1 + b_) == &core_[core_.size()]);
                 sum = common::sum_of_u64s(lsum);
                 break;
             }
@@ -31,82 +31,155 @@ static std::vector<unsigned> pcbf_bf_mgen(unsigned nsketches, unsigned l2sz, boo
 
 template<typename HashStruct=WangHash, typename RngType=common::DefaultRNGType>
 class cbfbase_t {
+    // Counting bloom filter: a stack of cache-line-blocked filters (levels), where a key inserted c times
+    // is expected to be present in the first ~log2(c) + 1 levels, level i accepting an insertion with probability 2^-i.
+    // All levels share one allocation. A key is hashed once; its in-block probe pattern is computed once and shared,
+    // and only the block differs between levels, so a query prefetches one cache line per level and tests each with one mask comparison.
 protected:
-    std::vector<bfbase_t<HashStruct>> bfs_;
+    struct level_t {
+        uint64_t salt;       // Odd multiplier selecting this level's block from the key's hash
+        uint64_t offset;     // First word of this level
+        uint64_t block_mask; // Number of blocks in the level, minus one
+    };
+    std::vector<uint64_t, Allocator<uint64_t>> core_;
+    std::vector<level_t> levels_;
+    HashStruct hf_;
+    uint64_t seed_;
+    uint8_t nh_;
     RngType   rng_;
     uint64_t  gen_;
     uint8_t nbits_;
-    // TODO: this can be improved by providing a continuous chunk of memory
-    //       and performing all operations on subfilters.
-public:
-    explicit cbfbase_t(const std::vector<unsigned> &l2szs, unsigned nhashes, uint64_t seedseedseedval): rng_{seedseedseedval}, gen_(rng_()), nbits_(64) {
-#if !NDEBUG
-            std::fprintf(stderr, "Total l2szs: %s. nh: %u, seed: %" PRIu64".\n", std::accumulate(std::begin(l2szs), std::end(l2szs), std::string(""),
-                         [](std::string &a, unsigned u) -> std::string & {
-                return a += std::to_string(u) + ',';
-            }).data(), nhashes, seedseedseedval);
-#endif
+    static constexpr unsigned BLOCK_WORDS = detail::BLOCK_WORDS;
+    static constexpr size_t MAX_LEVELS = 64;
+
+    void layout(const std::vector<unsigned> &l2szs) {
         if(l2szs.empty()) throw std::runtime_error("Need at least 1 size for hashes.");
-        bfs_.reserve(l2szs.size());
-        std::generate_n(std::back_inserter(bfs_), l2szs.size(), [&]{return bfbase_t<HashStruct>(l2szs[bfs_.size()], nhashes, rng_());});
+        if(l2szs.size() > MAX_LEVELS) throw std::invalid_argument("Counting bloom filters support at most 64 levels");
+        levels_.clear();
+        uint64_t offset = 0;
+        for(const unsigned l2sz: l2szs) {
+            if(l2sz < 9 || l2sz > 40) throw std::invalid_argument(std::string("Counting bloom filter levels must have 2^9-2^40 bits, not 2^") + std::to_string(l2sz));
+            levels_.push_back(level_t{rng_() | 1, offset, (uint64_t(1) << (l2sz - 9)) - 1});
+            offset += uint64_t(BLOCK_WORDS) << (l2sz - 9);
+        }
+        core_.assign(offset, uint64_t(0));
+    }
+    INLINE uint64_t *block(const level_t &level, uint64_t h) {
+        return core_.data() + level.offset + (((h * level.salt) >> 32) & level.block_mask) * BLOCK_WORDS;
+    }
+    INLINE const uint64_t *block(const level_t &level, uint64_t h) const {
+        return core_.data() + level.offset + (((h * level.salt) >> 32) & level.block_mask) * BLOCK_WORDS;
+    }
+    // Number of leading levels which contain every probe of h.
+#if __AVX512F__
+    INLINE unsigned depth(uint64_t h, __m512i probes) const {
+#else
+    INLINE unsigned depth(uint64_t h, const uint64_t *probes) const {
+#endif
+        const size_t nl = levels_.size();
+        const uint64_t *blocks[MAX_LEVELS];
+        for(size_t i = 0; i < nl; ++i) __builtin_prefetch(blocks[i] = block(levels_[i], h));
+        for(size_t i = 0; i < nl; ++i) {
+#if __AVX512F__
+            if(_mm512_test_epi64_mask(_mm512_maskz_andnot_epi64(0xFF, _mm512_loadu_si512(blocks[i]), probes), probes)) return i;
+#else
+            uint64_t missing = 0;
+            for(unsigned j = 0; j < BLOCK_WORDS; ++j) missing |= probes[j] & ~blocks[i][j];
+            if(missing) return i;
+#endif
+        }
+        return nl;
+    }
+public:
+    explicit cbfbase_t(const std::vector<unsigned> &l2szs, unsigned nhashes, uint64_t seedseedseedval):
+        nh_(nhashes), rng_{seedseedseedval}, gen_(rng_()), nbits_(64)
+    {
+        if(nhashes == 0 || nhashes > sizeof(detail::block_salts) / sizeof(detail::block_salts[0]))
+            throw std::invalid_argument("Counting bloom filters support 1-32 hash functions");
+        seed_ = rng_();
+        layout(l2szs);
     }
     explicit cbfbase_t(size_t nbfs, size_t l2sz, unsigned nhashes, uint64_t seedseedseedval, bool shrinkpow2=true):
         cbfbase_t(detail::pcbf_bf_mgen(nbfs, l2sz, shrinkpow2),  nhashes, seedseedseedval) {}
     void reseed(uint64_t seed) {
         rng_.seed(seed);
     }
+    // Inserts val, returning its estimated count afterwards (as est_count would).
     INLINE unsigned addh(const uint64_t val) {
-        auto it(bfs_.begin());
-        if(!it->may_contain_and_addh(val))
-            return 1u;
-        FOREVER {
-            ++it;
-            if(it == bfs_.end()) return 1u << bfs_.size();
-            if(!it->may_contain(val)) {
-                const auto dist = static_cast<unsigned>(std::distance(bfs_.begin(), it));
-                if(HEDLEY_UNLIKELY(nbits_ < dist)) gen_ = rng_(), nbits_ = 64;
-                if((gen_ & (UINT64_C(-1) >> (64 - dist))) == 0) it->addh(val); // Flip the biased coin, add if it returns 'heads'
-                gen_ >>= dist, nbits_ -= dist;
-            }
+        const uint64_t h = hf_(val ^ seed_);
+#if __AVX512F__
+        const __m512i probes = detail::block_probes(h, nh_);
+#else
+        uint64_t probes[BLOCK_WORDS];
+        detail::block_probes(h, nh_, probes);
+#endif
+        const unsigned dist = depth(h, probes);
+        if(dist == levels_.size()) return 1u << (dist - 1); // Else already at capacity
+        if(dist) {
+            // Flip the biased coin, adding to the next level with probability 2^-dist.
+            if(HEDLEY_UNLIKELY(nbits_ < dist)) gen_ = rng_(), nbits_ = 64;
+            const bool heads = (gen_ & (UINT64_C(-1) >> (64 - dist))) == 0;
+            gen_ >>= dist, nbits_ -= dist;
+            if(!heads) return 1u << (dist - 1);
         }
-        // Otherwise, probabilistically insert at position.
-        if(it != bfs_.end()) {
-            return -1u;
-        } // Else already at capacity
-        return 1u << (std::distance(bfs_.begin(), it) - 1);
+        uint64_t *const dest = block(levels_[dist], h);
+#if __AVX512F__
+        _mm512_storeu_si512(dest, _mm512_or_si512(_mm512_loadu_si512(dest), probes));
+#else
+        for(unsigned j = 0; j < BLOCK_WORDS; ++j) dest[j] |= probes[j];
+#endif
+        return 1u << dist;
     }
     bool may_contain(uint64_t val) const {
-        return bfs_[0].may_contain(val);
+        const uint64_t h = hf_(val ^ seed_);
+        const uint64_t *const b = block(levels_[0], h);
+#if __AVX512F__
+        const __m512i probes = detail::block_probes(h, nh_);
+        return _mm512_test_epi64_mask(_mm512_maskz_andnot_epi64(0xFF, _mm512_loadu_si512(b), probes), probes) == 0;
+#else
+        uint64_t probes[BLOCK_WORDS], missing = 0;
+        detail::block_probes(h, nh_, probes);
+        for(unsigned j = 0; j < BLOCK_WORDS; ++j) missing |= probes[j] & ~b[j];
+        return missing == 0;
+#endif
     }
     unsigned est_count(const uint64_t val) const {
-        auto it(bfs_.cbegin());
-        if(!it->may_contain(val)) return 0;
-        for(++it;it < bfs_.end() && it->may_contain(val); ++it);
-        return 1u << (std::distance(bfs_.cbegin(), it) - 1);
+        const uint64_t h = hf_(val ^ seed_);
+#if __AVX512F__
+        const unsigned d = depth(h, detail::block_probes(h, nh_));
+#else
+        uint64_t probes[BLOCK_WORDS];
+        detail::block_probes(h, nh_, probes);
+        const unsigned d = depth(h, probes);
+#endif
+        return d ? 1u << (d - 1): 0u;
     }
-    void resize_sketches(unsigned np) {
-        for(auto &bf: bfs_) bf.resize(np);
+    // Resizes every level to 2^l2sz bits, clearing the filter.
+    void resize_sketches(unsigned l2sz) {
+        layout(std::vector<unsigned>(levels_.size(), l2sz));
     }
+    // Changes the number of levels, each taking the size of the first level, clearing the filter.
     void resize(unsigned nbfs) {
-        bfs_.reserve(nbfs);
-        auto nhashes = bfs_.at(0).nhashes();
-        auto np = bfs_[0].p();
-        clear();
-        while(bfs_.size() < nbfs) bfs_.emplace_back(np, nhashes, rng_());
+        layout(std::vector<unsigned>(nbfs, p()));
     }
     void clear() {
-        for(auto &bf: bfs_) bf.clear();
+        std::fill(core_.begin(), core_.end(), uint64_t(0));
+    }
+    void free() {
+        decltype(core_) tmp{};
+        std::swap(core_, tmp);
     }
     auto p() const {
-        return bfs_[0].p();
+        return unsigned(ilog2(levels_[0].block_mask + 1) + 9);
     }
     auto nhashes() const {
-        return bfs_[0].nhashes();
+        return unsigned(nh_);
     }
-    std::size_t size() const {return bfs_.size();}
-    std::size_t filter_size() const {return bfs_[0].size();}
-    auto begin() const {return bfs_.cbegin();}
-    auto end() const {return bfs_.cend();}
+    std::size_t size() const {return levels_.size();}
+    std::size_t filter_size() const {return (levels_[0].block_mask + 1) << 9;}
+    // Words of level i.
+    const uint64_t *level_data(size_t i) const {return core_.data() + levels_.at(i).offset;}
+    size_t level_words(size_t i) const {return (levels_.at(i).block_mask + 1) * BLOCK_WORDS;}
 };
 using cbf_t = cbfbase_t<>;
 
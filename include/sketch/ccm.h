@@ -321,49 +321,33 @@ public:
     }
     static constexpr bool is_increment = std::is_same<UpdateStrategy, update::Increment>::value;
     ssize_t add(const uint64_t val) {
-        unsigned nhdone = 0;
         ssize_t ret;
         CONST_IF(conservative_update) {
-            std::vector<uint64_t> indices, best_indices;
-            indices.reserve(nhashes_);
-            //std::fprintf(stderr, "Doing SIMD stuff\n");
-            //std::fprintf(stderr, "Doing Leftover stuff\n");
-            while(nhdone < nhashes_) {
-                assert(seeds_.data());
-                uint64_t hv = hash(val, nhdone);
-                auto index = subtbl_sz_ * nhdone++ + (hv & mask_);
-                indices.push_back(index);
+            // Stack buffers cover up to 16 rows, so the usual configurations never allocate.
+            tmpbuffer<uint64_t, 16> indices(nhashes_);
+            tmpbuffer<ssize_t, 16> counts(nhashes_);
+            uint64_t *const ip = indices.get();
+            ssize_t *const cp = counts.get();
+            // Rows hash independently, so this loop vectorizes; counters are then read in one pass.
+            for(unsigned i = 0; i < nhashes_; ++i)
+                ip[i] = subtbl_sz_ * i + (hash(val, i) & mask_);
+            for(unsigned i = 0; i < nhashes_; ++i)
+                cp[i] = data_.operator[](ip[i]);
+            const ssize_t minval = *std::min_element(cp, cp + nhashes_);
+            // Move the rows holding the minimum to the front, in order; only those are updated.
+            unsigned nbest = 0;
+            for(unsigned i = 0; i < nhashes_; ++i) {
+                ip[nbest] = ip[i];
+                nbest += cp[i] == minval;
             }
-#if 0
-            if(val == 137) {
-                for(const auto v: indices) std::fprintf(stderr, "index for 137: %u\n", unsigned(v));
-            }
-#endif
-            best_indices.push_back(indices[0]);
-            ssize_t minval = data_.operator[](indices[0]);
-            for(size_t i(1); i < indices.size(); ++i) {
-                unsigned score;
-                if((score = data_.operator[](indices[i])) == minval) {
-                    best_indices.push_back(indices[i]);
-                } else if(score < minval) {
-                    best_indices.clear();
-                    best_indices.push_back(indices[i]);
-                    minval = score;
-                }
-            }
-            //std::fprintf(stderr, "Now update\n");
-            updater_(best_indices, data_, nbits_);
+            updater_(static_cast<const uint64_t *>(ip), nbest, data_, nbits_);
             ret = minval;
-            //std::fprintf(stderr, "Now updated\n");
         } else { // not conservative update. This means we support deletions
             ret = std::numeric_limits<decltype(ret)>::max();
             const auto maxv = 1ull << nbits_;
-            std::vector<uint64_t> indices{0};
-            while(nhdone < nhashes_) {
-                uint64_t hv = hash(val, nhdone);
-                auto ind = (hv & mask_) + subtbl_sz_ * nhdone++;
-                indices[0] = ind;
-                updater_(indices, data_, maxv);
+            for(unsigned i = 0; i < nhashes_; ++i) {
+                const uint64_t ind = (hash(val, i) & mask_) + subtbl_sz_ * i;
+                updater_(&ind, 1, data_, maxv);
                 ret = std::min(ret, ssize_t(data_[ind]));
             }
         }
@@ -1,14 +1,21 @@
 #ifndef DDSKETCH_H__
 #define DDSKETCH_H__
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <numeric>
 #include <limits>
 #include <stdexcept>
+#include <type_traits>
 #include <cmath>
 
 #include "macros.h"
+#include "isa.h"
 
 namespace sketch {
 
@@ -22,124 +29,228 @@ using std::uint64_t;
 // Based on implementation from https://raw.githubusercontent.com/DataDog/sketches-py/master/ddsketch/ddsketch.py
 // Accessed 9/6/19
 
-template<typename IntegerType=std::int64_t, size_t initial_nbins=128, size_t grow_left_by=128>
+namespace detail {
+
+// dst[i] += src[i] for i < n, for merging bins.
+template<typename T>
+inline void add_bins_base(T *dst, const T *src, size_t n) {
+    for(size_t i = 0; i < n; ++i) dst[i] += src[i];
+}
+#if SKETCH_ISA_DISPATCH
+SKETCH_TARGET_AVX2 inline void add_bins_avx2(uint64_t *dst, const uint64_t *src, size_t n) {
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        __m256i *d = reinterpret_cast<__m256i *>(dst + i);
+        _mm256_storeu_si256(d, _mm256_add_epi64(_mm256_loadu_si256(d), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i))));
+    }
+    add_bins_base(dst + i, src + i, n - i);
+}
+SKETCH_TARGET_AVX2 inline void add_bins_avx2(uint32_t *dst, const uint32_t *src, size_t n) {
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i *d = reinterpret_cast<__m256i *>(dst + i);
+        _mm256_storeu_si256(d, _mm256_add_epi32(_mm256_loadu_si256(d), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i))));
+    }
+    add_bins_base(dst + i, src + i, n - i);
+}
+SKETCH_TARGET_AVX512 inline void add_bins_avx512(uint64_t *dst, const uint64_t *src, size_t n) {
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+        _mm512_storeu_si512(dst + i, _mm512_add_epi64(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+    if(i < n) {
+        const __mmask8 m = (1u << (n - i)) - 1;
+        _mm512_mask_storeu_epi64(dst + i, m, _mm512_add_epi64(_mm512_maskz_loadu_epi64(m, dst + i), _mm512_maskz_loadu_epi64(m, src + i)));
+    }
+}
+SKETCH_TARGET_AVX512 inline void add_bins_avx512(uint32_t *dst, const uint32_t *src, size_t n) {
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16)
+        _mm512_storeu_si512(dst + i, _mm512_add_epi32(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+    if(i < n) {
+        const __mmask16 m = (1u << (n - i)) - 1;
+        _mm512_mask_storeu_epi32(dst + i, m, _mm512_add_epi32(_mm512_maskz_loadu_epi32(m, dst + i), _mm512_maskz_loadu_epi32(m, src + i)));
+    }
+}
+#endif /* SKETCH_ISA_DISPATCH */
+
+// Integer bins of 4 or 8 bytes, signed or not, are added as unsigned lanes.
+template<typename T>
+struct has_add_kernel: std::integral_constant<bool, SKETCH_ISA_DISPATCH && std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8)> {};
+
+template<typename T>
+inline void add_bins_isa(T *dst, const T *src, size_t n, isa_t isa, std::true_type) {
+#if SKETCH_ISA_DISPATCH
+    using U = std::conditional_t<sizeof(T) == 8, uint64_t, uint32_t>;
+    U *ud = reinterpret_cast<U *>(dst);
+    const U *us = reinterpret_cast<const U *>(src);
+    if(isa >= isa_t::AVX512) return add_bins_avx512(ud, us, n);
+    if(isa >= isa_t::AVX2) return add_bins_avx2(ud, us, n);
+#endif
+    add_bins_base(dst, src, n);
+}
+template<typename T>
+inline void add_bins_isa(T *dst, const T *src, size_t n, isa_t, std::false_type) {
+    add_bins_base(dst, src, n);
+}
+template<typename T>
+inline void add_bins_isa(T *dst, const T *src, size_t n, isa_t isa) {
+    add_bins_isa(dst, src, n, isa, has_add_kernel<T>());
+}
+
+} // namespace detail
+
+/*
+ * Counts by integer key over a contiguous range of at most maxbins_ keys.
+ * When a key would stretch the range past that, the lowest keys are collapsed into the lowest bin kept,
+ * which keeps the upper quantiles accurate.
+ *
+ * The bins form a ring: key k lives at bins_[(head_ + k - mink_) & (capacity - 1)], where the capacity is a power of two
+ * and every slot outside the range holds zero. So the range grows in either direction by moving head_ instead of the bins,
+ * and only doubling the capacity copies them.
+ *
+ * Rank queries use cumulative counts, rebuilt on the first query after an update under a lock,
+ * so several threads may query one Store at once, but not while another updates it.
+ */
+template<typename IntegerType=std::int64_t, size_t initial_nbins=128>
 struct Store {
 
     const size_t maxbins_;
-    std::vector<IntegerType> bins_; // TODO: consider using std::deque; this depends on how often it needs to shift
-    size_t count_;
-    uint64_t mink_, maxk_;
+    std::vector<IntegerType> bins_;
+    size_t head_;
+    uint64_t count_;
+    int64_t mink_, maxk_;
+    // Cumulative counts for const rank queries; copies start empty and rebuild on demand.
+    struct index_type {
+        std::vector<uint64_t> v_;
+        std::atomic<bool> valid_{false};
+        std::mutex mut_;
+        index_type() = default;
+        index_type(const index_type &) {}
+        void invalidate() {valid_.store(false, std::memory_order_relaxed);}
+    };
+    mutable index_type cum_;
 
     using Type = IntegerType;
 
-    Store(size_t maxnbins): maxbins_(maxnbins), bins_(initial_nbins, 0), count_(0), mink_(0), maxk_(0) {}
+    static size_t roundup(size_t n) {
+        size_t ret = 1;
+        while(ret < n) ret <<= 1;
+        return ret;
+    }
+
+    Store(size_t maxnbins): maxbins_(std::max(maxnbins, size_t(1))), bins_(roundup(std::min(initial_nbins, maxbins_)), 0),
+                            head_(0), count_(0), mink_(0), maxk_(0) {}
     Store(const Store &o) = default;
     Store(Store &&o) = default;
 
-    Store& operator=(const Store &o) = default;
-    Store& operator=(Store &&o) = default;
+    size_t mask() const {return bins_.size() - 1;}
+    // Number of bins in the key range.
+    size_t size() const {return count_ ? size_t(maxk_ - mink_) + 1: 0;}
+    size_t capacity() const {return bins_.size();}
+    uint64_t count() const {return count_;}
+    int64_t min_key() const {return mink_;}
+    int64_t max_key() const {return maxk_;}
+    // Bin i of the range, i.e., for key min_key() + i.
+    IntegerType &operator[](size_t i) {return bins_[(head_ + i) & mask()];}
+    const IntegerType &operator[](size_t i) const {return bins_[(head_ + i) & mask()];}
+    IntegerType count_at(int64_t key) const {return count_ && key >= mink_ && key <= maxk_ ? (*this)[key - mink_]: IntegerType(0);}
 
-    auto begin() {return bins_.begin();}
-    auto end()   {return bins_.end();}
-    auto begin() const {return bins_.begin();}
-    auto end()   const {return bins_.end();}
-    IntegerType &operator[](size_t i) {return bins_[i];}
-    const IntegerType &operator[](size_t i) const {return bins_[i];}
+    void clear() {
+        std::fill(bins_.begin(), bins_.end(), IntegerType(0));
+        head_ = count_ = 0;
+        mink_ = maxk_ = 0;
+        cum_.invalidate();
+    }
 
     Store &operator+=(const Store &o) {
         if(o.count_ == 0) return *this;
-        if(count_ == 0)
-            std::copy(o.begin(), o.end(), begin());
-        const bool minklt = o.mink_ < mink_;
-        if(maxk_ > o.maxk_) {
-            if(minklt) grow_left(o.mink_);
-
-            for(size_t i = std::max(mink_, o.mink_), e = o.maxk_ + 1;i < e; ++i)
-                bins_[i - mink_] += o.bins_[i - o.mink_];
-
-            if(!minklt)
-                bins_.front() += std::accumulate(o.begin(), o.begin() + (mink_ - o.mink_), IntegerType(0));
-        } else {
-            if(minklt) {
-                auto tmp = o.bins_;
-                for(size_t i = mink_; i < maxk_ + 1; ++i)
-                    tmp[i - o.mink_] += bins_[i - mink_];
-                bins_ = std::move(tmp);
-                maxk_ = o.maxk_;
-                mink_ = o.mink_;
-            } else {
-                grow_right(maxk_);
-                for(size_t i = o.mink_; i < o.maxk_ + 1; ++i)
-                    bins_[i - mink_] += o.bins_[i - o.mink_];
-            }
+        if(count_ == 0) mink_ = maxk_ = o.maxk_;
+        extend(std::min(mink_, o.mink_), std::max(maxk_, o.maxk_));
+        int64_t k = o.mink_;
+        if(k < mink_) {
+            IntegerType collapsed = 0;
+            for(; k < mink_ && k <= o.maxk_; ++k) collapsed += o[k - o.mink_];
+            (*this)[0] += collapsed;
+        }
+        // The remaining keys are contiguous in both rings but for wrap-arounds, so they are added in at most three runs.
+        const isa_t isa = runtime_isa();
+        while(k <= o.maxk_) {
+            const size_t di = (head_ + size_t(k - mink_)) & mask(), si = (o.head_ + size_t(k - o.mink_)) & o.mask();
+            const size_t n = std::min(size_t(o.maxk_ - k) + 1, std::min(bins_.size() - di, o.bins_.size() - si));
+            detail::add_bins_isa(&bins_[di], &o.bins_[si], n, isa);
+            k += n;
         }
         count_ += o.count_;
+        cum_.invalidate();
         return *this;
     }
-    Store operator+(const Store &o) {
+    Store operator+(const Store &o) const {
         auto ret = *this;
         ret += o;
         return ret;
     }
 
-    void addh(uint64_t key) {
+    void addh(int64_t key, IntegerType n=1) {
         if(unlikely(count_ == 0))
             mink_ = maxk_ = key;
-        else {
-            if(key < mink_) grow_left(key);
-            else grow_right(key);
-        }
-        ++bins_[std::max(ssize_t(0), ssize_t(key - mink_))];
-        ++count_;
+        else if(key < mink_)
+            extend(std::max(key, maxk_ - int64_t(maxbins_) + 1), maxk_);
+        else if(key > maxk_)
+            extend(mink_, key);
+        (*this)[std::max(key, mink_) - mink_] += n;
+        count_ += n;
+        cum_.invalidate();
     }
-    size_t size() const {return bins_.size();}
-    void grow_left(uint64_t key) {
-        if(mink_ < key || size() >= maxbins_) return;
-        uint64_t tmpmink;
-        if(maxk_ - key >= maxbins_) tmpmink = maxk_ - maxbins_ + 1;
-        else {
-            tmpmink = mink_;
-            while(tmpmink > key) tmpmink -= grow_left_by;
-        }
-        bins_.insert(bins_.begin(), mink_ - key, IntegerType(0));
-        mink_ = tmpmink;
-    }
-    void grow_right(uint64_t key) {
-        if(key < maxk_) return;
-        if(key - maxk_ >= maxbins_) {
-            bins_.resize(maxbins_);
-            std::fill(std::begin(bins_) + 1, std::end(bins_), 0);
-            bins_.front() = count_;
-            maxk_ = key;
-            mink_ = key - maxbins_ + 1;
-        } else if(key - mink_ >= maxbins_) {
-            auto tmpmink = key - maxbins_ + 1;
-            auto keydiff = tmpmink - mink_;
-            auto beg = std::begin(bins_);
-            auto endit = beg + keydiff - 1;
-            auto n = std::accumulate(beg + 1, endit, *beg);
-            bins_.erase(beg, endit);
-            bins_.insert(bins_.end(), key - maxk_, IntegerType(0));
-            maxk_ = key;
-            mink_ = tmpmink;
-            bins_.front() += n;
-        } else {
-            bins_.insert(bins_.end(), key - maxk_, IntegerType(0));
-            maxk_ = key;
+    // Widens the range to [lo, hi] (lo <= mink_, hi >= maxk_), keeping at most maxbins_ bins.
+    void extend(int64_t lo, int64_t hi) {
+        if(uint64_t(hi - lo) >= maxbins_) lo = hi - int64_t(maxbins_) + 1;
+        if(lo > mink_) {
+            IntegerType collapsed = 0;
+            for(int64_t k = mink_, e = std::min(lo, maxk_ + 1); k < e; ++k) {
+                auto &b = (*this)[k - mink_];
+                collapsed += b;
+                b = 0;
+            }
+            head_ = (head_ + size_t(lo - mink_)) & mask();
+            mink_ = lo;
+            maxk_ = std::max(maxk_, lo);
+            (*this)[0] += collapsed;
         }
-        throw std::runtime_error("NotImplemented");
-    }
-    auto key_at_rank(uint64_t rank) const {
-        // If this was managed better [e.g., prefix scan] we'd look it up
-        // in log time, but whether that matters depends on the number of bins
-        auto it = std::cbegin(bins_);
-        const auto e = std::cend(bins_);
-        uint64_t n = *it++;
-        do {
-            if(n >= rank) return it - std::cbegin(bins_) + mink_;
-            n += *it++;
-        } while(it != e);
-        return maxk_;
+        reserve(size_t(hi - lo) + 1);
+        head_ = (head_ - size_t(mink_ - lo)) & mask();
+        mink_ = lo;
+        maxk_ = hi;
+    }
+    // Makes room for n bins, laying the current range out from slot 0.
+    void reserve(size_t n) {
+        if(n <= bins_.size()) return;
+        std::vector<IntegerType> tmp(roundup(n), IntegerType(0));
+        for(size_t i = 0, e = size(); i < e; ++i) tmp[i] = (*this)[i];
+        bins_ = std::move(tmp);
+        head_ = 0;
+    }
+
+    void build_index() const {
+        if(cum_.valid_.load(std::memory_order_acquire)) return;
+        std::lock_guard<std::mutex> lock(cum_.mut_);
+        if(cum_.valid_.load(std::memory_order_relaxed)) return;
+        cum_.v_.resize(size());
+        uint64_t sum = 0;
+        for(size_t i = 0; i < cum_.v_.size(); ++i) cum_.v_[i] = sum += (*this)[i];
+        cum_.valid_.store(true, std::memory_order_release);
+    }
+    // Smallest key whose bin holds the rank-th value (from 1).
+    int64_t key_at_rank(uint64_t rank) const {
+        build_index();
+        auto it = std::lower_bound(cum_.v_.begin(), cum_.v_.end(), rank);
+        return it == cum_.v_.end() ? maxk_: mink_ + int64_t(it - cum_.v_.begin());
+    }
+    // Number of values in bins with keys up to key.
+    uint64_t rank_of_key(int64_t key) const {
+        if(!count_ || key < mink_) return 0;
+        if(key >= maxk_) return count_;
+        build_index();
+        return cum_.v_[key - mink_];
     }
 };
 
@@ -162,8 +273,9 @@ public:
         maxbins_(max_bins),
         alpha_(alpha), gamma_(1. + 2.*alpha/(1-alpha)), lgamma_(std::log1p(2.*alpha/(1.-alpha))),
         mv_(min_value), sum_(0), count_(0),
-        lowest_(std::numeric_limits<FType>::min()), highest_(std::numeric_limits<FType>::max()),
-        offset_(-static_cast<int32_t>(std::ceil(std::log(mv_)/lgamma_)) + 1)
+        lowest_(std::numeric_limits<FType>::max()), highest_(std::numeric_limits<FType>::lowest()),
+        offset_(-static_cast<int32_t>(std::ceil(std::log(mv_)/lgamma_)) + 1),
+        store_(max_bins)
     {
     }
     int64_t get_key(FType val) const  {
@@ -173,6 +285,14 @@ public:
             return static_cast<int64_t>(std::ceil(std::log(val)/lgamma_)) + offset_;
         return 0;
     }
+    // Midpoint, in relative terms, of the values mapped to key.
+    FType value_of_key(int64_t key) const {
+        if(key < 0)
+            return -2. * std::pow(double(gamma_), double(-key - offset_)) / (1. + gamma_);
+        if(key > 0)
+            return 2. * std::pow(double(gamma_), double(key - offset_)) / (1. + gamma_);
+        return 0;
+    }
     void addh(FType x) {
         auto k = get_key(x);
         store_.addh(k);
@@ -181,10 +301,182 @@ public:
         if(x < lowest_) lowest_ = x;
         if(x > highest_) highest_ = x;
     }
+    DDSketch &operator+=(const DDSketch &o) {
+        if(alpha_ != o.alpha_ || mv_ != o.mv_ || maxbins_ != o.maxbins_)
+            throw std::runtime_error("Non-matching parameters for DDSketch merge");
+        store_ += o.store_;
+        count_ += o.count_;
+        sum_ += o.sum_;
+        lowest_ = std::min(lowest_, o.lowest_);
+        highest_ = std::max(highest_, o.highest_);
+        return *this;
+    }
+    DDSketch operator+(const DDSketch &o) const {
+        auto ret = *this;
+        ret += o;
+        return ret;
+    }
+
+    /*
+     * Quantile, rank and CDF queries share the store's cumulative counts, rebuilt under a lock by the first query after an update.
+     * Any number of threads may query one sketch at once, but updates and merges need exclusive access.
+     */
+    // Value at quantile q in [0, 1], within relative error alpha of the exact one, or NaN if q is out of range or the sketch is empty.
+    FType quantile(double q) const {
+        if(!(q >= 0. && q <= 1.) || !count_) return std::numeric_limits<FType>::quiet_NaN();
+        const uint64_t rank = q * (count_ - 1) + 1;
+        return std::min(std::max(value_of_key(store_.key_at_rank(rank)), lowest_), highest_);
+    }
+    // Quantiles for n values of q, sharing one index.
+    void quantiles(const double *qs, size_t n, FType *out) const {
+        store_.build_index();
+        for(size_t i = 0; i < n; ++i) out[i] = quantile(qs[i]);
+    }
+    std::vector<FType> quantiles(const std::vector<double> &qs) const {
+        std::vector<FType> ret(qs.size());
+        quantiles(qs.data(), qs.size(), ret.data());
+        return ret;
+    }
+    // Estimated number of values at most x: those in x's bin and below.
+    uint64_t rank(FType x) const {return store_.rank_of_key(get_key(x));}
+    // Estimated fraction of values at most x.
+    double cdf(FType x) const {return count_ ? double(rank(x)) / count_: 0.;}
+
+    uint64_t count() const {return count_;}
+    double sum() const {return sum_;}
+    double mean() const {return sum_ / count_;}
+    FType min() const {return lowest_;}
+    FType max() const {return highest_;}
+    FType alpha() const {return alpha_;}
+    const StoreT &store() const {return store_;}
 }; // class DDSketch
 
+/*
+ * DDSketch for many concurrent writers.
+ * Each writer thread records into its own Collector, which at most once per interval pushes its sketch onto a lock-free list
+ * and starts a fresh one, so writers never wait on each other or on readers.
+ * There is no background thread: a collector only pushes from addh() once its interval has passed, from flush(), or when destroyed,
+ * so an idle collector keeps its records until one of those. A pushed sketch is merged into the global sketch right away
+ * if the pushing writer wins a try_lock on the merge lock; otherwise it waits for the next writer that does, or for the next query.
+ * Collectors must not outlive the ConcurrentDDSketch they feed.
+ */
+template<typename FType=float, typename StoreT=Store<>>
+class ConcurrentDDSketch {
+public:
+    using sketch_type = DDSketch<FType, StoreT>;
+    using clock_type = std::chrono::steady_clock;
+private:
+    struct node_t {
+        sketch_type sk_;
+        node_t *next_;
+        node_t(const sketch_type &sk): sk_(sk), next_(nullptr) {}
+    };
+    const sketch_type empty_;
+    const clock_type::duration interval_;
+    mutable std::atomic<node_t *> pending_;
+    mutable std::mutex mut_;
+    mutable sketch_type global_;
+    mutable uint64_t nmerges_;
+
+    void push(node_t *n) {
+        n->next_ = pending_.load(std::memory_order_relaxed);
+        while(!pending_.compare_exchange_weak(n->next_, n, std::memory_order_release, std::memory_order_relaxed));
+        std::unique_lock<std::mutex> lock(mut_, std::try_to_lock);
+        if(lock.owns_lock()) merge_pending();
+    }
+    // Requires mut_.
+    void merge_pending() const {
+        for(node_t *n = pending_.exchange(nullptr, std::memory_order_acquire), *next; n; n = next) {
+            global_ += n->sk_;
+            next = n->next_;
+            delete n;
+            ++nmerges_;
+        }
+    }
+public:
+    class Collector {
+        ConcurrentDDSketch &parent_;
+        std::unique_ptr<node_t> node_;
+        clock_type::time_point deadline_;
+        unsigned until_check_;
+    public:
+        // Records between clock reads.
+        static constexpr unsigned CHECK_EVERY = 256;
+        Collector(ConcurrentDDSketch &parent): parent_(parent), node_(new node_t(parent.empty_)),
+                                               deadline_(clock_type::now() + parent.interval_), until_check_(CHECK_EVERY) {}
+        // The moved-from collector gets an empty sketch of its own, so it remains usable.
+        Collector(Collector &&o): parent_(o.parent_), node_(std::move(o.node_)), deadline_(o.deadline_), until_check_(o.until_check_) {
+            o.node_.reset(new node_t(parent_.empty_));
+        }
+        Collector(const Collector &o) = delete;
+        ~Collector() {
+            if(node_ && node_->sk_.count()) parent_.push(node_.release());
+        }
+        INLINE void addh(FType x) {
+            node_->sk_.addh(x);
+            if(unlikely(--until_check_ == 0)) {
+                until_check_ = CHECK_EVERY;
+                const auto now = clock_type::now();
+                if(now >= deadline_) {
+                    flush();
+                    deadline_ = now + parent_.interval_;
+                }
+            }
+        }
+        // Hands everything recorded so far to the global sketch.
+        void flush() {
+            if(!node_->sk_.count()) return;
+            parent_.push(node_.release());
+            node_.reset(new node_t(parent_.empty_));
+        }
+        const sketch_type &local() const {return node_->sk_;}
+    };
+
+    ConcurrentDDSketch(FType alpha=1e-2, size_t max_bins=2048, FType min_value=1e-9,
+                       clock_type::duration interval=std::chrono::milliseconds(10)):
+        empty_(alpha, max_bins, min_value), interval_(interval), pending_(nullptr), global_(empty_), nmerges_(0) {}
+    ConcurrentDDSketch(const ConcurrentDDSketch &o) = delete;
+    ~ConcurrentDDSketch() {
+        for(node_t *n = pending_.load(), *next; n; n = next) {
+            next = n->next_;
+            delete n;
+        }
+    }
+    // One per writer thread.
+    Collector collector() {return Collector(*this);}
+
+    // Everything flushed by collectors so far.
+    sketch_type merged() const {
+        std::lock_guard<std::mutex> lock(mut_);
+        merge_pending();
+        return global_;
+    }
+    FType quantile(double q) const {
+        std::lock_guard<std::mutex> lock(mut_);
+        merge_pending();
+        return global_.quantile(q);
+    }
+    std::vector<FType> quantiles(const std::vector<double> &qs) const {
+        std::lock_guard<std::mutex> lock(mut_);
+        merge_pending();
+        return global_.quantiles(qs);
+    }
+    uint64_t count() const {
+        std::lock_guard<std::mutex> lock(mut_);
+        merge_pending();
+        return global_.count();
+    }
+    // Number of collector sketches merged into the global sketch.
+    uint64_t nmerges() const {
+        std::lock_guard<std::mutex> lock(mut_);
+        return nmerges_;
+    }
+}; // class ConcurrentDDSketch
+
 using ddf = DDSketch<float>;
 using ddd = DDSketch<double>;
+using concurrent_ddf = ConcurrentDDSketch<float>;
+using concurrent_ddd = ConcurrentDDSketch<double>;
 
 } // namespace dd
 
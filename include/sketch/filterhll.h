@@ -21,12 +21,10 @@ public:
         if(threshold > (1u << (nbfs - 1))) throw std::runtime_error("Count threshold must be countable-to");
     }
     void addh(uint64_t val) {
-        cbf_.addh(val); // This wastes one check in bf1. TODO: elide this.
-        if(cbf_.est_count(val) >= threshold_) hll_.addh(val);
+        if(cbf_.addh(val) >= threshold_) hll_.addh(val);
     }
     void addh(VType val) {
-        cbf_.addh(val); // This wastes one check in bf1. TODO: elide this.
-        val.for_each([&](uint64_t val){if(cbf_.est_count(val) >= threshold_) hll_.addh(val);});
+        val.for_each([&](uint64_t val){addh(val);});
     }
     void clear() {
         hll_.clear();
@@ -14,6 +14,7 @@
 #include "fixed_vector.h"
 #include "xxHash/xxh3.h"
 #include "macros.h"
+#include "isa.h"
 
 namespace sketch {
 inline namespace hash {
@@ -26,6 +27,134 @@ using Type  = typename vec::SIMDTypes<uint64_t>::Type;
 using VType = typename vec::SIMDTypes<uint64_t>::VType;
 using Space = vec::SIMDTypes<uint64_t>;
 #endif
+
+/*
+ * Array hashing: hash_batch(hasher, in, out, n) sets out[i] = hasher(in[i]) for i < n; in may equal out.
+ * Hashers built from simple steps (WangHash, MurFinHash, the CEI and InvH operations,
+ * and FusedReversible/CEIFused compositions of them) describe those steps once, in batch_apply,
+ * generically over a lane type. The kernels below instantiate it for AVX2 and AVX-512, unrolled four vectors deep,
+ * or for 64-bit scalars, and pick one at runtime (see isa.h).
+ * Other hashers are called one value at a time.
+ */
+namespace batch {
+
+struct ops_scalar {
+    using type = uint64_t;
+    static constexpr size_t width = 1;
+    static INLINE type load(const uint64_t *p) {return *p;}
+    static INLINE void store(uint64_t *p, type v) {*p = v;}
+    static INLINE type set1(uint64_t x) {return x;}
+    static INLINE type add(type a, type b) {return a + b;}
+    static INLINE type xor_(type a, type b) {return a ^ b;}
+    static INLINE type not_(type a) {return ~a;}
+    static INLINE type mul(type a, uint64_t c) {return a * c;}
+    template<int n> static INLINE type slli(type a) {return a << n;}
+    template<int n> static INLINE type srli(type a) {return a >> n;}
+    template<int n> static INLINE type rotl(type a) {return (a << n) | (a >> (64 - n));}
+};
+
+#if SKETCH_ISA_DISPATCH
+#define SKETCH_AVX2_FN   __attribute__((target("avx2"))) static inline
+#define SKETCH_AVX512_FN __attribute__((target("avx512f,avx512dq"))) static inline
+// Lanes are wrapped in a struct and batch_apply takes them by reference, so no vector crosses a
+// function boundary by value in a TU built for a baseline ISA (which GCC flags under -Wpsabi).
+struct ops_avx2 {
+    struct type {__m256i v;};
+    static constexpr size_t width = 4;
+    SKETCH_AVX2_FN type load(const uint64_t *p) {return {_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))};}
+    SKETCH_AVX2_FN void store(uint64_t *p, const type &a) {_mm256_storeu_si256(reinterpret_cast<__m256i *>(p), a.v);}
+    SKETCH_AVX2_FN type set1(uint64_t x) {return {_mm256_set1_epi64x(x)};}
+    SKETCH_AVX2_FN type add(const type &a, const type &b) {return {_mm256_add_epi64(a.v, b.v)};}
+    SKETCH_AVX2_FN type xor_(const type &a, const type &b) {return {_mm256_xor_si256(a.v, b.v)};}
+    SKETCH_AVX2_FN type not_(const type &a) {return {_mm256_xor_si256(a.v, _mm256_set1_epi64x(-1))};}
+    // No 64-bit multiply before AVX-512: lo * lo + ((hi * lo + lo * hi) << 32).
+    SKETCH_AVX2_FN type mul(const type &a, uint64_t c) {
+        const __m256i cv = _mm256_set1_epi64x(c), chi = _mm256_set1_epi64x(c >> 32);
+        const __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a.v, 32), cv), _mm256_mul_epu32(a.v, chi));
+        return {_mm256_add_epi64(_mm256_mul_epu32(a.v, cv), _mm256_slli_epi64(cross, 32))};
+    }
+    template<int n> SKETCH_AVX2_FN type slli(const type &a) {return {_mm256_slli_epi64(a.v, n)};}
+    template<int n> SKETCH_AVX2_FN type srli(const type &a) {return {_mm256_srli_epi64(a.v, n)};}
+    template<int n> SKETCH_AVX2_FN type rotl(const type &a) {return {_mm256_or_si256(_mm256_slli_epi64(a.v, n), _mm256_srli_epi64(a.v, 64 - n))};}
+};
+struct ops_avx512 {
+    struct type {__m512i v;};
+    static constexpr size_t width = 8;
+    SKETCH_AVX512_FN type load(const uint64_t *p) {return {_mm512_loadu_si512(p)};}
+    SKETCH_AVX512_FN void store(uint64_t *p, const type &a) {_mm512_storeu_si512(p, a.v);}
+    SKETCH_AVX512_FN type set1(uint64_t x) {return {_mm512_set1_epi64(x)};}
+    SKETCH_AVX512_FN type add(const type &a, const type &b) {return {_mm512_add_epi64(a.v, b.v)};}
+    SKETCH_AVX512_FN type xor_(const type &a, const type &b) {return {_mm512_xor_si512(a.v, b.v)};}
+    SKETCH_AVX512_FN type not_(const type &a) {return {_mm512_ternarylogic_epi64(a.v, a.v, a.v, 0x55)};}
+    SKETCH_AVX512_FN type mul(const type &a, uint64_t c) {return {_mm512_mullo_epi64(a.v, _mm512_set1_epi64(c))};}
+    // All-lanes zero-masked shifts and rotates: the unmasked intrinsics read an undefined source and trip -Wmaybe-uninitialized on GCC.
+    template<int n> SKETCH_AVX512_FN type slli(const type &a) {return {_mm512_maskz_slli_epi64(0xFF, a.v, n)};}
+    template<int n> SKETCH_AVX512_FN type srli(const type &a) {return {_mm512_maskz_srli_epi64(0xFF, a.v, n)};}
+    template<int n> SKETCH_AVX512_FN type rotl(const type &a) {return {_mm512_maskz_rol_epi64(0xFF, a.v, n)};}
+};
+#undef SKETCH_AVX2_FN
+#undef SKETCH_AVX512_FN
+#endif
+
+template<typename... T> struct make_void {using type = void;};
+
+template<typename H, typename=void>
+struct has_kernel: std::false_type {};
+template<typename H>
+struct has_kernel<H, typename make_void<decltype(std::declval<const H &>().template batch_apply<ops_scalar>(uint64_t(0)))>::type>
+    : std::true_type {};
+
+template<typename O, typename H>
+inline void unrolled(const H &h, const uint64_t *in, uint64_t *out, size_t n) {
+    static constexpr size_t W = O::width;
+    size_t i = 0;
+    for(; i + 4 * W <= n; i += 4 * W) {
+        auto v0 = O::load(in + i), v1 = O::load(in + i + W), v2 = O::load(in + i + 2 * W), v3 = O::load(in + i + 3 * W);
+        v0 = h.template batch_apply<O>(v0);
+        v1 = h.template batch_apply<O>(v1);
+        v2 = h.template batch_apply<O>(v2);
+        v3 = h.template batch_apply<O>(v3);
+        O::store(out + i, v0); O::store(out + i + W, v1); O::store(out + i + 2 * W, v2); O::store(out + i + 3 * W, v3);
+    }
+    for(; i + W <= n; i += W) O::store(out + i, h.template batch_apply<O>(O::load(in + i)));
+    for(; i < n; ++i) out[i] = h.template batch_apply<ops_scalar>(in[i]);
+}
+
+#if SKETCH_ISA_DISPATCH
+template<typename H>
+SKETCH_TARGET_AVX2 void kernel_avx2(const H &h, const uint64_t *in, uint64_t *out, size_t n) {unrolled<ops_avx2>(h, in, out, n);}
+template<typename H>
+SKETCH_TARGET_AVX512 void kernel_avx512(const H &h, const uint64_t *in, uint64_t *out, size_t n) {unrolled<ops_avx512>(h, in, out, n);}
+#endif
+
+template<typename H>
+void kernel_isa(const H &h, const uint64_t *in, uint64_t *out, size_t n, isa_t isa) {
+#if SKETCH_ISA_DISPATCH
+    if(isa >= isa_t::AVX512) return kernel_avx512(h, in, out, n);
+    if(isa >= isa_t::AVX2)   return kernel_avx2(h, in, out, n);
+#endif
+    // Left to the compiler, which vectorizes it for the build's target.
+    for(size_t i = 0; i < n; ++i) out[i] = h.template batch_apply<ops_scalar>(in[i]);
+}
+
+template<typename H>
+INLINE void dispatch(const H &h, const uint64_t *in, uint64_t *out, size_t n, std::true_type) {
+    kernel_isa(h, in, out, n, runtime_isa());
+}
+template<typename H>
+INLINE void dispatch(const H &h, const uint64_t *in, uint64_t *out, size_t n, std::false_type) {
+    for(size_t i = 0; i < n; ++i) out[i] = h(in[i]);
+}
+template<typename H>
+INLINE void dispatch(const H &h, const uint64_t *in, uint64_t *out, size_t n) {
+    dispatch(h, in, out, n, has_kernel<H>());
+}
+
+} // namespace batch
+
+template<typename H>
+void hash_batch(const H &h, const uint64_t *in, uint64_t *out, size_t n) {batch::dispatch(h, in, out, n);}
+
 static inline uint64_t mthash(uint64_t x) {
     std::mt19937_64 mt(x);
     return mt();
@@ -68,6 +197,17 @@ struct WangHash {
         return key;
     }
     INLINE auto operator()(int32_t key) const {return operator()(uint32_t(key));}
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &in) const {
+        typename O::type key = O::add(O::not_(in), O::template slli<21>(in));
+        key = O::xor_(key, O::template srli<24>(key));
+        key = O::add(O::add(key, O::template slli<3>(key)), O::template slli<8>(key));
+        key = O::xor_(key, O::template srli<14>(key));
+        key = O::add(O::add(key, O::template slli<2>(key)), O::template slli<4>(key));
+        key = O::xor_(key, O::template srli<28>(key));
+        return O::add(key, O::template slli<31>(key));
+    }
+    void hash_batch(const uint64_t *in, uint64_t *out, size_t n) const {batch::dispatch(*this, in, out, n);}
 #ifdef _VEC_H__
     INLINE Type operator()(Type element) const {
         VType key = Space::add(Space::slli(element, 21), ~element); // key = (~key) + (key << 21);
@@ -464,6 +604,14 @@ struct MurFinHash {
         key ^= key >> 33;
         return key;
     }
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &in) const {
+        typename O::type key = O::mul(O::xor_(in, O::template srli<33>(in)), C1);
+        key = O::xor_(key, O::template srli<33>(key));
+        key = O::mul(key, C2);
+        return O::xor_(key, O::template srli<33>(key));
+    }
+    void hash_batch(const uint64_t *in, uint64_t *out, size_t n) const {batch::dispatch(*this, in, out, n);}
 #ifdef DUMMY_INVERSE
     INLINE uint64_t inverse(uint64_t key) const {return this->operator()(key);}
 #endif
@@ -505,6 +653,8 @@ namespace op {
 template<typename T>
 struct multiplies {
     T operator()(T x, T y) const { return x * y;}
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &x, uint64_t y) const {return O::mul(x, y);}
 #ifdef _VEC_H__
     VType operator()(VType x, VType y) const {
 #if HAS_AVX_512
@@ -522,6 +672,8 @@ struct multiplies {
 template<typename T>
 struct plus {
     T operator()(T x, T y) const { return x + y;}
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &x, uint64_t y) const {return O::add(x, O::set1(y));}
 #ifdef _VEC_H__
     VType operator()(VType x, VType y) const { return Space::add(x.simd_, y.simd_);}
 #endif
@@ -529,6 +681,8 @@ struct plus {
 template<typename T>
 struct bit_xor {
     T operator()(T x, T y) const { return x ^ y;}
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &x, uint64_t y) const {return O::xor_(x, O::set1(y));}
 #ifdef _VEC_H__
     VType operator()(VType x, VType y) const { return Space::xor_fn(x.simd_, y.simd_);}
 #endif
@@ -615,6 +769,8 @@ struct RShiftXor {
     template<typename...Args>
     RShiftXor(Args &&...) {}
     uint64_t constexpr operator()(uint64_t v) const {return v ^ (v >> n);}
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &v) const {return O::xor_(v, O::template srli<n>(v));}
 #ifdef __SSE2__
     __m128i operator()(__m128i v) const {
         return _mm_xor_si128(_mm_srli_epi64(v, n), v);
@@ -656,6 +812,8 @@ struct LShiftXor {
     template<typename...Args>
     LShiftXor(Args...) {}
     uint64_t constexpr operator()(uint64_t v) const {return v ^ (v << n);}
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &v) const {return O::xor_(v, O::template slli<n>(v));}
     uint64_t constexpr inverse(uint64_t v) const {return InverseOperation()(v);}
     using InverseOperation = InvLShiftXor<n>;
 };
@@ -693,6 +851,10 @@ struct Rot {
     INLINE T constexpr operator()(T val, const T2 &) const {
         return this->operator()(val);
     }
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &val) const {return O::template rotl<left ? n: 64 - n>(val);}
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &val, uint64_t) const {return batch_apply<O>(val);}
     using InverseOperation = Rot<n, !left>;
 };
 template<size_t n> using RotL = Rot<n, true>;
@@ -712,6 +874,10 @@ struct BitFlip {
     INLINE T constexpr operator()(T val, const T2 &) const {
         return this->operator()(val);
     }
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &val) const {return O::not_(val);}
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &val, uint64_t) const {return O::not_(val);}
     using InverseOperation = BitFlip;
 };
 
@@ -738,6 +904,10 @@ struct InvH {
         h = op(h, seed_);
         return h;
     }
+    template<typename O>
+    INLINE auto batch_apply(const typename O::type &h) const -> decltype(op.template batch_apply<O>(h, seed_)) {
+        return op.template batch_apply<O>(h, seed_);
+    }
 #ifdef _VEC_H__
     INLINE VType inverse(VType hv) const {
         hv = iop(hv.simd_, Space::set1(inverse_));
@@ -768,6 +938,8 @@ struct CEIXOR {
     INLINE uint64_t operator()(uint64_t h) const {
         return h ^ seed_;
     }
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &h) const {return O::xor_(h, O::set1(seed_));}
     INLINE uint32_t inverse(uint32_t hv) const {
         return hv ^ seed32_;
     }
@@ -798,6 +970,8 @@ struct CEIMul {
     INLINE uint64_t operator()(uint64_t h) const {
         return h * seed_;
     }
+    template<typename O>
+    INLINE typename O::type batch_apply(const typename O::type &h) const {return O::mul(h, seed_);}
     INLINE uint32_t operator()(uint32_t h) const {
         return h * seed32_;
     }
@@ -826,6 +1000,13 @@ struct CEIFused: public CEIFused<Types...> {
     INLINE T operator()(T h) const {
         return CEIFused<Types...>::operator()(op(h));
     }
+    template<typename O>
+    INLINE auto batch_apply(const typename O::type &h) const
+        -> decltype(this->CEIFused<Types...>::template batch_apply<O>(op.template batch_apply<O>(h)))
+    {
+        return CEIFused<Types...>::template batch_apply<O>(op.template batch_apply<O>(h));
+    }
+    void hash_batch(const uint64_t *in, uint64_t *out, size_t n) const {batch::dispatch(*this, in, out, n);}
     template<typename T>
     INLINE T inverse(T hv) const {
         return op.inverse(CEIFused<Types...>::inverse(hv));
@@ -840,6 +1021,11 @@ struct CEIFused<Type> {
     INLINE T operator()(T h) const {return op(h);}
     template<typename T>
     INLINE T inverse(T hv) const {return op.inverse(hv);}
+    template<typename O>
+    INLINE auto batch_apply(const typename O::type &h) const -> decltype(op.template batch_apply<O>(h)) {
+        return op.template batch_apply<O>(h);
+    }
+    void hash_batch(const uint64_t *in, uint64_t *out, size_t n) const {batch::dispatch(*this, in, out, n);}
 };
 template<typename T1, typename T2, typename T3>
 struct CEIFused3: public CEIFused<T1, T2, T3> {};
@@ -860,6 +1046,13 @@ struct FusedReversible {
         op1(mthash(seed1) | 1), op2(mthash(seed2) | 1) {}
     template<typename T>
     INLINE T operator()(T h) const {return op2(op1(h));}
+    template<typename O>
+    INLINE auto batch_apply(const typename O::type &h) const
+        -> decltype(op2.template batch_apply<O>(op1.template batch_apply<O>(h)))
+    {
+        return op2.template batch_apply<O>(op1.template batch_apply<O>(h));
+    }
+    void hash_batch(const uint64_t *in, uint64_t *out, size_t n) const {batch::dispatch(*this, in, out, n);}
     template<typename T>
     INLINE T inverse(T hv) const {return op1.inverse(op2.inverse(hv));}
 };
@@ -873,6 +1066,13 @@ struct FusedReversible3 {
     {}
     template<typename T>
     INLINE T operator()(T h) const {return op3(op2(op1(h)));}
+    template<typename O>
+    INLINE auto batch_apply(const typename O::type &h) const
+        -> decltype(op3.template batch_apply<O>(op2.template batch_apply<O>(op1.template batch_apply<O>(h))))
+    {
+        return op3.template batch_apply<O>(op2.template batch_apply<O>(op1.template batch_apply<O>(h)));
+    }
+    void hash_batch(const uint64_t *in, uint64_t *out, size_t n) const {batch::dispatch(*this, in, out, n);}
     template<typename T>
     INLINE T inverse(T hv) const {
         return op1.inverse(op2.inverse(op3.inverse(hv)));
@@ -918,6 +1118,19 @@ struct RecursiveReversibleHash {
         std::for_each(v_.rbegin(), v_.rend(), [&](const auto &hash) {hv = hash.inverse(hv);});
         return hv;
     }
+    // Applies each stage in turn to cache-resident chunks.
+    void hash_batch(const uint64_t *in, uint64_t *out, size_t n) const {
+        static constexpr size_t CHUNK = 512;
+        if(v_.empty()) {
+            if(in != out) std::copy(in, in + n, out);
+            return;
+        }
+        for(size_t i = 0; i < n; i += CHUNK) {
+            const size_t nc = std::min(CHUNK, n - i);
+            hash::hash_batch(v_.front(), in + i, out + i, nc);
+            for(size_t j = 1; j < v_.size(); ++j) hash::hash_batch(v_[j], out + i, out + i, nc);
+        }
+    }
 };
 
 struct XorMultiplyNVec: public RecursiveReversibleHash<XorMultiply> {
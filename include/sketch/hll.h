@@ -8,6 +8,7 @@
 #include "common.h"
 #include "hash.h"
 #include "hedley.h"
+#include <mutex>
 
 namespace sketch {
 
@@ -17,8 +18,19 @@ class WideHyperLogLogHasher;
 
 }
 
+inline namespace pool {
+class thread_pool; // See pool.h, which callers of the overloads taking one include.
+}
+
 inline namespace hll {
 namespace detail {
+// Overloads taking a thread_pool are templates restricted to it, so that only its declaration is needed here.
+template<typename Pool>
+using if_thread_pool_t = std::enable_if_t<std::is_same<Pool, thread_pool>::value>;
+// Containers storing uint64_t contiguously, exposed through data() and size().
+template<typename Container>
+using if_contiguous_u64_t = std::enable_if_t<std::is_same<std::decay_t<decltype(*std::declval<const Container &>().data())>, uint64_t>::value>;
+
 template<typename FloatType>
 static constexpr FloatType gen_sigma(FloatType x) {
     if(x == 1.) return std::numeric_limits<FloatType>::infinity();
@@ -102,6 +114,16 @@ static const char *EST_STRS [] {
 
 using CountArrayType = std::array<uint32_t, 64>;
 
+/*
+ * Register histograms of a pair of sketches, as used by ertl_joint:
+ * lhs, rhs and un count the registers of each sketch and of their union (elementwise max),
+ * lhs_gt[v] those where lhs == v > rhs, rhs_gt[v] those where rhs == v > lhs, and eq[v] those where lhs == rhs == v.
+ */
+template<typename CountType=uint32_t, size_t N=64>
+struct joint_counts_t {
+    std::array<CountType, N> lhs, rhs, un, lhs_gt, rhs_gt, eq;
+};
+
 namespace detail {
 template<typename T>
 static double ertl_ml_estimate(const T& c, unsigned p, unsigned q, double relerr=1e-2); // forward declaration
@@ -438,90 +460,299 @@ public:
     static_assert(sizeof(SType) == sizeof(u8arr), "both items in the union must have the same size");
 };
 
-struct joint_unroller {
-    using MType = SIMDHolder::MaskType;
-    using SType = SIMDHolder::SType;
-    // Woof....
-#if defined(__AVX512BW__)
-    static_assert(sizeof(MType) == sizeof(uint64_t), "Must be 64 bits");
-#endif
-    template<typename T, size_t iternum, size_t niter_left> struct ju_impl {
-    INLINE void operator()(const SIMDHolder &ref1, const SIMDHolder &ref2, const SIMDHolder &u, T &arrh1, T &arrh2, T &arru, T &arrg1, T &arrg2, T &arreq, MType gtmask1, MType gtmask2, MType eqmask) const {
-            ++arrh1[ref1.vals[iternum]];
-            ++arrh2[ref2.vals[iternum]];
-            ++arru[u.vals[iternum]];
-#if __AVX512BW__
-            arrg1[ref1.vals[iternum]] += gtmask1 & 1;
-            arreq[ref1.vals[iternum]] += eqmask  & 1;
-            arrg2[ref2.vals[iternum]] += gtmask2 & 1;
-            gtmask1 >>= 1; gtmask2 >>= 1; eqmask  >>= 1;
-            // TODO: Consider packing these into an SIMD type and shifting them as a set.
-#else
-            static_assert(sizeof(MType) == sizeof(SIMDHolder), "Wrong size?");
-            arrg1[ref1.vals[iternum]] += gtmask1.vals[iternum] != 0;
-            arreq[ref1.vals[iternum]] += eqmask.vals [iternum] != 0;
-            arrg2[ref2.vals[iternum]] += gtmask2.vals[iternum] != 0;
+/*
+ * Register kernels compiled for several instruction sets and chosen by runtime_isa() (see isa.h),
+ * so that merging and estimation use AVX2 or AVX-512 even when this translation unit targets a lower level.
+ * The *_isa variants take the level explicitly, which lets tests compare every level with the baseline.
+ *
+ * max_bytes:       dst[i] = max(dst[i], src[i]) for i in [0, n).
+ * byte_histogram:  ++counts[p[i]] for i in [0, n).
+ * union_histogram: ++counts[max(a[i], b[i])] for i in [0, n), without materializing the union.
+ * joint_histogram: adds the register histograms of a, b and their union, and the lhs_gt, rhs_gt and eq histograms
+ *                  of ertl_joint (see joint_counts_t) in a single pass.
+ *
+ * Registers in a chunk of 256 usually span only a few values, so the vector versions of the histograms
+ * count each value in the chunk's [min, max] range with byte comparisons and popcounts,
+ * falling back to the scalar loop for chunks spanning more than 16 values.
+ */
+inline void max_bytes_base(uint8_t *SK_RESTRICT dst, const uint8_t *SK_RESTRICT src, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for(; i + sizeof(__m128i) <= n; i += sizeof(__m128i))
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_max_epu8(_mm_loadu_si128((const __m128i *)(dst + i)), _mm_loadu_si128((const __m128i *)(src + i))));
 #endif
-            ju_impl<T, iternum+1, niter_left-1> ju;
-            ju(ref1, ref2, u, arrh1, arrh2, arru, arrg1, arrg2, arreq, gtmask1, gtmask2, eqmask);
+    for(; i < n; ++i) dst[i] = std::max(dst[i], src[i]);
+}
+
+template<typename T>
+inline void byte_histogram_base(const uint8_t *p, size_t n, T *counts) {
+    for(size_t i = 0; i < n; ++i) ++counts[p[i]];
+}
+template<typename T>
+inline void union_histogram_base(const uint8_t *a, const uint8_t *b, size_t n, T *counts) {
+    for(size_t i = 0; i < n; ++i) ++counts[std::max(a[i], b[i])];
+}
+template<typename JointCounts>
+inline void joint_histogram_base(const uint8_t *a, const uint8_t *b, size_t n, JointCounts &jc) {
+    for(size_t i = 0; i < n; ++i) {
+        const uint8_t x = a[i], y = b[i];
+        ++jc.lhs[x]; ++jc.rhs[y]; ++jc.un[std::max(x, y)];
+        jc.lhs_gt[x] += x > y;
+        jc.rhs_gt[y] += y > x;
+        jc.eq[x] += x == y;
+    }
+}
+
+#if SKETCH_ISA_DISPATCH
+SKETCH_TARGET_AVX2 inline void max_bytes_avx2(uint8_t *SK_RESTRICT dst, const uint8_t *SK_RESTRICT src, size_t n) {
+    size_t i = 0;
+    for(; i + sizeof(__m256i) <= n; i += sizeof(__m256i))
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_max_epu8(_mm256_loadu_si256((const __m256i *)(dst + i)), _mm256_loadu_si256((const __m256i *)(src + i))));
+    for(; i < n; ++i) dst[i] = std::max(dst[i], src[i]);
+}
+SKETCH_TARGET_AVX512 inline void max_bytes_avx512(uint8_t *SK_RESTRICT dst, const uint8_t *SK_RESTRICT src, size_t n) {
+    size_t i = 0;
+    for(; i + sizeof(__m512i) <= n; i += sizeof(__m512i))
+        _mm512_storeu_si512((void *)(dst + i), _mm512_max_epu8(_mm512_loadu_si512((const void *)(dst + i)), _mm512_loadu_si512((const void *)(src + i))));
+    if(i < n) {
+        const __mmask64 m = _bzhi_u64(~0ull, n - i);
+        _mm512_mask_storeu_epi8(dst + i, m, _mm512_max_epu8(_mm512_maskz_loadu_epi8(m, dst + i), _mm512_maskz_loadu_epi8(m, src + i)));
+    }
+}
+
+// Minimum byte of a 128-bit vector: widen to 16-bit lanes and use phminposuw.
+SKETCH_TARGET_AVX2 static inline unsigned hmin_epu8(__m128i x) {
+    x = _mm_min_epu8(x, _mm_srli_epi16(x, 8));
+    return _mm_cvtsi128_si32(_mm_minpos_epu16(_mm_and_si128(x, _mm_set1_epi16(0xFF)))) & 0xFFu;
+}
+// Smallest and largest bytes of nv vectors. The maximum is found as the complement of the minimum of complements.
+SKETCH_TARGET_AVX2 static inline void byte_range_avx2(const __m256i *v, unsigned nv, unsigned &lo, unsigned &hi) {
+    __m256i mn = v[0], mx = v[0];
+    for(unsigned j = 1; j < nv; ++j) mn = _mm256_min_epu8(mn, v[j]), mx = _mm256_max_epu8(mx, v[j]);
+    mx = _mm256_xor_si256(mx, _mm256_set1_epi8(-1));
+    lo = hmin_epu8(_mm_min_epu8(_mm256_castsi256_si128(mn), _mm256_extracti128_si256(mn, 1)));
+    hi = 0xFFu - hmin_epu8(_mm_min_epu8(_mm256_castsi256_si128(mx), _mm256_extracti128_si256(mx, 1)));
+}
+SKETCH_TARGET_AVX512 static inline void byte_range_avx512(const __m512i *v, unsigned nv, unsigned &lo, unsigned &hi) {
+    __m512i mn = v[0], mx = v[0];
+    for(unsigned j = 1; j < nv; ++j) mn = _mm512_min_epu8(mn, v[j]), mx = _mm512_max_epu8(mx, v[j]);
+    mx = _mm512_xor_si512(mx, _mm512_set1_epi8(-1));
+    // Zero-masked extracts with every lane selected compile to plain moves; the unmasked forms (including
+    // _mm512_castsi512_si256 on GCC 12) read an undefined source and trip -Wmaybe-uninitialized.
+    const __m256i mn256 = _mm256_min_epu8(_mm512_maskz_extracti64x4_epi64(0xF, mn, 0), _mm512_maskz_extracti64x4_epi64(0xF, mn, 1)),
+                  mx256 = _mm256_min_epu8(_mm512_maskz_extracti64x4_epi64(0xF, mx, 0), _mm512_maskz_extracti64x4_epi64(0xF, mx, 1));
+    lo = hmin_epu8(_mm_min_epu8(_mm256_castsi256_si128(mn256), _mm256_extracti128_si256(mn256, 1)));
+    hi = 0xFFu - hmin_epu8(_mm_min_epu8(_mm256_castsi256_si128(mx256), _mm256_extracti128_si256(mx256, 1)));
+}
+SKETCH_TARGET_AVX2 static inline uint32_t eq_mask_avx2(__m256i x, __m256i y) {
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+}
+
+// Adds the histogram of v[0..nv) to counts.
+template<typename T>
+SKETCH_TARGET_AVX2 inline void count_chunk_avx2(const __m256i *v, unsigned nv, T *counts) {
+    unsigned lo, hi;
+    byte_range_avx2(v, nv, lo, hi);
+    if(hi - lo >= 16) {
+        byte_histogram_base(reinterpret_cast<const uint8_t *>(v), nv * sizeof(__m256i), counts);
+        return;
+    }
+    for(unsigned val = lo; val <= hi; ++val) {
+        const __m256i b = _mm256_set1_epi8(val);
+        uint64_t c = 0;
+        for(unsigned j = 0; j < nv; ++j) c += popcount(eq_mask_avx2(v[j], b));
+        counts[val] += c;
+    }
+}
+template<typename T>
+SKETCH_TARGET_AVX512 inline void count_chunk_avx512(const __m512i *v, unsigned nv, T *counts) {
+    unsigned lo, hi;
+    byte_range_avx512(v, nv, lo, hi);
+    if(hi - lo >= 16) {
+        byte_histogram_base(reinterpret_cast<const uint8_t *>(v), nv * sizeof(__m512i), counts);
+        return;
+    }
+    for(unsigned val = lo; val <= hi; ++val) {
+        const __m512i b = _mm512_set1_epi8(val);
+        uint64_t c = 0;
+        for(unsigned j = 0; j < nv; ++j) c += popcount(_mm512_cmpeq_epu8_mask(v[j], b));
+        counts[val] += c;
+    }
+}
+
+template<typename T>
+SKETCH_TARGET_AVX2 inline void byte_histogram_avx2(const uint8_t *p, size_t n, T *counts) {
+    size_t i = 0;
+    for(__m256i v[8]; i + sizeof(v) <= n; i += sizeof(v)) {
+        for(unsigned j = 0; j < 8; ++j) v[j] = _mm256_loadu_si256((const __m256i *)(p + i) + j);
+        count_chunk_avx2(v, 8, counts);
+    }
+    byte_histogram_base(p + i, n - i, counts);
+}
+template<typename T>
+SKETCH_TARGET_AVX512 inline void byte_histogram_avx512(const uint8_t *p, size_t n, T *counts) {
+    size_t i = 0;
+    for(__m512i v[4]; i + sizeof(v) <= n; i += sizeof(v)) {
+        for(unsigned j = 0; j < 4; ++j) v[j] = _mm512_loadu_si512((const void *)(p + i + j * sizeof(__m512i)));
+        count_chunk_avx512(v, 4, counts);
+    }
+    byte_histogram_base(p + i, n - i, counts);
+}
+
+template<typename T>
+SKETCH_TARGET_AVX2 inline void union_histogram_avx2(const uint8_t *a, const uint8_t *b, size_t n, T *counts) {
+    size_t i = 0;
+    for(__m256i v[8]; i + sizeof(v) <= n; i += sizeof(v)) {
+        for(unsigned j = 0; j < 8; ++j)
+            v[j] = _mm256_max_epu8(_mm256_loadu_si256((const __m256i *)(a + i) + j), _mm256_loadu_si256((const __m256i *)(b + i) + j));
+        count_chunk_avx2(v, 8, counts);
+    }
+    union_histogram_base(a + i, b + i, n - i, counts);
+}
+template<typename T>
+SKETCH_TARGET_AVX512 inline void union_histogram_avx512(const uint8_t *a, const uint8_t *b, size_t n, T *counts) {
+    size_t i = 0;
+    for(__m512i v[4]; i + sizeof(v) <= n; i += sizeof(v)) {
+        for(unsigned j = 0; j < 4; ++j)
+            v[j] = _mm512_max_epu8(_mm512_loadu_si512((const void *)(a + i + j * sizeof(__m512i))), _mm512_loadu_si512((const void *)(b + i + j * sizeof(__m512i))));
+        count_chunk_avx512(v, 4, counts);
+    }
+    union_histogram_base(a + i, b + i, n - i, counts);
+}
+
+// v holds a chunk of a in its first half and the same chunk of b in its second.
+// For each value in the chunk's range, the registers of a equal to it split into lhs_gt, eq and the rest,
+// those of b into rhs_gt, eq and the rest, and the union's into lhs_gt + rhs_gt + eq.
+template<typename JointCounts>
+SKETCH_TARGET_AVX2 inline void joint_histogram_avx2(const uint8_t *a, const uint8_t *b, size_t n, JointCounts &jc) {
+    size_t i = 0;
+    for(__m256i v[8]; i + sizeof(v) / 2 <= n; i += sizeof(v) / 2) {
+        uint32_t gt1[4], gt2[4], eq[4];
+        for(unsigned j = 0; j < 4; ++j) {
+            v[j] = _mm256_loadu_si256((const __m256i *)(a + i) + j);
+            v[j + 4] = _mm256_loadu_si256((const __m256i *)(b + i) + j);
+            const __m256i u = _mm256_max_epu8(v[j], v[j + 4]);
+            eq[j] = eq_mask_avx2(v[j], v[j + 4]);
+            gt1[j] = eq_mask_avx2(u, v[j]) & ~eq[j];
+            gt2[j] = eq_mask_avx2(u, v[j + 4]) & ~eq[j];
+        }
+        unsigned lo, hi;
+        byte_range_avx2(v, 8, lo, hi);
+        if(hi - lo >= 16) {
+            joint_histogram_base(a + i, b + i, sizeof(v) / 2, jc);
+            continue;
+        }
+        for(unsigned val = lo; val <= hi; ++val) {
+            const __m256i bv = _mm256_set1_epi8(val);
+            uint64_t c1 = 0, c2 = 0, cg1 = 0, cg2 = 0, ceq = 0;
+            for(unsigned j = 0; j < 4; ++j) {
+                const uint32_t m1 = eq_mask_avx2(v[j], bv), m2 = eq_mask_avx2(v[j + 4], bv);
+                c1 += popcount(m1); c2 += popcount(m2);
+                cg1 += popcount(m1 & gt1[j]); cg2 += popcount(m2 & gt2[j]); ceq += popcount(m1 & eq[j]);
+            }
+            jc.lhs[val] += c1; jc.rhs[val] += c2;
+            jc.lhs_gt[val] += cg1; jc.rhs_gt[val] += cg2; jc.eq[val] += ceq;
+            jc.un[val] += cg1 + cg2 + ceq;
         }
-    };
-    template<typename T, size_t iternum> struct ju_impl<T, iternum, 0> {
-        INLINE void operator()(const SIMDHolder &, const SIMDHolder &, const SIMDHolder &, T &, T &, T &, T &, T &, T &, MType, MType, MType) const {}
-    };
-    template<typename T>
-    INLINE void operator()(const SIMDHolder &ref1, const SIMDHolder &ref2, const SIMDHolder &u, T &arrh1, T &arrh2, T &arru, T &arrg1, T &arrg2, T &arreq) const {
-        ju_impl<T, 0, SIMDHolder::nels> ju;
-#if __AVX512BW__
-        auto g1 = SIMDHolder::gt_fn(ref1.val, ref2.val);
-        auto g2 = SIMDHolder::gt_fn(ref2.val, ref1.val);
-        auto eq = SIMDHolder::eq_fn(ref1.val, ref2.val);
-#else
-        auto g1 = SIMDHolder(SIMDHolder::gt_fn(ref1.val, ref2.val));
-        auto g2 = SIMDHolder(SIMDHolder::gt_fn(ref2.val, ref1.val));
-        auto eq = SIMDHolder(SIMDHolder::eq_fn(ref1.val, ref2.val));
-#endif
-        static_assert(std::is_same<MType, std::decay_t<decltype(g1)>>::value, "g1 should be the same time as MType");
-        ju(ref1, ref2, u, arrh1, arrh2, arru, arrg1, arrg2, arreq, g1, g2, eq);
     }
-    template<typename T>
-    INLINE void sum_arrays(const SType *arr1, const SType *arr2, const SType *const arr1end, T &arrh1, T &arrh2, T &arru, T &arrg1, T &arrg2, T &arreq) const {
-        SIMDHolder v1, v2, u;
-        do {
-            v1.val = *arr1++;
-            v2.val = *arr2++;
-            u.val  = SIMDHolder::max_fn(v1.val, v2.val);
-            this->operator()(v1, v2, u, arrh1, arrh2, arru, arrg1, arrg2, arreq);
-        } while(arr1 < arr1end);
-    }
-    template<typename T, typename VectorType>
-    INLINE void sum_arrays(const VectorType &c1, const VectorType &c2, T &arrh1, T &arrh2, T &arru, T &arrg1, T &arrg2, T &arreq) const {
-        assert(c1.size() == c2.size() || !std::fprintf(stderr, "Sizes: %zu, %zu\n", c1.size(), c2.size()));
-        assert((c1.size() & (SIMDHolder::nels - 1)) == 0);
-        sum_arrays(reinterpret_cast<const SType *>(&c1[0]), reinterpret_cast<const SType *>(&c2[0]), reinterpret_cast<const SType *>(&*c1.cend()), arrh1, arrh2, arru, arrg1, arrg2, arreq);
+    joint_histogram_base(a + i, b + i, n - i, jc);
+}
+template<typename JointCounts>
+SKETCH_TARGET_AVX512 inline void joint_histogram_avx512(const uint8_t *a, const uint8_t *b, size_t n, JointCounts &jc) {
+    size_t i = 0;
+    for(__m512i v[8]; i + sizeof(v) / 2 <= n; i += sizeof(v) / 2) {
+        __mmask64 gt1[4], gt2[4], eq[4];
+        for(unsigned j = 0; j < 4; ++j) {
+            v[j] = _mm512_loadu_si512((const void *)(a + i + j * sizeof(__m512i)));
+            v[j + 4] = _mm512_loadu_si512((const void *)(b + i + j * sizeof(__m512i)));
+            gt1[j] = _mm512_cmpgt_epu8_mask(v[j], v[j + 4]);
+            gt2[j] = _mm512_cmpgt_epu8_mask(v[j + 4], v[j]);
+            eq[j] = ~(gt1[j] | gt2[j]);
+        }
+        unsigned lo, hi;
+        byte_range_avx512(v, 8, lo, hi);
+        if(hi - lo >= 16) {
+            joint_histogram_base(a + i, b + i, sizeof(v) / 2, jc);
+            continue;
+        }
+        for(unsigned val = lo; val <= hi; ++val) {
+            const __m512i bv = _mm512_set1_epi8(val);
+            uint64_t c1 = 0, c2 = 0, cg1 = 0, cg2 = 0, ceq = 0;
+            for(unsigned j = 0; j < 4; ++j) {
+                const __mmask64 m1 = _mm512_cmpeq_epu8_mask(v[j], bv), m2 = _mm512_cmpeq_epu8_mask(v[j + 4], bv);
+                c1 += popcount(m1); c2 += popcount(m2);
+                cg1 += popcount(m1 & gt1[j]); cg2 += popcount(m2 & gt2[j]); ceq += popcount(m1 & eq[j]);
+            }
+            jc.lhs[val] += c1; jc.rhs[val] += c2;
+            jc.lhs_gt[val] += cg1; jc.rhs_gt[val] += cg2; jc.eq[val] += ceq;
+            jc.un[val] += cg1 + cg2 + ceq;
+        }
     }
-};
+    joint_histogram_base(a + i, b + i, n - i, jc);
+}
+#endif /* SKETCH_ISA_DISPATCH */
+
+inline void max_bytes_isa(uint8_t *SK_RESTRICT dst, const uint8_t *SK_RESTRICT src, size_t n, isa_t isa) {
+#if SKETCH_ISA_DISPATCH
+    if(isa >= isa_t::AVX512) return max_bytes_avx512(dst, src, n);
+    if(isa >= isa_t::AVX2)   return max_bytes_avx2(dst, src, n);
+#endif
+    max_bytes_base(dst, src, n);
+}
+inline void max_bytes(uint8_t *SK_RESTRICT dst, const uint8_t *SK_RESTRICT src, size_t n) {
+    max_bytes_isa(dst, src, n, runtime_isa());
+}
 
 template<typename T>
-inline void inc_counts(T &counts, const SIMDHolder *p, const SIMDHolder *pend) {
+inline void byte_histogram_isa(const uint8_t *p, size_t n, T &counts, isa_t isa) {
     static_assert(std::is_integral<std::decay_t<decltype(counts[0])>>::value, "Counts must be integral.");
-    SIMDHolder tmp;
-    do {
-        tmp = *p++;
-        tmp.inc_counts(counts);
-    } while(p < pend);
+#if SKETCH_ISA_DISPATCH
+    if(isa >= isa_t::AVX512) return byte_histogram_avx512(p, n, &counts[0]);
+    if(isa >= isa_t::AVX2)   return byte_histogram_avx2(p, n, &counts[0]);
+#endif
+    byte_histogram_base(p, n, &counts[0]);
+}
+template<typename T>
+inline void byte_histogram(const uint8_t *p, size_t n, T &counts) {
+    byte_histogram_isa(p, n, counts, runtime_isa());
+}
+
+template<typename T>
+inline void union_histogram_isa(const uint8_t *a, const uint8_t *b, size_t n, T &counts, isa_t isa) {
+    static_assert(std::is_integral<std::decay_t<decltype(counts[0])>>::value, "Counts must be integral.");
+#if SKETCH_ISA_DISPATCH
+    if(isa >= isa_t::AVX512) return union_histogram_avx512(a, b, n, &counts[0]);
+    if(isa >= isa_t::AVX2)   return union_histogram_avx2(a, b, n, &counts[0]);
+#endif
+    union_histogram_base(a, b, n, &counts[0]);
+}
+template<typename T>
+inline void union_histogram(const uint8_t *a, const uint8_t *b, size_t n, T &counts) {
+    union_histogram_isa(a, b, n, counts, runtime_isa());
+}
+
+template<typename JointCounts>
+inline void joint_histogram_isa(const uint8_t *a, const uint8_t *b, size_t n, JointCounts &jc, isa_t isa) {
+#if SKETCH_ISA_DISPATCH
+    if(isa >= isa_t::AVX512) return joint_histogram_avx512(a, b, n, jc);
+    if(isa >= isa_t::AVX2)   return joint_histogram_avx2(a, b, n, jc);
+#endif
+    joint_histogram_base(a, b, n, jc);
+}
+template<typename JointCounts>
+inline void joint_histogram(const uint8_t *a, const uint8_t *b, size_t n, JointCounts &jc) {
+    joint_histogram_isa(a, b, n, jc, runtime_isa());
+}
+
+template<typename T>
+inline void inc_counts(T &counts, const SIMDHolder *p, const SIMDHolder *pend) {
+    byte_histogram(reinterpret_cast<const uint8_t *>(p), reinterpret_cast<const uint8_t *>(pend) - reinterpret_cast<const uint8_t *>(p), counts);
 }
 
 static inline std::array<uint32_t, 64> sum_counts(const SIMDHolder *p, const SIMDHolder *pend) {
     // Should add Contiguous Container requirement.
     std::array<uint32_t, 64> counts{0};
-    const size_t nelem = (uint8_t *)pend - (uint8_t *)p;
-    if(nelem < sizeof(*p)) {
-        const size_t e = (uint8_t *)pend - (uint8_t *)p;
-        for(size_t i = 0; i < e; ++i) ++counts[((uint8_t *)p)[i]];
-    } else {
-        inc_counts(counts, p, pend);
-    }
+    inc_counts(counts, p, pend);
     return counts;
 }
 
@@ -548,13 +779,8 @@ template<typename CoreType>
 void parsum_helper(void *data_, long index, int) {
     parsum_data_t<CoreType> &data(*reinterpret_cast<parsum_data_t<CoreType> *>(data_));
     uint64_t local_counts[64]{0};
-    SIMDHolder tmp;
-    const SIMDHolder *p(reinterpret_cast<const SIMDHolder *>(&data.core_[index * data.pb_])),
-                     *pend(reinterpret_cast<const SIMDHolder *>(&data.core_[std::min(data.l_, (index+1) * data.pb_)]));
-    do {
-        tmp = *p++;
-        tmp.inc_counts(local_counts);
-    } while(p < pend);
+    const size_t start = index * data.pb_;
+    byte_histogram(&data.core_[start], std::min(data.l_, (index+1) * data.pb_) - start, local_counts);
     for(uint64_t i = 0; i < 64ull; ++i) data.counts_[i] += local_counts[i];
 }
 
@@ -564,8 +790,15 @@ inline std::set<uint64_t> seeds_from_seed(uint64_t seed, size_t size) {
     while(rset.size() < size) rset.emplace(mt());
     return rset;
 }
+// Starting point of the secant solve in ertl_ml_estimate, shared with the batched version.
+struct ertl_ml_init_t {
+    double x, a;
+    unsigned cPrime;
+    int mPrime, kMinPrime, kMaxPrime;
+    bool infinite;
+};
 template<typename T>
-static double ertl_ml_estimate(const T& c, unsigned p, unsigned q, double relerr) {
+inline ertl_ml_init_t ertl_ml_init(const T& c, unsigned p, unsigned q) {
 /*
     Note --
     Putting all these optimizations together finally gives the new cardinality estimation
@@ -577,8 +810,9 @@ static double ertl_ml_estimate(const T& c, unsigned p, unsigned q, double relerr
    -Ertl paper.
 TODO:  Consider adding this change to the method. This could improve our performance for other
 */
+    ertl_ml_init_t ret;
     const uint64_t m = 1ull << p;
-    if (c[q+1] == m) return std::numeric_limits<double>::infinity();
+    if((ret.infinite = c[q+1] == m)) return ret;
 
     int kMin, kMax;
     for(kMin=0; c[kMin]==0; ++kMin);
@@ -591,12 +825,28 @@ TODO:  Consider adding this change to the method. This could improve our perform
     unsigned cPrime = c[q+1];
     if(q) cPrime += c[kMaxPrime];
     double gprev;
-    double x;
     double a = z + c[0];
     int mPrime = m - c[0];
-    gprev = z + ldexp(c[q+1], -q); // Reuse gprev, setting to 0 after.
-    x = gprev <= 1.5*a ? mPrime/(0.5*gprev+a): (mPrime/gprev)*std::log1p(gprev/a);
-    gprev = 0;
+    gprev = z + ldexp(c[q+1], -q);
+    ret.x = gprev <= 1.5*a ? mPrime/(0.5*gprev+a): (mPrime/gprev)*std::log1p(gprev/a);
+    ret.a = a;
+    ret.cPrime = cPrime;
+    ret.mPrime = mPrime;
+    ret.kMinPrime = kMinPrime;
+    ret.kMaxPrime = kMaxPrime;
+    return ret;
+}
+
+template<typename T>
+static double ertl_ml_estimate(const T& c, unsigned p, unsigned q, double relerr) {
+    const uint64_t m = 1ull << p;
+    const ertl_ml_init_t init = ertl_ml_init(c, p, q);
+    if(init.infinite) return std::numeric_limits<double>::infinity();
+    const int kMinPrime = init.kMinPrime, kMaxPrime = init.kMaxPrime, mPrime = init.mPrime;
+    const unsigned cPrime = init.cPrime;
+    const double a = init.a;
+    double x = init.x;
+    double gprev = 0;
     double deltaX = x;
     relerr /= std::sqrt(m);
     while(deltaX > x*relerr) {
@@ -626,6 +876,180 @@ TODO:  Consider adding this change to the method. This could improve our perform
     return x*m;
 }
 
+/*
+ * ertl_ml_estimate for many histograms at once, e.g., the union histograms of a block of pairs.
+ * Each vector lane runs the secant solve of one histogram, performing the scalar version's operations
+ * in the same order, so the results are bit-for-bit identical when the scalar version is built without
+ * floating-point contraction (-ffp-contract=off), and otherwise differ only in rounding;
+ * lanes whose loops have finished are masked off.
+ * Its cost is dominated by a chain of dependent divisions per histogram, which lanes overlap.
+ * The transposed table of counts lets each step load one count per lane with a single vector load.
+ * counts[i][k] must be valid for k in [0, q + 1], as for ertl_ml_estimate.
+ */
+static constexpr unsigned ERTL_BATCH_MAX_Q = 64;
+
+#if SKETCH_ISA_DISPATCH
+// The lanes never fuse multiplies and adds, so they round as ertl_ml_estimate does when it is built without contraction.
+#if defined(__clang__)
+#  pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#  pragma GCC push_options
+#  pragma GCC optimize("fp-contract=off")
+#endif
+struct ertl_ops_avx2 {
+    using type = __m256d;
+    using mask = __m256d;
+    static constexpr unsigned W = 4;
+    SKETCH_TARGET_AVX2 static type set1(double x) {return _mm256_set1_pd(x);}
+    SKETCH_TARGET_AVX2 static type load(const double *p) {return _mm256_loadu_pd(p);}
+    SKETCH_TARGET_AVX2 static void store(double *p, type x) {_mm256_storeu_pd(p, x);}
+    SKETCH_TARGET_AVX2 static type add(type x, type y) {return _mm256_add_pd(x, y);}
+    SKETCH_TARGET_AVX2 static type sub(type x, type y) {return _mm256_sub_pd(x, y);}
+    SKETCH_TARGET_AVX2 static type mul(type x, type y) {return _mm256_mul_pd(x, y);}
+    SKETCH_TARGET_AVX2 static type div(type x, type y) {return _mm256_div_pd(x, y);}
+    SKETCH_TARGET_AVX2 static type max(type x, type y) {return _mm256_max_pd(x, y);}
+    SKETCH_TARGET_AVX2 static mask gt(type x, type y) {return _mm256_cmp_pd(x, y, _CMP_GT_OQ);}
+    SKETCH_TARGET_AVX2 static mask ge(type x, type y) {return _mm256_cmp_pd(x, y, _CMP_GE_OQ);}
+    SKETCH_TARGET_AVX2 static mask lt(type x, type y) {return _mm256_cmp_pd(x, y, _CMP_LT_OQ);}
+    SKETCH_TARGET_AVX2 static mask le(type x, type y) {return _mm256_cmp_pd(x, y, _CMP_LE_OQ);}
+    SKETCH_TARGET_AVX2 static mask and_(mask x, mask y) {return _mm256_and_pd(x, y);}
+    SKETCH_TARGET_AVX2 static bool any(mask x) {return _mm256_movemask_pd(x) != 0;}
+    // m ? x: y
+    SKETCH_TARGET_AVX2 static type blend(mask m, type x, type y) {return _mm256_blendv_pd(y, x, m);}
+    // The exponent frexp returns for positive, normal x, as a double.
+    SKETCH_TARGET_AVX2 static type frexp_exp(type x) {
+        const __m256i e = _mm256_srli_epi64(_mm256_castpd_si256(x), 52);
+        return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(e, _mm256_set1_epi64x(0x4330000000000000ll))), _mm256_set1_pd(4503599627370496. + 1022.));
+    }
+    // 2^-s for integral s in [0, 1022].
+    SKETCH_TARGET_AVX2 static type exp2_neg(type s) {
+        const __m256i bits = _mm256_castpd_si256(_mm256_add_pd(s, _mm256_set1_pd(4503599627370496.)));
+        return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_sub_epi64(_mm256_set1_epi64x(0x4330000000000000ll + 1023), bits), 52));
+    }
+};
+struct ertl_ops_avx512 {
+    using type = __m512d;
+    using mask = __mmask8;
+    static constexpr unsigned W = 8;
+    SKETCH_TARGET_AVX512 static type set1(double x) {return _mm512_set1_pd(x);}
+    SKETCH_TARGET_AVX512 static type load(const double *p) {return _mm512_loadu_pd(p);}
+    SKETCH_TARGET_AVX512 static void store(double *p, type x) {_mm512_storeu_pd(p, x);}
+    SKETCH_TARGET_AVX512 static type add(type x, type y) {return _mm512_add_pd(x, y);}
+    SKETCH_TARGET_AVX512 static type sub(type x, type y) {return _mm512_sub_pd(x, y);}
+    SKETCH_TARGET_AVX512 static type mul(type x, type y) {return _mm512_mul_pd(x, y);}
+    SKETCH_TARGET_AVX512 static type div(type x, type y) {return _mm512_div_pd(x, y);}
+    SKETCH_TARGET_AVX512 static type max(type x, type y) {return _mm512_maskz_max_pd(0xFF, x, y);}
+    SKETCH_TARGET_AVX512 static mask gt(type x, type y) {return _mm512_cmp_pd_mask(x, y, _CMP_GT_OQ);}
+    SKETCH_TARGET_AVX512 static mask ge(type x, type y) {return _mm512_cmp_pd_mask(x, y, _CMP_GE_OQ);}
+    SKETCH_TARGET_AVX512 static mask lt(type x, type y) {return _mm512_cmp_pd_mask(x, y, _CMP_LT_OQ);}
+    SKETCH_TARGET_AVX512 static mask le(type x, type y) {return _mm512_cmp_pd_mask(x, y, _CMP_LE_OQ);}
+    SKETCH_TARGET_AVX512 static mask and_(mask x, mask y) {return x & y;}
+    SKETCH_TARGET_AVX512 static bool any(mask x) {return x != 0;}
+    SKETCH_TARGET_AVX512 static type blend(mask m, type x, type y) {return _mm512_mask_blend_pd(m, y, x);}
+    SKETCH_TARGET_AVX512 static type frexp_exp(type x) {
+        return _mm512_sub_pd(_mm512_cvtepi64_pd(_mm512_maskz_srli_epi64(0xFF, _mm512_castpd_si512(x), 52)), _mm512_set1_pd(1022.));
+    }
+    SKETCH_TARGET_AVX512 static type exp2_neg(type s) {
+        return _mm512_castsi512_pd(_mm512_maskz_slli_epi64(0xFF, _mm512_sub_epi64(_mm512_set1_epi64(1023), _mm512_cvtpd_epi64(s)), 52));
+    }
+};
+
+// Estimates for up to O::W histograms, one per lane.
+template<typename O, typename T>
+inline void ertl_ml_group(const T *counts, size_t n, unsigned p, unsigned q, double relerr, double *out) {
+    using V = typename O::type;
+    constexpr unsigned W = O::W;
+    const uint64_t m = 1ull << p;
+    // Lanes without a histogram, or whose estimate is infinite, keep x = 0 and never run.
+    double cd[(ERTL_BATCH_MAX_Q + 2) * W], xs[W]{}, as[W]{}, cps[W]{}, mps[W]{}, kmins[W]{}, kmaxs[W]{};
+    bool infinite[W]{};
+    std::fill(cd, cd + (q + 1) * W, 0.);
+    int ktop = 0, kbottom = ERTL_BATCH_MAX_Q;
+    for(size_t i = 0; i < n; ++i) {
+        const ertl_ml_init_t init = ertl_ml_init(counts[i], p, q);
+        if((infinite[i] = init.infinite)) continue;
+        xs[i] = init.x; as[i] = init.a; cps[i] = init.cPrime; mps[i] = init.mPrime;
+        kmins[i] = init.kMinPrime; kmaxs[i] = init.kMaxPrime;
+        for(int k = init.kMinPrime; k < init.kMaxPrime; ++k) cd[k * W + i] = counts[i][k];
+        ktop = std::max(ktop, init.kMaxPrime - 1);
+        kbottom = std::min(kbottom, init.kMinPrime);
+    }
+    const V a = O::load(as), cPrime = O::load(cps), mPrime = O::load(mps), kMinPrime = O::load(kmins), kMaxPrime = O::load(kmaxs),
+            one = O::set1(1.), two = O::set1(2.), relerrv = O::set1(relerr / std::sqrt(m));
+    V x = O::load(xs), deltaX = x, gprev = O::set1(0.);
+    for(;;) {
+        const auto active = O::gt(deltaX, O::mul(x, relerrv));
+        if(!O::any(active)) break;
+        const V kappaMinus1 = O::frexp_exp(x);
+        V xPrime = O::mul(x, O::exp2_neg(O::max(O::add(kMaxPrime, one), O::add(kappaMinus1, two))));
+        const V xPrime2 = O::mul(xPrime, xPrime);
+        V h = O::add(O::sub(xPrime, O::div(xPrime2, O::set1(3.))),
+                     O::mul(O::mul(xPrime2, xPrime2), O::sub(O::set1(1./45.), O::div(xPrime2, O::set1(472.5)))));
+        // k from kappaMinus1 down to kMaxPrime, in lockstep: the lane's step t is k = kappaMinus1 - t.
+        for(V k = O::set1(0.);; k = O::add(k, one)) {
+            const auto mk = O::and_(active, O::le(k, O::sub(kappaMinus1, kMaxPrime)));
+            if(!O::any(mk)) break;
+            const V hPrime = O::sub(one, h);
+            h = O::blend(mk, O::div(O::add(xPrime, O::mul(h, hPrime)), O::add(xPrime, hPrime)), h);
+            xPrime = O::blend(mk, O::add(xPrime, xPrime), xPrime);
+        }
+        V g = O::mul(cPrime, h);
+        for(int k = ktop; k >= kbottom; --k) {
+            const V kv = O::set1(k);
+            const auto mk = O::and_(active, O::and_(O::lt(kv, kMaxPrime), O::ge(kv, kMinPrime)));
+            const V hPrime = O::sub(one, h);
+            h = O::blend(mk, O::div(O::add(xPrime, O::mul(h, hPrime)), O::add(xPrime, hPrime)), h);
+            xPrime = O::blend(mk, O::add(xPrime, xPrime), xPrime);
+            g = O::blend(mk, O::add(g, O::mul(O::load(cd + k * W), h)), g);
+        }
+        g = O::add(g, O::mul(x, a));
+        const V step = O::blend(O::and_(O::lt(gprev, g), O::le(g, mPrime)), O::mul(deltaX, O::div(O::sub(g, mPrime), O::sub(gprev, g))), O::set1(0.));
+        deltaX = O::blend(active, step, deltaX);
+        x = O::blend(active, O::add(x, deltaX), x);
+        gprev = O::blend(active, g, gprev);
+    }
+    O::store(xs, O::mul(x, O::set1(double(m))));
+    for(size_t i = 0; i < n; ++i) out[i] = infinite[i] ? std::numeric_limits<double>::infinity(): xs[i];
+}
+
+template<typename T>
+SKETCH_TARGET_AVX2 inline void ertl_ml_batch_avx2(const T *counts, size_t n, unsigned p, unsigned q, double relerr, double *out) {
+    for(size_t i = 0; i < n; i += ertl_ops_avx2::W)
+        ertl_ml_group<ertl_ops_avx2>(counts + i, std::min(n - i, size_t(ertl_ops_avx2::W)), p, q, relerr, out + i);
+}
+template<typename T>
+SKETCH_TARGET_AVX512 inline void ertl_ml_batch_avx512(const T *counts, size_t n, unsigned p, unsigned q, double relerr, double *out) {
+    for(size_t i = 0; i < n; i += ertl_ops_avx512::W)
+        ertl_ml_group<ertl_ops_avx512>(counts + i, std::min(n - i, size_t(ertl_ops_avx512::W)), p, q, relerr, out + i);
+}
+#if defined(__clang__)
+#  pragma STDC FP_CONTRACT DEFAULT
+#elif defined(__GNUC__)
+#  pragma GCC pop_options
+#endif
+#endif /* SKETCH_ISA_DISPATCH */
+
+template<typename T>
+inline void ertl_ml_estimate_batch_isa(const T *counts, size_t n, unsigned p, unsigned q, double *out, isa_t isa, double relerr=1e-2) {
+    PREC_REQ(q <= ERTL_BATCH_MAX_Q, "q is too large");
+#if SKETCH_ISA_DISPATCH
+    if(isa >= isa_t::AVX512) return ertl_ml_batch_avx512(counts, n, p, q, relerr, out);
+    if(isa >= isa_t::AVX2)   return ertl_ml_batch_avx2(counts, n, p, q, relerr, out);
+#endif
+    for(size_t i = 0; i < n; ++i) out[i] = ertl_ml_estimate(counts[i], p, q, relerr);
+}
+// out[i] = ertl_ml_estimate(counts[i], p, q, relerr) for i in [0, n).
+template<typename T>
+inline void ertl_ml_estimate_batch(const T *counts, size_t n, unsigned p, unsigned q, double *out, double relerr=1e-2) {
+    ertl_ml_estimate_batch_isa(counts, n, p, q, out, runtime_isa(), relerr);
+}
+// As above, with blocks of histograms distributed over pool's workers.
+template<typename T, typename Pool, typename=if_thread_pool_t<Pool>>
+inline void ertl_ml_estimate_batch(const T *counts, size_t n, unsigned p, unsigned q, double *out, Pool &pool, double relerr=1e-2) {
+    pool.parallel_for_range(0, n, [&](size_t b, size_t e) {ertl_ml_estimate_batch(counts + b, e - b, p, q, out + b, relerr);},
+                            std::max(n / (8 * pool.size()), size_t(64)));
+}
+
 template<typename HllType>
 double ertl_ml_estimate(const HllType& c, double relerr=1e-2) {
     return ertl_ml_estimate(detail::sum_counts(c.core()), c.p(), c.q(), relerr);
@@ -633,42 +1057,40 @@ double ertl_ml_estimate(const HllType& c, double relerr=1e-2) {
 
 } // namespace detail
 
+// Histogram of the union of two sketches' registers, computed in one pass without building the union sketch.
 template<typename HllType>
-std::array<double, 3> ertl_joint(const HllType &h1, const HllType &h2) {
-    assert(h1.m() == h2.m() || !std::fprintf(stderr, "sizes don't match! Size1: %zu. Size2: %zu\n", h1.size(), h2.size()));
+CountArrayType union_counts(const HllType &h1, const HllType &h2) {
+    PREC_REQ(h1.m() == h2.m(), "mismatched sketch sizes.");
+    CountArrayType ret{0};
+    detail::union_histogram(h1.core().data(), h2.core().data(), h1.core().size(), ret);
+    return ret;
+}
+// All of the histograms ertl_joint needs, in one pass over both sketches.
+template<typename HllType>
+joint_counts_t<> joint_counts(const HllType &h1, const HllType &h2) {
+    PREC_REQ(h1.m() == h2.m(), "mismatched sketch sizes.");
+    joint_counts_t<> ret{};
+    detail::joint_histogram(h1.core().data(), h2.core().data(), h1.core().size(), ret);
+    return ret;
+}
+
+namespace detail {
+template<typename CountType, size_t N>
+std::array<double, 3> ertl_joint_estimate(const joint_counts_t<CountType, N> &jc, unsigned p, unsigned q, double cAX, double cBX) {
     std::array<double, 3> ret;
-    if(h1.get_jestim() != ERTL_JOINT_MLE) {
-        ret[2] = h1.union_size(h2);
-        ret[0] = h1.creport();
-        ret[1] = h2.creport();
-        ret[2] = ret[0] + ret[1] - ret[2];
-        ret[0] -= ret[2];
-        ret[1] -= ret[2];
-        ret[2] = std::max(ret[2], 0.);
-        return ret;
-    }
-    using detail::ertl_ml_estimate;
-    auto p = h1.p();
-    auto q = h1.q();
-    std::array<uint32_t, 64> c1{0}, c2{0}, cu{0}, ceq{0}, cg1{0}, cg2{0};
-    detail::joint_unroller ju;
-    ju.sum_arrays(h1.core(), h2.core(), c1, c2, cu, cg1, cg2, ceq);
-    const double cAX = h1.get_is_ready() ? h1.creport() : ertl_ml_estimate(c1, h1.p(), h1.q());
-    const double cBX = h2.get_is_ready() ? h2.creport() : ertl_ml_estimate(c2, h2.p(), h2.q());
-    const double cABX = ertl_ml_estimate(cu, h1.p(), h1.q());
-    // std::fprintf(stderr, "Made initials: %lf, %lf, %lf\n", cAX, cBX, cABX);
+    const double cABX = ertl_ml_estimate(jc.un, p, q);
     std::array<uint32_t, 64> countsAXBhalf;
     std::array<uint32_t, 64> countsBXAhalf;
-    countsAXBhalf[q] = h1.m();
-    countsBXAhalf[q] = h1.m();
+    countsAXBhalf[q] = 1ull << p;
+    countsBXAhalf[q] = 1ull << p;
     for(unsigned _q = 0; _q < q; ++_q) {
         // Handle AXBhalf
-        countsAXBhalf[_q] = cg1[_q] + ceq[_q] + cg2[_q + 1];
+        countsAXBhalf[_q] = jc.lhs_gt[_q] + jc.eq[_q] + jc.rhs_gt[_q + 1];
         assert(countsAXBhalf[q] >= countsAXBhalf[_q]);
         countsAXBhalf[q] -= countsAXBhalf[_q];
 
         // Handle BXAhalf
-        countsBXAhalf[_q] = cg2[_q] + ceq[_q] + cg1[_q + 1];
+        countsBXAhalf[_q] = jc.rhs_gt[_q] + jc.eq[_q] + jc.lhs_gt[_q + 1];
         assert(countsBXAhalf[q] >= countsBXAhalf[_q]);
         countsBXAhalf[q] -= countsBXAhalf[_q];
     }
@@ -682,6 +1104,34 @@ std::array<double, 3> ertl_joint(const HllType &h1, const HllType &h2) {
     ret[2] = std::max(0., 0.5 * (cX1 + cX2));
     return ret;
 }
+} // namespace detail
+
+// Joint estimate from precomputed counts (see joint_counts), e.g., to batch the estimation for many pairs.
+template<typename CountType, size_t N>
+std::array<double, 3> ertl_joint(const joint_counts_t<CountType, N> &jc, unsigned p, unsigned q) {
+    return detail::ertl_joint_estimate(jc, p, q, detail::ertl_ml_estimate(jc.lhs, p, q), detail::ertl_ml_estimate(jc.rhs, p, q));
+}
+
+template<typename HllType>
+std::array<double, 3> ertl_joint(const HllType &h1, const HllType &h2) {
+    assert(h1.m() == h2.m() || !std::fprintf(stderr, "sizes don't match! Size1: %zu. Size2: %zu\n", h1.size(), h2.size()));
+    std::array<double, 3> ret;
+    if(h1.get_jestim() != ERTL_JOINT_MLE) {
+        ret[2] = h1.union_size(h2);
+        ret[0] = h1.creport();
+        ret[1] = h2.creport();
+        ret[2] = ret[0] + ret[1] - ret[2];
+        ret[0] -= ret[2];
+        ret[1] -= ret[2];
+        ret[2] = std::max(ret[2], 0.);
+        return ret;
+    }
+    using detail::ertl_ml_estimate;
+    const auto jc = joint_counts(h1, h2);
+    const double cAX = h1.get_is_ready() ? h1.creport() : ertl_ml_estimate(jc.lhs, h1.p(), h1.q());
+    const double cBX = h2.get_is_ready() ? h2.creport() : ertl_ml_estimate(jc.rhs, h2.p(), h2.q());
+    return detail::ertl_joint_estimate(jc, h1.p(), h1.q(), cAX, cBX);
+}
 
 template<typename HllType>
 std::array<double, 3> ertl_joint(HllType &h1, HllType &h2) {
@@ -874,6 +1324,96 @@ public:
         add(hasher(s, len));
     }
 #endif
+    // Bulk insertion.
+    // Values are processed in blocks of BATCH_SIZE: register indices and
+    // leading-zero counts are computed for the whole block and the target registers
+    // are prefetched before any of them is updated, so that cache misses on large sketches overlap.
+    // If single_writer is set, registers are updated with plain stores instead of CAS.
+    static constexpr size_t BATCH_SIZE = 64;
+    void add_batch(const uint64_t *SK_RESTRICT hashvals, size_t n, bool single_writer=!SKETCH_THREADSAFE) noexcept {
+        const size_t nblocks = n / BATCH_SIZE;
+        if(single_writer)
+            for(size_t b = 0; b < nblocks; ++b) add_block<false>(hashvals + b * BATCH_SIZE);
+        else
+            for(size_t b = 0; b < nblocks; ++b) add_block<true>(hashvals + b * BATCH_SIZE);
+        add_tail(hashvals + nblocks * BATCH_SIZE, n - nblocks * BATCH_SIZE, single_writer, [](uint64_t x) {return x;});
+    }
+    void addh_batch(const uint64_t *SK_RESTRICT elements, size_t n, bool single_writer=!SKETCH_THREADSAFE) noexcept {
+        static constexpr size_t nper = sizeof(VType) / sizeof(uint64_t);
+        static_assert(BATCH_SIZE % nper == 0, "BATCH_SIZE must be a multiple of the vector width");
+        uint64_t buf[BATCH_SIZE];
+        using Space = vec::SIMDTypes<uint64_t>;
+        const size_t nblocks = n / BATCH_SIZE;
+        for(size_t b = 0; b < nblocks; ++b) {
+            const uint64_t *const block = elements + b * BATCH_SIZE;
+            CONST_IF(hash::batch::has_kernel<HashStruct>::value) {
+                hash_batch(hf_, block, buf, BATCH_SIZE);
+            } else {
+                SK_UNROLL_8
+                for(size_t j = 0; j < BATCH_SIZE; j += nper)
+                    Space::storeu(reinterpret_cast<Type *>(buf + j),
+                                  hf_(Space::loadu(reinterpret_cast<const Type *>(block + j))));
+            }
+            if(single_writer) add_block<false>(buf);
+            else              add_block<true>(buf);
+        }
+        add_tail(elements + nblocks * BATCH_SIZE, n - nblocks * BATCH_SIZE, single_writer, [this](uint64_t x) {return uint64_t(hf_(x));});
+    }
+    template<typename Container, typename=detail::if_contiguous_u64_t<Container>>
+    void addh_batch(const Container &con, bool single_writer=!SKETCH_THREADSAFE) noexcept {
+        addh_batch(con.data(), con.size(), single_writer);
+    }
+    // Splits the elements across pool's workers, which update registers with CAS.
+    template<typename Pool, typename=detail::if_thread_pool_t<Pool>>
+    void addh_batch(const uint64_t *SK_RESTRICT elements, size_t n, Pool &pool) {
+        const size_t nblocks = (n + BATCH_SIZE - 1) / BATCH_SIZE;
+        pool.parallel_for_range(0, nblocks, [this,elements,n](size_t b, size_t e) {
+            addh_batch(elements + b * BATCH_SIZE, std::min(e * BATCH_SIZE, n) - b * BATCH_SIZE, false);
+        }, std::max(nblocks / (8 * pool.size()), size_t(16)));
+        not_ready();
+    }
+private:
+    template<bool atomic>
+    INLINE void add_block(const uint64_t *SK_RESTRICT hashvals) noexcept {
+        uint32_t indices[BATCH_SIZE];
+        uint8_t lzts[BATCH_SIZE];
+        uint8_t *const regs = core_.data();
+        const unsigned shift = q();
+        SK_UNROLL_8
+        for(size_t j = 0; j < BATCH_SIZE; ++j) {
+            const uint64_t hv = hashvals[j];
+            indices[j] = shift == 64 ? uint32_t(0): uint32_t(hv >> shift);
+            lzts[j] = clz(((hv << 1)|1) << (np_ - 1)) + 1;
+            __builtin_prefetch(regs + indices[j], 1);
+        }
+        for(size_t j = 0; j < BATCH_SIZE; ++j) set_register<atomic>(indices[j], lzts[j]);
+    }
+    template<bool atomic>
+    INLINE void set_register(uint32_t index, uint8_t lzt) noexcept {
+        uint8_t *const regs = core_.data();
+        CONST_IF(atomic) {
+            for(;regs[index] < lzt;
+                 __sync_bool_compare_and_swap(&regs[index], regs[index], lzt));
+        } else {
+            if(regs[index] < lzt) regs[index] = lzt;
+        }
+#if LZ_COUNTER
+        ++clz_counts_[lzt];
+#endif
+    }
+    // Updates registers for the leftovers after the last full block as the blocks are: with CAS unless single_writer, regardless of NOT_THREADSAFE.
+    template<typename Func>
+    INLINE void add_tail(const uint64_t *SK_RESTRICT vals, size_t n, bool single_writer, const Func &func) noexcept {
+        const unsigned shift = q();
+        for(size_t i = 0; i < n; ++i) {
+            const uint64_t hv = func(vals[i]);
+            const uint32_t index = shift == 64 ? uint32_t(0): uint32_t(hv >> shift);
+            const uint8_t lzt = clz(((hv << 1)|1) << (np_ - 1)) + 1;
+            if(single_writer) set_register<false>(index, lzt);
+            else              set_register<true>(index, lzt);
+        }
+    }
+public:
     void parsum(int nthreads=-1, size_t pb=4096) {
         if(nthreads < 0) nthreads = nthreads > 0 ? nthreads: std::thread::hardware_concurrency();
         std::atomic<uint64_t> acounts[64];
@@ -885,6 +1425,17 @@ public:
         std::memcpy(counts, acounts, sizeof(counts));
         value_ = detail::calculate_estimate(counts, estim_, m(), np_, alpha());
     }
+    template<typename Pool, typename=detail::if_thread_pool_t<Pool>>
+    void parsum(Pool &pool, size_t pb=4096) {
+        std::atomic<uint64_t> acounts[64];
+        std::fill(std::begin(acounts), std::end(acounts), 0);
+        detail::parsum_data_t<decltype(core_)> data{acounts, core_, m(), pb};
+        const uint64_t nr(core_.size() / pb + (core_.size() % pb != 0));
+        pool.parallel_for(0, nr, [&data](size_t i) {detail::parsum_helper<decltype(core_)>(&data, i, 0);}, 1);
+        uint64_t counts[64];
+        std::memcpy(counts, acounts, sizeof(counts));
+        value_ = detail::calculate_estimate(counts, estim_, m(), np_, alpha());
+    }
     ssize_t printf(std::FILE *fp) const noexcept {
         ssize_t ret = std::fputc('[', fp) > 0;
         for(size_t i = 0; i < core_.size() - 1; ++i)
@@ -957,36 +1508,7 @@ public:
 
     hllbase_t &operator+=(const hllbase_t &other) noexcept {
         PREC_REQ(np_ == other.np_, "mismatched sketch sizes.");
-        unsigned i;
-#if HAS_AVX_512 || __AVX2__ || __SSE2__
-        if(m() >= sizeof(Type)) {
-#if HAS_AVX_512 && __AVX512BW__
-            __m512i *els(reinterpret_cast<__m512i *>(core_.data()));
-            const __m512i *oels(reinterpret_cast<const __m512i *>(other.core_.data()));
-            for(i = 0; i < m() >> 6; ++i) els[i] = _mm512_max_epu8(els[i], oels[i]); // mm512_max_epu8 is available on with AVX512BW :(
-#elif __AVX2__
-            __m256i *els(reinterpret_cast<__m256i *>(core_.data()));
-            const __m256i *oels(reinterpret_cast<const __m256i *>(other.core_.data()));
-            for(i = 0; i < m() * sizeof(uint8_t) / sizeof(__m256i); ++i) {
-                assert(reinterpret_cast<const char *>(&els[i]) < reinterpret_cast<const char *>(&core_[core_.size()]));
-                els[i] = _mm256_max_epu8(els[i], oels[i]);
-            }
-#else // __SSE2__
-            __m128i *els(reinterpret_cast<__m128i *>(core_.data()));
-            const __m128i *oels(reinterpret_cast<const __m128i *>(other.core_.data()));
-            for(i = 0; i < m() >> 4; ++i) els[i] = _mm_max_epu8(els[i], oels[i]);
-#endif /* #if (HAS_AVX_512 && __AVX512BW__) || __AVX2__ || true */
-
-            if(m() < sizeof(Type)) for(;i < m(); ++i) core_[i] = std::max(core_[i], other.core_[i]);
-        } else {
-#endif /* #if HAS_AVX_512 || __AVX2__ || __SSE2__ */
-            uint64_t *els(reinterpret_cast<uint64_t *>(core_.data()));
-            const uint64_t *oels(reinterpret_cast<const uint64_t *>(other.core_.data()));
-            while(els < reinterpret_cast<const uint64_t *>(core_.data() + core_.size()))
-                *els = std::max(*els, *oels), ++els, ++oels;
-#if HAS_AVX_512 || __AVX2__ || __SSE2__
-        }
-#endif
+        detail::max_bytes(core_.data(), other.core_.data(), core_.size());
         not_ready();
         return *this;
     }
@@ -1125,16 +1647,7 @@ public:
     double union_size(const hllbase_t &other) const noexcept {
         if(jestim_ != JointEstimationMethod::ERTL_JOINT_MLE) {
             assert(m() == other.m());
-            std::array<uint32_t, 64> counts{0};
-            // We can do this because we use an aligned allocator.
-            // We also have found that wider vectors than SSE2 don't matter
-            const __m128i *p1(reinterpret_cast<const __m128i *>(data())), *p2(reinterpret_cast<const __m128i *>(other.data()));
-            const __m128i *const pe(reinterpret_cast<const __m128i *>(&core_[core_.size()]));
-            for(__m128i tmp;p1 < pe;) {
-                tmp = _mm_max_epu8(*p1++, *p2++);
-                for(size_t i = 0; i < sizeof(tmp);++counts[reinterpret_cast<uint8_t *>(&tmp)[i++]]);
-            }
-            return detail::calculate_estimate(counts, get_estim(), m(), p(), alpha());
+            return detail::calculate_estimate(union_counts(*this, other), get_estim(), m(), p(), alpha());
         }
         const auto full_counts = ertl_joint(*this, other);
         return full_counts[0] + full_counts[1] + full_counts[2];
@@ -1303,6 +1816,117 @@ public:
 
 using shll_t = shllbase_t<>;
 
+template<typename HashStruct=WangHash>
+class concurrent_hllbase_t {
+    // Sharded HyperLogLog for many concurrent writers.
+    // Each writer updates its own private core, so there is no cache-line
+    // contention between threads. Shards are max-merged with hllbase_t::operator+=
+    // only when an estimate is requested.
+    // Each shard carries a generation counter bumped on every register change;
+    // a cached estimate is reused until the summed generation moves.
+public:
+    using hll_type = hllbase_t<HashStruct>;
+private:
+    struct alignas(64) shard_t {
+        hll_type             hll_;
+        std::atomic<uint64_t> gen_;
+        template<typename...Args>
+        shard_t(Args &&...args): hll_(std::forward<Args>(args)...), gen_(0) {}
+        shard_t(const shard_t &o): hll_(o.hll_), gen_(o.gen_.load()) {}
+    };
+    std::vector<shard_t, sse::AlignedAllocator<shard_t, sse::Alignment::KL>> shards_;
+    mutable hll_type      merged_;
+    mutable uint64_t      merged_gen_;
+    mutable std::mutex    mut_;
+    static unsigned next_slot() {
+        static std::atomic<unsigned> counter{0};
+        thread_local const unsigned slot = counter++;
+        return slot;
+    }
+    uint64_t generation() const {
+        uint64_t ret = 0;
+        for(const auto &s: shards_) ret += s.gen_.load(std::memory_order_acquire);
+        return ret;
+    }
+    // Union of all shards, re-merged only if any shard has changed since the last call. Requires mut_.
+    const hll_type &merged_locked() const {
+        const uint64_t gen = generation();
+        if(gen != merged_gen_ || !merged_.is_calculated()) {
+            merged_.clear();
+            for(const auto &s: shards_) merged_ += s.hll_;
+            merged_.sum();
+            merged_gen_ = gen;
+        }
+        return merged_;
+    }
+    // Copies o under the lock held by the caller, so the cached union is not read mid-merge.
+    concurrent_hllbase_t(const concurrent_hllbase_t &o, const std::lock_guard<std::mutex> &):
+        shards_(o.shards_), merged_(o.merged_), merged_gen_(o.merged_gen_) {}
+public:
+    template<typename...Args>
+    explicit concurrent_hllbase_t(size_t np, size_t nshards=std::thread::hardware_concurrency(), Args &&...args):
+        merged_(np, args...), merged_gen_(0)
+    {
+        if(nshards == 0) nshards = 1;
+        shards_.reserve(nshards);
+        while(shards_.size() < nshards) shards_.emplace_back(np, args...);
+        merged_.not_ready();
+    }
+    concurrent_hllbase_t(const concurrent_hllbase_t &o): concurrent_hllbase_t(o, std::lock_guard<std::mutex>(o.mut_)) {}
+    size_t nshards() const {return shards_.size();}
+    uint32_t p() const {return merged_.p();}
+    uint64_t m() const {return merged_.m();}
+    // Default shard for the calling thread. Threads are assigned slots round-robin on first use.
+    unsigned thread_shard() const {return next_slot() % shards_.size();}
+
+    INLINE void add(uint64_t hashval, unsigned tid) noexcept {
+        assert(tid < shards_.size());
+        shard_t &s = shards_[tid];
+        auto &core = s.hll_.mutable_core();
+        const uint32_t index(s.hll_.q() == 64 ? uint32_t(0): uint32_t(hashval >> s.hll_.q()));
+        const uint8_t lzt = clz(((hashval << 1)|1) << (s.hll_.p() - 1)) + 1;
+        if(core[index] < lzt) {
+            // CAS is uncontended unless more threads than shards share a slot.
+            for(;core[index] < lzt;
+                 __sync_bool_compare_and_swap(&core[index], core[index], lzt));
+            s.gen_.fetch_add(1, std::memory_order_release);
+        }
+    }
+    INLINE void addh(uint64_t element, unsigned tid) noexcept {
+        assert(tid < shards_.size());
+        add(shards_[tid].hll_.hash(element), tid);
+    }
+    INLINE void add(uint64_t hashval)   noexcept {add(hashval, thread_shard());}
+    INLINE void addh(uint64_t element)  noexcept {addh(element, thread_shard());}
+    void addh_batch(const uint64_t *elements, size_t n, unsigned tid) noexcept {
+        assert(tid < shards_.size());
+        shards_[tid].hll_.addh_batch(elements, n, false);
+        shards_[tid].gen_.fetch_add(1, std::memory_order_release);
+    }
+    void addh_batch(const uint64_t *elements, size_t n) noexcept {addh_batch(elements, n, thread_shard());}
+
+    // Returns a copy of the union of all shards.
+    hll_type merged() const {
+        std::lock_guard<std::mutex> lock(mut_);
+        return merged_locked();
+    }
+    double report() const {
+        std::lock_guard<std::mutex> lock(mut_);
+        return merged_locked().creport();
+    }
+    double creport() const {return report();}
+    double cardinality_estimate() const {return report();}
+    hll_type finalize() const {return merged();}
+    void clear() {
+        std::lock_guard<std::mutex> lock(mut_);
+        for(auto &s: shards_) s.hll_.clear(), s.gen_.fetch_add(1, std::memory_order_release);
+        merged_.clear();
+    }
+    double union_size(const concurrent_hllbase_t &o) const {return merged().union_size(o.merged());}
+    double jaccard_index(const concurrent_hllbase_t &o) const {return merged().jaccard_index(o.merged());}
+};
+using concurrent_hll_t = concurrent_hllbase_t<>;
+
 // Returns the size of the set intersection
 template<typename HS>
 inline double intersection_size(hllbase_t<HS> &first, hllbase_t<HS> &other) noexcept {
@@ -1564,33 +2188,7 @@ struct wh119_t {
     }
     wh119_t &operator+=(const wh119_t &o) {
         PREC_REQ(size() == o.size(), "mismatched sketch sizes.");
-        unsigned i;
-#if HAS_AVX_512 || __AVX2__ || __SSE2__
-        if(m() >= sizeof(Type)) {
-#if HAS_AVX_512 && __AVX512BW__
-            __m512i *els(reinterpret_cast<__m512i *>(core_.data()));
-            const __m512i *oels(reinterpret_cast<const __m512i *>(o.core_.data()));
-            for(i = 0; i < m() >> 6; ++i) els[i] = _mm512_max_epu8(els[i], oels[i]); // mm512_max_epu8 is available on with AVX512BW :(
-#elif __AVX2__
-            __m256i *els(reinterpret_cast<__m256i *>(core_.data()));
-            const __m256i *oels(reinterpret_cast<const __m256i *>(o.core_.data()));
-            for(i = 0; i < m() * sizeof(uint8_t) / sizeof(__m256i); ++i) {
-                assert(reinterpret_cast<const char *>(&els[i]) < reinterpret_cast<const char *>(&core_[core_.size()]));
-                els[i] = _mm256_max_epu8(els[i], oels[i]);
-            }
-#else // __SSE2__
-            __m128i *els(reinterpret_cast<__m128i *>(core_.data()));
-            const __m128i *oels(reinterpret_cast<const __m128i *>(o.core_.data()));
-            for(i = 0; i < m() >> 4; ++i) els[i] = _mm_max_epu8(els[i], oels[i]);
-#endif /* #if (HAS_AVX_512 && __AVX512BW__) || __AVX2__ || true */
-
-            if(m() < sizeof(Type)) for(;i < m(); ++i) core_[i] = std::max(core_[i], o.core_[i]);
-        } else {
-#endif /* #if HAS_AVX_512 || __AVX2__ || __SSE2__ */
-            std::transform(core_.data(), core_.data() + core_.size(), o.core_.data(), core_.data(), [](auto x, auto y) {return std::max(x, y);});
-#if HAS_AVX_512 || __AVX2__ || __SSE2__
-        }
-#endif
+        hll::detail::max_bytes(core_.data(), o.core_.data(), core_.size());
         return *this;
     }
     wh119_t operator+(const wh119_t &o) const {
@@ -1602,10 +2200,7 @@ struct wh119_t {
         std::array<uint32_t, 256> counts{0};
         PREC_REQ(is_pow2(core_.size()), "Size must be a power of two");
         PREC_REQ(core_.size() >= sizeof(hll::detail::SIMDHolder), "Must be at least as large as a SIMD vector");
-        const hll::detail::SIMDHolder *ptr = static_cast<const hll::detail::SIMDHolder*>(static_cast<const void *>(core_.data()));
-        for(size_t i = 0; i < core_.size() / sizeof(*ptr); ++i) {
-            (*ptr++).inc_counts(counts);
-        }
+        hll::detail::byte_histogram(core_.data(), core_.size(), counts);
         long double sum = counts[0];
         for(ssize_t i = 1; i < ssize_t(counts.size()); ++i) {
             sum += static_cast<long double>(counts[i]) * (std::pow(wh_base_, -i));
@@ -1634,15 +2229,8 @@ struct wh119_t {
     double union_size(const std::vector<uint8_t, Allocator<uint8_t>> &o) const {
         PREC_REQ(o.size() == size(), "mismatched sizes");
         if(o.size() != size()) throw std::runtime_error("Non-matching parameters for wh119_t");
-        std::array<uint32_t, 256> counts;
-        std::memset(counts.data(), 0, sizeof(counts));
-        size_t i;
-        using space = vec::SIMDTypes<uint64_t>;
-        const space::Type *p1 = static_cast<const space::Type *>(static_cast<const void *>(core_.data())),
-                          *p2 = static_cast<const space::Type *>(static_cast<const void *>(o.data()));
-        for(i = 0; i < core_.size() / sizeof(*p1); ++i) {
-            hll::detail::SIMDHolder(hll::detail::SIMDHolder::max_fn(*p1++, *p2++)).inc_counts(counts);
-        }
+        std::array<uint32_t, 256> counts{0};
+        hll::detail::union_histogram(core_.data(), o.data(), core_.size(), counts);
         long double tmp = counts[0];
         for(ssize_t i = 1; i < ssize_t(counts.size()); ++i)
             tmp += static_cast<long double>(counts[i]) * (std::pow(wh_base_, -i));
@@ -0,0 +1,264 @@
+#ifndef SKETCH_HLL_STORE_H__
+#define SKETCH_HLL_STORE_H__
+#include "hll.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace sketch {
+inline namespace hll {
+
+/*
+ * Flat container for many same-p HyperLogLogs, meant to be mmap'd instead of read.
+ *
+ * Layout (native byte order):
+ *   [0, 64)                       header (hll_store_header_t)
+ *   [64, 64 + n * 2^p)            registers, one contiguous 2^p-byte array per sketch
+ *   [64 + n * 2^p, ... + n * 8)   cardinality estimates, one double per sketch
+ *
+ * Each register array starts on a 64-byte boundary of the file (and therefore of the mapping),
+ * so hll_view objects pointing into it can be handed directly to the SIMD kernels.
+ */
+struct hll_store_header_t {
+    char     magic_[8];
+    uint32_t version_;
+    uint32_t p_;
+    uint64_t n_;
+    uint64_t card_offset_;
+    uint8_t  pad_[32];
+};
+static_assert(sizeof(hll_store_header_t) == 64, "hll_store header must occupy one cache line");
+static constexpr char HLL_STORE_MAGIC[8] {'S', 'K', 'H', 'L', 'L', 'S', 'T', '\0'};
+static constexpr uint32_t HLL_STORE_VERSION = 1;
+
+// Non-owning, read-only HyperLogLog over externally owned registers (e.g., an hll_store mapping).
+// Estimates use ERTL_MLE, the hll_t default.
+class hll_view {
+    const uint8_t *data_;
+    uint32_t         np_;
+    mutable double value_;
+public:
+    struct core_type {
+        const uint8_t *b_, *e_;
+        const uint8_t *begin() const {return b_;}
+        const uint8_t *end()   const {return e_;}
+        const uint8_t *data()  const {return b_;}
+        size_t size()          const {return e_ - b_;}
+        uint8_t operator[](size_t i) const {return b_[i];}
+    };
+    hll_view(const uint8_t *data, unsigned p, double value=-1.): data_(data), np_(p), value_(value) {
+        PREC_REQ(p >= hll_t::min_size(), "p too small for SIMD kernels");
+    }
+    template<typename HS>
+    hll_view(const hllbase_t<HS> &h): hll_view(h.data(), h.p()) {}
+
+    uint32_t p() const {return np_;}
+    uint32_t q() const {return (sizeof(uint64_t) * CHAR_BIT) - np_;}
+    uint64_t m() const {return static_cast<uint64_t>(1) << np_;}
+    size_t size() const {return size_t(m());}
+    const uint8_t *data() const {return data_;}
+    core_type core() const {return core_type{data_, data_ + m()};}
+
+    bool is_calculated() const {return value_ >= 0.;}
+    double creport() const {
+        if(!is_calculated())
+            value_ = detail::calculate_estimate(detail::sum_counts(core()), ERTL_MLE, m(), np_, make_alpha(m()));
+        return value_;
+    }
+    double report() const {return creport();}
+    double cardinality_estimate() const {return creport();}
+
+    double union_size(const hll_view &o) const {
+        PREC_REQ(o.p() == p(), "Must have matching parameters");
+        return detail::calculate_estimate(union_counts(*this, o), ERTL_MLE, m(), np_, make_alpha(m()));
+    }
+    std::array<double, 3> full_set_comparison(const hll_view &o) const {
+        const double us = union_size(o), mys = creport(), os = o.creport(),
+                     is = std::max(mys + os - us, 0.),
+                     my_only = std::max(mys - is, 0.), o_only = std::max(os - is, 0.);
+        return std::array<double, 3>{{my_only, o_only, is}};
+    }
+    double jaccard_index(const hll_view &o) const {
+        const double us = union_size(o);
+        return std::max(0., (creport() + o.creport() - us) / us);
+    }
+    double containment_index(const hll_view &o) const {
+        auto fsr = full_set_comparison(o);
+        return fsr[2] / (fsr[2] + fsr[0]);
+    }
+    bool operator==(const hll_view &o) const {
+        return np_ == o.np_ && (data_ == o.data_ || std::equal(data_, data_ + m(), o.data_));
+    }
+    bool operator!=(const hll_view &o) const {return !this->operator==(o);}
+
+    // Copies registers into an owning sketch.
+    template<typename HS=WangHash>
+    hllbase_t<HS> to_hll() const {
+        hllbase_t<HS> ret(np_);
+        std::memcpy(ret.mutable_core().data(), data_, m());
+        return ret;
+    }
+};
+
+// Streams sketches into the hll_store format.
+// Registers are written as they arrive; estimates and the final count are written on close().
+class hll_store_writer {
+    std::FILE          *fp_;
+    uint32_t             p_;
+    std::vector<double> cards_;
+    std::string       path_;
+public:
+    hll_store_writer(const std::string &path, unsigned p): fp_(std::fopen(path.data(), "wb")), p_(p), path_(path) {
+        PREC_REQ(p >= hll_t::min_size(), "p too small for SIMD kernels");
+        if(fp_ == nullptr) throw std::runtime_error(std::string("Could not open file at '") + path + "' for writing");
+        write_header();
+    }
+    hll_store_writer(const hll_store_writer &) = delete;
+    hll_store_writer &operator=(const hll_store_writer &) = delete;
+    ~hll_store_writer() {
+        if(fp_) {
+            try {close();} catch(const std::exception &ex) {std::fprintf(stderr, "Failed to finalize hll_store at %s: %s\n", path_.data(), ex.what());}
+        }
+    }
+    template<typename HS>
+    void add(const hllbase_t<HS> &h) {
+        PREC_REQ(h.p() == p_, "Must have matching parameters");
+        // Stored with ERTL_MLE, as hll_view recomputes it, whatever estimator h uses.
+        add_registers(h.data(), hll_view(h).creport());
+    }
+    void add(const hll_view &h) {
+        PREC_REQ(h.p() == p_, "Must have matching parameters");
+        add_registers(h.data(), h.creport());
+    }
+    size_t size() const {return cards_.size();}
+    // The stream is closed whether or not finalizing succeeds, so the destructor never writes after a failed close().
+    void close() {
+        std::FILE *fp = fp_;
+        try {
+            checked_write(cards_.data(), cards_.size() * sizeof(double));
+            if(std::fseek(fp_, 0, SEEK_SET)) throw std::runtime_error("Failed to seek to hll_store header");
+            write_header();
+        } catch(...) {
+            fp_ = nullptr;
+            std::fclose(fp);
+            throw;
+        }
+        fp_ = nullptr;
+        if(std::fclose(fp)) throw std::runtime_error(std::string("Failed to close ") + path_);
+    }
+private:
+    void add_registers(const uint8_t *data, double card) {
+        checked_write(data, size_t(1) << p_);
+        cards_.push_back(card);
+    }
+    void checked_write(const void *data, size_t nbytes) {
+        if(nbytes && std::fwrite(data, 1, nbytes, fp_) != nbytes)
+            throw std::runtime_error(std::string("Failed to write to ") + path_);
+    }
+    void write_header() {
+        hll_store_header_t hdr;
+        std::memset(&hdr, 0, sizeof(hdr));
+        std::memcpy(hdr.magic_, HLL_STORE_MAGIC, sizeof(hdr.magic_));
+        hdr.version_ = HLL_STORE_VERSION;
+        hdr.p_ = p_;
+        hdr.n_ = cards_.size();
+        hdr.card_offset_ = sizeof(hdr) + (hdr.n_ << p_);
+        checked_write(&hdr, sizeof(hdr));
+    }
+};
+
+// Read-only mapping of a file written by hll_store_writer.
+// Element access returns hll_view objects pointing into the mapping, so opening is O(1)
+// regardless of the number of sketches, and pages are faulted in as sketches are touched.
+class hll_store {
+    const uint8_t            *map_;
+    size_t                  mapsz_;
+    const hll_store_header_t *hdr_;
+    const double           *cards_;
+public:
+    explicit hll_store(const std::string &path, bool populate=false): map_(nullptr), mapsz_(0) {
+        int fd = ::open(path.data(), O_RDONLY);
+        if(fd < 0) throw std::runtime_error(std::string("Could not open file at '") + path + "' for reading");
+        struct stat st;
+        if(::fstat(fd, &st)) {
+            ::close(fd);
+            throw std::runtime_error(std::string("Could not stat ") + path);
+        }
+        mapsz_ = st.st_size;
+        if(mapsz_ < sizeof(hll_store_header_t)) {
+            ::close(fd);
+            throw std::runtime_error(path + " is too small to be an hll_store");
+        }
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        if(populate) flags |= MAP_POPULATE;
+#endif
+        void *ptr = ::mmap(nullptr, mapsz_, PROT_READ, flags, fd, 0);
+        ::close(fd);
+        if(ptr == MAP_FAILED) throw std::runtime_error(std::string("Failed to mmap ") + path);
+        map_ = static_cast<const uint8_t *>(ptr);
+        hdr_ = reinterpret_cast<const hll_store_header_t *>(map_);
+        try {
+            if(std::memcmp(hdr_->magic_, HLL_STORE_MAGIC, sizeof(HLL_STORE_MAGIC)))
+                throw std::runtime_error(path + " is not an hll_store (bad magic)");
+            if(hdr_->version_ != HLL_STORE_VERSION)
+                throw std::runtime_error(path + ": unsupported hll_store version " + std::to_string(hdr_->version_));
+            // n_ is bounded by the mapping's size before any offset is computed, so no product can wrap.
+            if(hdr_->p_ < hll_t::min_size() || hdr_->p_ > 32
+               || hdr_->n_ > ((mapsz_ - sizeof(hll_store_header_t)) >> hdr_->p_)
+               || hdr_->card_offset_ != sizeof(hll_store_header_t) + (hdr_->n_ << hdr_->p_)
+               || hdr_->card_offset_ > mapsz_
+               || hdr_->n_ > (mapsz_ - hdr_->card_offset_) / sizeof(double))
+                throw std::runtime_error(path + ": truncated or corrupt hll_store");
+        } catch(...) {
+            ::munmap(const_cast<uint8_t *>(map_), mapsz_);
+            throw;
+        }
+        cards_ = reinterpret_cast<const double *>(map_ + hdr_->card_offset_);
+    }
+    hll_store(const hll_store &) = delete;
+    hll_store &operator=(const hll_store &) = delete;
+    hll_store(hll_store &&o) noexcept: map_(o.map_), mapsz_(o.mapsz_), hdr_(o.hdr_), cards_(o.cards_) {
+        o.map_ = nullptr; o.mapsz_ = 0;
+    }
+    hll_store &operator=(hll_store &&o) noexcept {
+        std::swap(map_, o.map_); std::swap(mapsz_, o.mapsz_);
+        std::swap(hdr_, o.hdr_); std::swap(cards_, o.cards_);
+        return *this;
+    }
+    ~hll_store() {
+        if(map_) ::munmap(const_cast<uint8_t *>(map_), mapsz_);
+    }
+
+    size_t size() const {return hdr_->n_;}
+    uint32_t p() const {return hdr_->p_;}
+    uint64_t m() const {return static_cast<uint64_t>(1) << hdr_->p_;}
+    const uint8_t *registers(size_t i) const {return map_ + sizeof(hll_store_header_t) + (i << hdr_->p_);}
+    const double *cardinalities() const {return cards_;}
+    hll_view operator[](size_t i) const {return hll_view(registers(i), p(), cards_[i]);}
+    hll_view at(size_t i) const {
+        if(i >= size()) throw std::out_of_range(std::string("Index ") + std::to_string(i) + " out of range for hll_store of size " + std::to_string(size()));
+        return operator[](i);
+    }
+    // Hint the kernel that a range of sketches will be read soon.
+    void prefetch(size_t first, size_t last) const {
+        PREC_REQ(first <= last && last <= size(), "Prefetch range must lie within the store");
+        static const size_t pgsz = ::sysconf(_SC_PAGESIZE);
+        const uintptr_t start = reinterpret_cast<uintptr_t>(registers(first)) & ~(pgsz - 1);
+        ::madvise(reinterpret_cast<void *>(start), reinterpret_cast<uintptr_t>(registers(last)) - start, MADV_WILLNEED);
+    }
+
+    template<typename It>
+    static void write(const std::string &path, It first, It last) {
+        if(first == last) throw std::invalid_argument("Cannot infer p for an empty hll_store");
+        hll_store_writer writer(path, first->p());
+        while(first != last) writer.add(*first++);
+        writer.close();
+    }
+    template<typename Container>
+    static void write(const std::string &path, const Container &con) {write(path, std::begin(con), std::end(con));}
+};
+
+} // inline namespace hll
+} // namespace sketch
+
+#endif /* SKETCH_HLL_STORE_H__ */
@@ -216,7 +216,7 @@ public:
 #endif
             maxv.for_each(func);
         }
-        for(const IT *w = (const IT *)d, *e = (const IT *)&data_[data_.size()]; w < e; func(*w++));
+        for(const IT *w = (const IT *)d, *ow = (const IT *)od, *e = (const IT *)&data_[data_.size()]; w < e; func(std::max(*w++, *ow++)));
     }
     template<typename Func>
     void for_each_union_register(const hmh_t &o, const Func &func) const {
@@ -284,8 +284,10 @@ public:
     }
 #define _mm512_srli_epi16(mm, Imm) _mm512_and_si512(_mm512_set1_epi16(0xFFFFu >> Imm), _mm512_srli_epi32(mm, Imm))
 #define _mm512_srli_epi8(mm, Imm) _mm512_and_si512(_mm512_set1_epi8(0xFFu >> Imm), _mm512_srli_epi32(mm, Imm))
+    // Histogram of leading-zero counts, decoded from packed registers a vector at a time.
+    // If o is provided, this is the histogram of the union (elementwise max) of the two sketches.
     template<typename IT>
-    std::array<uint32_t, 64> sum_counts() const {
+    std::array<uint32_t, 64> __sum_counts(const hmh_t *o=nullptr) const {
         using hll::detail::SIMDHolder;
         using Space = vec::SIMDTypes<IT>;
         std::array<uint32_t, 64> ret{0};
@@ -322,16 +324,24 @@ public:
             };
             auto ptr = reinterpret_cast<const SIMDHolder *>(data_.data());
             auto eptr = reinterpret_cast<const SIMDHolder *>(&data_[data_.size()]);
-            while(eptr - ptr > 8) {
-                update_point(ptr[0]); update_point(ptr[1]); update_point(ptr[2]); update_point(ptr[3]);
-                update_point(ptr[4]); update_point(ptr[5]); update_point(ptr[6]); update_point(ptr[7]);
-                ptr += 8;
+            if(o) {
+                auto optr = reinterpret_cast<const SIMDHolder *>(o->data_.data());
+                SK_UNROLL_8
+                while(ptr < eptr) update_point(SIMDHolder(Space::max(*ptr++, *optr++)));
+            } else {
+                while(eptr - ptr > 8) {
+                    update_point(ptr[0]); update_point(ptr[1]); update_point(ptr[2]); update_point(ptr[3]);
+                    update_point(ptr[4]); update_point(ptr[5]); update_point(ptr[6]); update_point(ptr[7]);
+                    ptr += 8;
+                }
+                while(ptr < eptr) update_point(*ptr++);
             }
-            while(ptr < eptr) update_point(*ptr++);
-        } else for_each_register([&](auto x) {++ret[reg2lzc(x, r_)];});
+        } else if(o) for_each_union_register(*o, [&](auto x) {++ret[reg2lzc(x, r_)];});
+        else for_each_register([&](auto x) {++ret[reg2lzc(x, r_)];});
 #if !NDEBUG
         std::array<uint32_t, 64> cmp{0};
-        for_each_register([&](auto x) {++cmp[reg2lzc(x, r_)];});
+        if(o) for_each_union_register(*o, [&](auto x) {++cmp[reg2lzc(x, r_)];});
+        else for_each_register([&](auto x) {++cmp[reg2lzc(x, r_)];});
         assert(std::equal(ret.begin(), ret.end(), cmp.begin()));
 #endif
         assert(std::accumulate(ret.begin(), ret.end(), size_t(0)) == (1ull << p_));
@@ -352,15 +362,20 @@ public:
         while(reg > r) __sync_bool_compare_and_swap(&r, r, reg);
 #endif
     }
-    double estimate_hll_portion() const {
-        double ret;
+    std::array<uint32_t, 64> sum_counts(const hmh_t *o=nullptr) const {
         switch(lrszm3_) {
 #undef CASE_U
-#define CASE_U(type, index, __UNUSED) case index: ret = hll::detail::ertl_ml_estimate(this->sum_counts<type>(), p_, 64 - p_); break
+#define CASE_U(type, index, __UNUSED) case index: return this->__sum_counts<type>(o)
             SHOW_CASES(CASE_U)
             default: HEDLEY_UNREACHABLE();
         }
-        return std::max(ret, 0.);
+    }
+    std::array<uint32_t, 64> union_sum_counts(const hmh_t &o) const {
+        PREC_REQ(o.p_ == this->p_ && o.r_ == this->r_, "Must have matching parameters");
+        return sum_counts(&o);
+    }
+    double estimate_hll_portion(const hmh_t *o=nullptr) const {
+        return std::max(hll::detail::ertl_ml_estimate(sum_counts(o), p_, 64 - p_), 0.);
     }
     double cardinality_estimate() const {
         double ret = estimate_mh_portion();
@@ -372,68 +387,117 @@ public:
         //std::fprintf(stderr, "mhsum: %g. p: %d, ret: %g\n", ret, p, std::ldexp(1. / ret, 2 * p));
         return std::ldexp(1. / ret, 2 * p);
     }
-    template<size_t N, typename IT, typename OIT>
-    static void __lzrem_func(IT lzc, OIT rem, double &ret) {
-        static constexpr double mri = 1. / ((uint64_t(1) << N) - 1);
-        static constexpr double mrx2 = 2. * ((uint64_t(1) << N) - 1);
-        ret += std::ldexp((mrx2 - rem) * mri,
-                           -static_cast<std::make_signed_t<IT>>(lzc));
-        // TODO: Better manual intrinsics
-    }
     double estimate_mh_portion() const {
+        return mhsum2ret(mh_sum(nullptr), p_);
+    }
+    // Sum over registers of (1 + (maxrem - rem) / maxrem) * 2^-lzc,
+    // computed as (2 * maxrem - rem) / maxrem * 2^-lzc, which saves one operation per register.
+    // If o is provided, each register is first max-merged with o's.
+    double mh_sum(const hmh_t *o) const {
+        switch(lrszm3_) {
+#undef CASE_U
+#define CASE_U(type, index, __UNUSED) case index: return __mh_sum<type>(o)
+            SHOW_CASES(CASE_U)
+            default: HEDLEY_UNREACHABLE();
+        }
+    }
+    template<typename IT>
+    double __mh_sum(const hmh_t *o) const {
+        const IT *lhp = reinterpret_cast<const IT *>(data_.data()),
+                 *rhp = o ? reinterpret_cast<const IT *>(o->data_.data()): static_cast<const IT *>(nullptr);
+        const size_t n = num_registers();
+        const double mrx2 = 2. * max_remainder(), mri = 1. / max_remainder();
         double ret = 0.;
-        for_each_lzrem([&ret,r=this->r_](auto lzc, auto rem) {
-            if(r == 2) __lzrem_func<2>(lzc, rem, ret);
-            else if(r == 10) __lzrem_func<10>(lzc, rem, ret);
-            else if(r == 26) __lzrem_func<26>(lzc, rem, ret);
-            else __lzrem_func<56>(lzc, rem, ret);
-            //ret += (1. + (maxrem - rem) * mri) * INVPOWERSOFTWO[lzc];
-            // We substitute     (2 * maxrem - rem) * mri
-            // for               (1 + (mr - rem) * mri)
-            // which saves one operation per iteration
-        });
-        return mhsum2ret(ret, p_);
+        size_t i = 0;
+        // Registers are widened to 64-bit lanes, split into lzc and remainder with a shift and a mask,
+        // and 2^-lzc is built directly in the exponent field of a double.
+#if __AVX512F__ && __AVX512DQ__
+        {
+            const __m512i rbm = _mm512_set1_epi64(rbm_), bias = _mm512_set1_epi64(1023);
+            const __m128i shift = _mm_cvtsi32_si128(r_);
+            const __m512d mrx2v = _mm512_set1_pd(mrx2);
+            __m512d acc = _mm512_setzero_pd();
+            for(; i + 8 <= n; i += 8) {
+                __m512i v;
+                CONST_IF(sizeof(IT) == 1) {
+                    __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(lhp + i));
+                    if(rhp) x = _mm_max_epu8(x, _mm_loadl_epi64(reinterpret_cast<const __m128i *>(rhp + i)));
+                    v = _mm512_maskz_cvtepu8_epi64(0xFF, x);
+                } else CONST_IF(sizeof(IT) == 2) {
+                    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lhp + i));
+                    if(rhp) x = _mm_max_epu16(x, _mm_loadu_si128(reinterpret_cast<const __m128i *>(rhp + i)));
+                    v = _mm512_maskz_cvtepu16_epi64(0xFF, x);
+                } else CONST_IF(sizeof(IT) == 4) {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lhp + i));
+                    if(rhp) x = _mm256_max_epu32(x, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhp + i)));
+                    v = _mm512_maskz_cvtepu32_epi64(0xFF, x);
+                } else {
+                    v = _mm512_loadu_si512(lhp + i);
+                    if(rhp) v = _mm512_maskz_max_epu64(0xFF, v, _mm512_loadu_si512(rhp + i));
+                }
+                const __m512d scale = _mm512_castsi512_pd(_mm512_maskz_slli_epi64(0xFF, _mm512_sub_epi64(bias, _mm512_maskz_srl_epi64(0xFF, v, shift)), 52));
+                const __m512d rem = _mm512_cvtepu64_pd(_mm512_and_si512(v, rbm));
+                acc = _mm512_add_pd(acc, _mm512_mul_pd(_mm512_sub_pd(mrx2v, rem), scale));
+            }
+            // _mm512_reduce_add_pd's order of additions, with zero-masked extracts so GCC does not flag it under -Wmaybe-uninitialized.
+            const __m256d h = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, acc, 0), _mm512_maskz_extractf64x4_pd(0xF, acc, 1));
+            const __m128d q = _mm_add_pd(_mm256_castpd256_pd128(h), _mm256_extractf128_pd(h, 1));
+            ret = _mm_cvtsd_f64(_mm_add_sd(q, _mm_unpackhi_pd(q, q)));
+        }
+#elif __AVX2__
+        // Without AVX512DQ there is no u64->double conversion, but remainders of
+        // registers narrower than 64 bits fit in the 52-bit mantissa.
+        CONST_IF(sizeof(IT) < 8) {
+            const __m256i rbm = _mm256_set1_epi64x(rbm_), bias = _mm256_set1_epi64x(1023),
+                          magic = _mm256_set1_epi64x(0x4330000000000000LL);
+            const __m128i shift = _mm_cvtsi32_si128(r_);
+            const __m256d mrx2v = _mm256_set1_pd(mrx2), magicd = _mm256_set1_pd(4503599627370496.);
+            __m256d acc = _mm256_setzero_pd();
+            for(; i + 4 <= n; i += 4) {
+                __m256i v;
+                CONST_IF(sizeof(IT) == 1) {
+                    int32_t lw, rw;
+                    std::memcpy(&lw, lhp + i, sizeof(lw));
+                    __m128i x = _mm_cvtsi32_si128(lw);
+                    if(rhp) std::memcpy(&rw, rhp + i, sizeof(rw)), x = _mm_max_epu8(x, _mm_cvtsi32_si128(rw));
+                    v = _mm256_cvtepu8_epi64(x);
+                } else CONST_IF(sizeof(IT) == 2) {
+                    __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(lhp + i));
+                    if(rhp) x = _mm_max_epu16(x, _mm_loadl_epi64(reinterpret_cast<const __m128i *>(rhp + i)));
+                    v = _mm256_cvtepu16_epi64(x);
+                } else {
+                    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lhp + i));
+                    if(rhp) x = _mm_max_epu32(x, _mm_loadu_si128(reinterpret_cast<const __m128i *>(rhp + i)));
+                    v = _mm256_cvtepu32_epi64(x);
+                }
+                const __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_sub_epi64(bias, _mm256_srl_epi64(v, shift)), 52));
+                const __m256d rem = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(v, rbm), magic)), magicd);
+                acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_sub_pd(mrx2v, rem), scale));
+            }
+            double tmp[4];
+            _mm256_storeu_pd(tmp, acc);
+            ret = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+        }
+#endif
+        for(; i < n; ++i) {
+            const IT x = rhp ? std::max(lhp[i], rhp[i]): lhp[i];
+            ret += std::ldexp(mrx2 - double(reg2rem(x, rbm_)), -static_cast<int>(reg2lzc(x, r_)));
+        }
+        return ret * mri;
     }
     double card_ji(const hmh_t &o) const {
         double mv = this->cardinality_estimate(), ov = o.cardinality_estimate();
         double us = union_size(o);
         return std::max(0., mv + ov - us); // Inclusion-exclusion principle
     }
+    // Cardinality of the union, without materializing it.
+    // As in cardinality_estimate, falls back to the HLL estimate for small cardinalities.
     double union_size(const hmh_t &o) const {
-        double ret = 0.;
-#if 0
-        if(data_.size() < sizeof(vec::SIMDTypes<uint64_t>::Type)) {
-#endif
-            for_each_union_lzrem(o, [&](auto lzc, auto rem) {
-                switch(r_) {
-                    case 2: __lzrem_func<2>(lzc, rem, ret); break;
-                    case 10: __lzrem_func<10>(lzc, rem, ret); break;
-                    case 26: __lzrem_func<26>(lzc, rem, ret); break;
-                    case 58: __lzrem_func<58>(lzc, rem, ret); break;
-                    default: __builtin_unreachable(); break;
-                }
-            });
-#if 0
-        } else {
-            auto maxremi = max_remainder();
-            double maxrem = maxremi, mri = 1. / (maxrem), mrx2 = 2. * maxrem;
-            switch(lrszm3_) {
-#undef CASE_U
-#define CASE_U(type, i, rshift) case i: \
-            __for_each_union_vector<type>(o, [&](auto v) { \
-                using Space = vec::SIMDTypes<type>;\
-                using VType = Space::VType;\
-                auto lzcs = VType(Space::srli(v, rshift));\
-                auto rems = Space::and_fn(v, Space::set1(maxremi));\
-                for(unsigned j = 0; j < sizeof(VType) / sizeof(type); ++j) \
-                    ret += mrx2 - double(((const type *)&rems)[j]) * mri * INVPOWERSOFTWO[((const type *)&lzcs)[j]];\
-            }); break
-            SHOW_CASES(CASE_U)
-                default: HEDLEY_UNREACHABLE();
-            }
-        }
-#endif
-        return mhsum2ret(ret, p_);
+        PREC_REQ(o.p_ == this->p_ && o.r_ == this->r_, "Must have matching parameters");
+        double ret = mhsum2ret(mh_sum(&o), p_);
+        if(ret < (1024 << p_))
+            ret = estimate_hll_portion(&o);
+        return ret;
     }
     double approx_ec(double n, double m, int laziness=1) const {
         if(n < m) std::swap(n, m);
@@ -536,8 +600,9 @@ public:
         }
 #if __AVX512BW__ || __AVX2__ || __SSE2__
         else {
-#if __AVX512BW__ // TODO: replace this with a (potentially separate) check per type
-            using Type = typename vec::SIMDTypes<IT>::Type;
+#if __AVX512BW__
+            using Space = vec::SIMDTypes<IT>;
+            using Type = typename Space::Type;
             const Type *lhp = (const Type *)data_.data(), *lhe = (const Type *)&data_[data_.size()],
                        *rhp = (const Type *)o.data_.data();
             const Type zero = Space::set1(0);
@@ -0,0 +1,75 @@
+#ifndef SKETCH_ISA_H__
+#define SKETCH_ISA_H__
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Runtime instruction set detection.
+ * Kernels compiled for several instruction sets with per-function target attributes
+ * pick one with runtime_isa(), so that one binary runs on any x86-64 machine.
+ * Setting the environment variable SKETCH_ISA to scalar, sse2, avx2 or avx512
+ * caps the level used, e.g., to test or time the lower-level paths.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#  define SKETCH_ISA_DISPATCH 1
+#  include <immintrin.h>
+#  define SKETCH_TARGET_AVX2   __attribute__((target("avx2,bmi,bmi2,popcnt"), flatten))
+#  define SKETCH_TARGET_AVX512 __attribute__((target("avx512f,avx512dq,avx512bw,avx512vl,avx2,bmi,bmi2,popcnt"), flatten))
+#else
+#  define SKETCH_ISA_DISPATCH 0
+#endif
+
+namespace sketch {
+
+enum class isa_t: int {
+    SCALAR = 0,
+    SSE2   = 1,
+    AVX2   = 2,
+    AVX512 = 3 // F, DQ, BW and VL
+};
+
+inline const char *isa_name(isa_t isa) noexcept {
+    switch(isa) {
+        case isa_t::AVX512: return "avx512";
+        case isa_t::AVX2:   return "avx2";
+        case isa_t::SSE2:   return "sse2";
+        default:            return "scalar";
+    }
+}
+
+// Highest level supported by this CPU (and operating system).
+inline isa_t detect_isa() noexcept {
+#if SKETCH_ISA_DISPATCH
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")
+       && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl"))
+        return isa_t::AVX512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("popcnt"))
+        return isa_t::AVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return isa_t::SSE2;
+#endif
+    return isa_t::SCALAR;
+}
+
+// Level used by dispatching kernels: detect_isa(), capped by SKETCH_ISA. Computed once.
+inline isa_t runtime_isa() noexcept {
+    static const isa_t ret = []() {
+        isa_t isa = detect_isa();
+        if(const char *s = std::getenv("SKETCH_ISA")) {
+            for(const isa_t cap: {isa_t::SCALAR, isa_t::SSE2, isa_t::AVX2, isa_t::AVX512}) {
+                if(std::strcmp(s, isa_name(cap)) == 0) {
+                    if(cap < isa) isa = cap;
+                    break;
+                }
+            }
+        }
+        return isa;
+    }();
+    return ret;
+}
+
+} // namespace sketch
+
+#endif // SKETCH_ISA_H__
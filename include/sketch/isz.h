@@ -1,16 +1,234 @@
 #ifndef ISZ_H__
 #define ISZ_H__
+#include <algorithm>
+#include <cassert>
 #include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include "sketch/isa.h"
 
 namespace sketch {
 namespace isz {
-template<typename Container, typename Cmp=std::less<>>
-std::uint64_t intersection_size(const Container &c1, const Container &c2, const Cmp &cmp=Cmp()) {
-    // These containers must be sorted.
-    //static_assert(std::is_same<decltype(*std::begin(c1)), decltype(*std::begin(c2))>::value, "Containers must derefernce to the same type.");
-    //for(const auto v: c1) std::fprintf(stderr, "element is %zu\n", size_t(v));
-    assert(std::is_sorted(c2.begin(), c2.end(), cmp));
-    assert(std::is_sorted(c1.begin(), c1.end(), cmp));
+
+/*
+ * Intersection kernels for sorted arrays of 32- or 64-bit integers, as in bottom-k sketches.
+ * Both arrays must be strictly increasing, except for a final run of equal elements (the padding of unfilled sketches),
+ * which is matched pairwise, as a merge would.
+ *
+ * Blocks of W elements from each array are compared all-against-all, one broadcast element of one block at a time,
+ * then the block with the smaller last element (or both) advances. When one array is much longer than the other,
+ * count_common instead gallops through the longer one.
+ */
+namespace detail {
+
+// Merge position: every element before ia and ib has been consumed, matches are the common elements among them,
+// and nothing after is smaller than anything before, so ia + ib - matches elements of the union have been consumed.
+struct merge_pos_t {
+    size_t ia, ib;
+    uint64_t matches;
+};
+
+static constexpr size_t GALLOP_RATIO = 32;
+
+// Scalar merge from pos, stopping at the end of either array or after limit union elements in all.
+template<typename T>
+inline merge_pos_t merge_tail(const T *a, size_t na, const T *b, size_t nb, merge_pos_t pos, size_t limit) {
+    size_t ia = pos.ia, ib = pos.ib, used = pos.ia + pos.ib - pos.matches;
+    uint64_t m = pos.matches;
+    if(used <= limit && limit - used >= na + nb - ia - ib) { // The limit cannot be reached
+        while(ia < na && ib < nb) {
+            if(a[ia] == b[ib]) ++m, ++ia, ++ib;
+            else if(a[ia] < b[ib]) ++ia;
+            else ++ib;
+        }
+        return merge_pos_t{ia, ib, m};
+    }
+    for(; ia < na && ib < nb && used < limit; ++used) {
+        // Branches beat a branchless update here, whose loads would depend on the previous step's comparison.
+        if(a[ia] == b[ib]) ++m, ++ia, ++ib;
+        else if(a[ia] < b[ib]) ++ia;
+        else ++ib;
+    }
+    return merge_pos_t{ia, ib, m};
+}
+
+// Common elements of sorted s and much longer l, by exponential then binary search from the last match.
+template<typename T>
+inline uint64_t gallop_count(const T *s, size_t ns, const T *l, size_t nl) {
+    uint64_t ret = 0;
+    size_t j = 0;
+    for(size_t i = 0; i < ns && j < nl; ++i) {
+        const T x = s[i];
+        if(l[j] < x) {
+            size_t lo = j, step = 1;
+            while(lo + step < nl && l[lo + step] < x) lo += step, step <<= 1;
+            j = std::lower_bound(l + lo + 1, l + std::min(lo + step + 1, nl), x) - l;
+        }
+        if(j < nl && l[j] == x) ++ret, ++j;
+    }
+    return ret;
+}
+
+// Block kernels return the number of elements of a[0:W] found in b[0:W].
+template<typename T> struct block_avx2;
+template<typename T> struct block_avx512;
+#if SKETCH_ISA_DISPATCH
+template<> struct block_avx2<uint64_t> {
+    static constexpr size_t W = 4;
+    SKETCH_TARGET_AVX2 static unsigned count(const uint64_t *a, const uint64_t *b) {
+        const __m256i va = _mm256_loadu_si256((const __m256i *)a);
+        __m256i eq = _mm256_cmpeq_epi64(va, _mm256_set1_epi64x(b[0]));
+        for(unsigned r = 1; r < W; ++r) eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va, _mm256_set1_epi64x(b[r])));
+        return __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(eq)));
+    }
+};
+template<> struct block_avx2<uint32_t> {
+    static constexpr size_t W = 8;
+    SKETCH_TARGET_AVX2 static unsigned count(const uint32_t *a, const uint32_t *b) {
+        const __m256i va = _mm256_loadu_si256((const __m256i *)a);
+        __m256i eq = _mm256_cmpeq_epi32(va, _mm256_set1_epi32(b[0]));
+        for(unsigned r = 1; r < W; ++r) eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(va, _mm256_set1_epi32(b[r])));
+        return __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+    }
+};
+template<> struct block_avx512<uint64_t> {
+    static constexpr size_t W = 8;
+    SKETCH_TARGET_AVX512 static unsigned count(const uint64_t *a, const uint64_t *b) {
+        const __m512i va = _mm512_loadu_si512((const void *)a);
+        __mmask8 eq = 0;
+        for(unsigned r = 0; r < W; ++r) eq |= _mm512_cmpeq_epi64_mask(va, _mm512_set1_epi64(b[r]));
+        return __builtin_popcount(eq);
+    }
+};
+template<> struct block_avx512<uint32_t> {
+    static constexpr size_t W = 16;
+    SKETCH_TARGET_AVX512 static unsigned count(const uint32_t *a, const uint32_t *b) {
+        const __m512i va = _mm512_loadu_si512((const void *)a);
+        __mmask16 eq = 0;
+        for(unsigned r = 0; r < W; ++r) eq |= _mm512_cmpeq_epi32_mask(va, _mm512_set1_epi32(b[r]));
+        return __builtin_popcount(eq);
+    }
+};
+
+// Block merge over strictly increasing a and b while whole blocks remain and the matches they could hold
+// are among the first limit union elements. Returns a merge position for merge_tail to continue from.
+template<typename Ops, typename T>
+inline merge_pos_t block_merge(const T *a, size_t na, const T *b, size_t nb, size_t limit) {
+    constexpr size_t W = Ops::W;
+    size_t ia = 0, ib = 0;
+    uint64_t m = 0;
+    // A match in the current blocks has fewer than ia + W - 1 + ib + W - 1 - m union elements before it.
+    while(ia + W <= na && ib + W <= nb && ia + ib + 2 * W - 2 - m < limit) {
+        const T al = a[ia + W - 1], bl = b[ib + W - 1];
+        m += Ops::count(a + ia, b + ib);
+        ia += W * (al <= bl);
+        ib += W * (bl <= al);
+    }
+    // The block left behind may hold elements below the other array's position, which have been consumed.
+    if(ia) while(ib < nb && b[ib] <= a[ia - 1]) ++ib;
+    if(ib) while(ia < na && a[ia] <= b[ib - 1]) ++ia;
+    return merge_pos_t{ia, ib, m};
+}
+SKETCH_TARGET_AVX2 inline merge_pos_t block_merge_avx2(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, size_t limit) {
+    return block_merge<block_avx2<uint64_t>>(a, na, b, nb, limit);
+}
+SKETCH_TARGET_AVX2 inline merge_pos_t block_merge_avx2(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, size_t limit) {
+    return block_merge<block_avx2<uint32_t>>(a, na, b, nb, limit);
+}
+SKETCH_TARGET_AVX512 inline merge_pos_t block_merge_avx512(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, size_t limit) {
+    return block_merge<block_avx512<uint64_t>>(a, na, b, nb, limit);
+}
+SKETCH_TARGET_AVX512 inline merge_pos_t block_merge_avx512(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, size_t limit) {
+    return block_merge<block_avx512<uint32_t>>(a, na, b, nb, limit);
+}
+#endif /* SKETCH_ISA_DISPATCH */
+
+template<typename T>
+using block_type = std::conditional_t<sizeof(T) == 8, uint64_t, uint32_t>;
+template<typename T>
+struct has_block_kernel: std::integral_constant<bool, SKETCH_ISA_DISPATCH && std::is_unsigned<T>::value && (sizeof(T) == 4 || sizeof(T) == 8)> {};
+
+template<typename T>
+inline merge_pos_t block_merge_isa(const T *a, size_t na, const T *b, size_t nb, size_t limit, isa_t isa, std::true_type) {
+#if SKETCH_ISA_DISPATCH
+    using U = block_type<T>;
+    const U *ua = reinterpret_cast<const U *>(a), *ub = reinterpret_cast<const U *>(b);
+    if(isa >= isa_t::AVX512) return block_merge_avx512(ua, na, ub, nb, limit);
+    if(isa >= isa_t::AVX2) return block_merge_avx2(ua, na, ub, nb, limit);
+#endif
+    return merge_pos_t{0, 0, 0};
+}
+template<typename T>
+inline merge_pos_t block_merge_isa(const T *, size_t, const T *, size_t, size_t, isa_t, std::false_type) {
+    return merge_pos_t{0, 0, 0};
+}
+
+// Length of a without its final run of equal elements.
+template<typename T>
+inline size_t strict_prefix(const T *a, size_t n) {
+    if(!n) return 0;
+    size_t ret = n;
+    while(ret && a[ret - 1] == a[n - 1]) --ret;
+    assert(std::adjacent_find(a, a + ret, std::greater_equal<T>()) == a + ret);
+    return ret;
+}
+
+template<typename T>
+inline merge_pos_t merge_count_isa(const T *a, size_t na, const T *b, size_t nb, size_t limit, isa_t isa) {
+    const size_t sa = strict_prefix(a, na), sb = strict_prefix(b, nb);
+    const merge_pos_t pos = block_merge_isa(a, sa, b, sb, limit, isa, has_block_kernel<T>());
+    return merge_tail(a, na, b, nb, pos, limit);
+}
+
+} // namespace detail
+
+// Number of common elements of sorted arrays a and b.
+template<typename T>
+inline uint64_t count_common_isa(const T *a, size_t na, const T *b, size_t nb, isa_t isa) {
+    if(na > nb) std::swap(a, b), std::swap(na, nb);
+    if(!na) return 0;
+    if(nb / na >= detail::GALLOP_RATIO) return detail::gallop_count(a, na, b, nb);
+    return detail::merge_count_isa(a, na, b, nb, std::numeric_limits<size_t>::max(), isa).matches;
+}
+template<typename T>
+inline uint64_t count_common(const T *a, size_t na, const T *b, size_t nb) {
+    return count_common_isa(a, na, b, nb, runtime_isa());
+}
+
+// Number of common elements of sorted arrays a and b among the first n elements of their union,
+// the numerator of the bottom-n Jaccard estimate.
+template<typename T>
+inline uint64_t count_common_prefix_isa(const T *a, size_t na, const T *b, size_t nb, size_t n, isa_t isa) {
+    return detail::merge_count_isa(a, na, b, nb, n, isa).matches;
+}
+template<typename T>
+inline uint64_t count_common_prefix(const T *a, size_t na, const T *b, size_t nb, size_t n) {
+    return count_common_prefix_isa(a, na, b, nb, n, runtime_isa());
+}
+
+namespace detail {
+template<typename C, typename=void>
+struct has_data: std::false_type {};
+template<typename C>
+struct has_data<C, std::enable_if_t<std::is_pointer<decltype(std::declval<const C &>().data())>::value>>: std::true_type {};
+
+// Contiguous integer containers in ascending order go to count_common.
+template<typename Container, typename Cmp, bool=has_data<Container>::value>
+struct use_count_common: std::false_type {};
+template<typename Container, typename Cmp>
+struct use_count_common<Container, Cmp, true> {
+    using value_type = std::decay_t<decltype(*std::declval<const Container &>().data())>;
+    static constexpr bool value = has_block_kernel<value_type>::value
+        && (std::is_same<Cmp, std::less<>>::value || std::is_same<Cmp, std::less<value_type>>::value);
+};
+
+template<typename Container, typename Cmp>
+std::uint64_t intersection_size(const Container &c1, const Container &c2, const Cmp &, std::true_type) {
+    return count_common(c1.data(), c1.size(), c2.data(), c2.size());
+}
+template<typename Container, typename Cmp>
+std::uint64_t intersection_size(const Container &c1, const Container &c2, const Cmp &cmp, std::false_type) {
     auto it1 = std::begin(c1);
     auto it2 = std::begin(c2);
     const auto e1 = std::cend(c1);
@@ -29,6 +247,17 @@ std::uint64_t intersection_size(const Container &c1, const Container &c2, const
     }
     return ret;
 }
+} // namespace detail
+
+template<typename Container, typename Cmp=std::less<>>
+std::uint64_t intersection_size(const Container &c1, const Container &c2, const Cmp &cmp=Cmp()) {
+    // These containers must be sorted.
+    //static_assert(std::is_same<decltype(*std::begin(c1)), decltype(*std::begin(c2))>::value, "Containers must derefernce to the same type.");
+    //for(const auto v: c1) std::fprintf(stderr, "element is %zu\n", size_t(v));
+    assert(std::is_sorted(c2.begin(), c2.end(), cmp));
+    assert(std::is_sorted(c1.begin(), c1.end(), cmp));
+    return detail::intersection_size(c1, c2, cmp, std::integral_constant<bool, detail::use_count_common<Container, Cmp>::value>());
+}
 } // common
 } // sketch
 
@@ -0,0 +1,153 @@
+#ifndef SKETCH_KNN_H__
+#define SKETCH_KNN_H__
+#include "pairwise.h"
+#include "heap.h"
+
+namespace sketch {
+inline namespace knn {
+
+namespace detail {
+using pairwise::detail::prio;
+using pairwise::detail::prepare;
+
+template<typename S>
+auto cardinality(const S &s, prio<1>) -> decltype(double(s.cardinality_estimate())) {return s.cardinality_estimate();}
+template<typename S>
+auto cardinality(const S &s, prio<0>) -> decltype(double(s.report())) {return s.report();}
+
+template<typename M>
+auto upper_bound(const M &m, double x, double y, prio<1>) -> decltype(double(m.upper_bound(x, y))) {return m.upper_bound(x, y);}
+template<typename M>
+double upper_bound(const M &, double, double, prio<0>) {return std::numeric_limits<double>::max();}
+
+struct neighbor_cmp {
+    // Better neighbors compare greater, so std heap functions keep the worst retained neighbor on top.
+    bool operator()(const std::pair<size_t, double> &x, const std::pair<size_t, double> &y) const {
+        return x.second > y.second || (x.second == y.second && x.first < y.first);
+    }
+};
+struct neighbor_hash {
+    uint64_t operator()(const std::pair<size_t, double> &x) const {return x.first;}
+};
+} // namespace detail
+
+struct knn_stats {
+    size_t compared = 0; // full register comparisons performed
+    size_t pruned   = 0; // candidates skipped by the cardinality bound
+};
+
+/*
+ * k-nearest-neighbor search over a fixed collection of sketches.
+ *
+ * References are sorted by estimated cardinality once. A query visits them outward from its own
+ * cardinality, in decreasing order of the metric's cardinality-only upper bound (e.g., min/max for Jaccard),
+ * and stops as soon as that bound drops below the worst of the k retained neighbors.
+ * Because cardinalities are themselves estimates, bounds are inflated by (1 + slack) before comparing.
+ * Metrics without upper_bound are searched exhaustively.
+ */
+template<typename Sketch, typename Metric=jaccard_metric>
+class knn_index {
+public:
+    using neighbor_type = std::pair<size_t, double>; // (index into the collection, similarity)
+private:
+    std::vector<const Sketch *> ptrs_;
+    std::vector<double>        cards_; // ascending
+    std::vector<size_t>          ids_; // ids_[i] is the collection index with cardinality cards_[i]
+    Metric                    metric_;
+    double                     slack_;
+public:
+    knn_index(std::vector<const Sketch *> ptrs, Metric metric=Metric(), double slack=.1):
+        ptrs_(std::move(ptrs)), cards_(ptrs_.size()), ids_(ptrs_.size()), metric_(std::move(metric)), slack_(slack)
+    {
+        std::vector<std::pair<double, size_t>> tmp(ptrs_.size());
+        for(size_t i = 0; i < ptrs_.size(); ++i) {
+            detail::prepare(*ptrs_[i], detail::prio<1>());
+            tmp[i] = {detail::cardinality(*ptrs_[i], detail::prio<1>()), i};
+        }
+        std::sort(tmp.begin(), tmp.end());
+        for(size_t i = 0; i < tmp.size(); ++i)
+            std::tie(cards_[i], ids_[i]) = tmp[i];
+    }
+    template<typename Alloc>
+    knn_index(const std::vector<Sketch, Alloc> &sketches, Metric metric=Metric(), double slack=.1):
+        knn_index(to_ptrs(sketches), std::move(metric), slack) {}
+
+    size_t size() const {return ptrs_.size();}
+    double slack() const {return slack_;}
+    void set_slack(double slack) {slack_ = slack;}
+
+    // Returns up to k neighbors, most similar first.
+    std::vector<neighbor_type> query(const Sketch &q, size_t k, knn_stats *stats=nullptr) const {
+        std::vector<neighbor_type> ret;
+        if(!k || ptrs_.empty()) return ret;
+        detail::prepare(q, detail::prio<1>());
+        const double qc = detail::cardinality(q, detail::prio<1>()), inflate = 1. + slack_;
+        heap::ObjHeap<neighbor_type, detail::neighbor_cmp, detail::neighbor_hash> heap(std::min(k, size()));
+        size_t hi = std::lower_bound(cards_.begin(), cards_.end(), qc) - cards_.begin(), lo = hi;
+        const size_t n = size();
+        size_t compared = 0;
+        while(lo > 0 || hi < n) {
+            const double lb = lo > 0 ? detail::upper_bound(metric_, qc, cards_[lo - 1], detail::prio<1>()): -1.,
+                         hb = hi < n ? detail::upper_bound(metric_, qc, cards_[hi], detail::prio<1>()): -1.;
+            // Bounds decrease monotonically away from qc, so once the better side fails, everything left does.
+            if(heap.size() == heap.max_size() && std::max(lb, hb) * inflate < heap.top().second)
+                break;
+            const size_t id = lb >= hb ? ids_[--lo]: ids_[hi++];
+            ++compared;
+            neighbor_type cand(id, metric_(q, *ptrs_[id]));
+            if(heap.size() < heap.max_size() || heap.check(cand))
+                heap.addh(std::move(cand));
+        }
+        if(stats) stats->compared += compared, stats->pruned += n - compared;
+        ret = heap.template to_container<std::vector<neighbor_type>>();
+        std::sort(ret.begin(), ret.end(), detail::neighbor_cmp());
+        return ret;
+    }
+    // Answers nq queries, in parallel when built with OpenMP.
+    std::vector<std::vector<neighbor_type>> query_batch(const Sketch *queries, size_t nq, size_t k, int nthreads=1, knn_stats *stats=nullptr) const {
+        std::vector<std::vector<neighbor_type>> ret(nq);
+        std::vector<knn_stats> qstats(stats ? nq: size_t(0));
+        for(size_t i = 0; i < nq; ++i) detail::prepare(queries[i], detail::prio<1>());
+        (void)nthreads;
+        OMP_PRAGMA("omp parallel for schedule(dynamic) num_threads(nthreads > 0 ? nthreads: omp_get_max_threads())")
+        for(size_t i = 0; i < nq; ++i)
+            ret[i] = query(queries[i], k, stats ? &qstats[i]: nullptr);
+        for(const auto &qs: qstats) stats->compared += qs.compared, stats->pruned += qs.pruned;
+        return ret;
+    }
+    template<typename Alloc>
+    std::vector<std::vector<neighbor_type>> query_batch(const std::vector<Sketch, Alloc> &queries, size_t k, int nthreads=1, knn_stats *stats=nullptr) const {
+        return query_batch(queries.data(), queries.size(), k, nthreads, stats);
+    }
+    // As above, with queries distributed over pool's workers.
+    std::vector<std::vector<neighbor_type>> query_batch(const Sketch *queries, size_t nq, size_t k, thread_pool &pool, knn_stats *stats=nullptr) const {
+        std::vector<std::vector<neighbor_type>> ret(nq);
+        std::vector<knn_stats> qstats(stats ? nq: size_t(0));
+        for(size_t i = 0; i < nq; ++i) detail::prepare(queries[i], detail::prio<1>());
+        pool.parallel_for(0, nq, [&](size_t i) {ret[i] = query(queries[i], k, stats ? &qstats[i]: nullptr);}, 1);
+        for(const auto &qs: qstats) stats->compared += qs.compared, stats->pruned += qs.pruned;
+        return ret;
+    }
+    template<typename Alloc>
+    std::vector<std::vector<neighbor_type>> query_batch(const std::vector<Sketch, Alloc> &queries, size_t k, thread_pool &pool, knn_stats *stats=nullptr) const {
+        return query_batch(queries.data(), queries.size(), k, pool, stats);
+    }
+private:
+    template<typename Alloc>
+    static std::vector<const Sketch *> to_ptrs(const std::vector<Sketch, Alloc> &sketches) {
+        std::vector<const Sketch *> ret(sketches.size());
+        for(size_t i = 0; i < sketches.size(); ++i) ret[i] = &sketches[i];
+        return ret;
+    }
+};
+
+// One-off search. Build a knn_index instead when issuing many queries against the same collection.
+template<typename Sketch, typename Alloc, typename Metric=jaccard_metric>
+std::vector<std::pair<size_t, double>> knn_search(const Sketch &query, const std::vector<Sketch, Alloc> &collection, size_t k, Metric metric=Metric(), double slack=.1) {
+    return knn_index<Sketch, Metric>(collection, std::move(metric), slack).query(query, k);
+}
+
+} // inline namespace knn
+} // namespace sketch
+
+#endif /* SKETCH_KNN_H__ */
@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <mutex>
 //#include <queue>
 #include "sketch/hll.h" // For common.h and clz functions
@@ -80,6 +81,162 @@ public:
 
 template<typename T, typename Allocator> struct FinalRMinHash; // Forward definition
 template<typename HashStruct=WangHash, typename VT=uint64_t, bool select_bottom=true> struct BottomKHasher;
+
+namespace detail {
+/*
+ * Flat bottom-k storage for RangeMinHash and CountingRangeMinHash, in place of a node-based std::set.
+ * Elements live in one array kept as a binary heap whose root is the element first in Cmp's order,
+ * i.e., the current threshold (the largest value, for std::greater), so that rejecting a value costs one comparison
+ * and replacing the threshold is a sift-down without allocation. A flat hash table over the keys answers duplicate checks;
+ * when Counted, elements are {first: key, second: count} and the table maps keys to heap positions.
+ *
+ * Iteration yields Cmp order, as std::set<T, Cmp> did, and is read-only, since writing through it could break the heap.
+ * Iterators never touch the array: if it is unsorted, they read a sorted copy built once under a lock and kept until
+ * the next change, so several threads may read one sketch at once, through const or non-const references alike.
+ * Only mutators and an explicit sort() reorder the array in place; a sorted array is itself a valid heap,
+ * so insertions simply continue from it, and iteration after sort() reads the array without copying.
+ */
+template<typename T, typename Elem, typename Cmp, bool Counted>
+class flat_bottomk {
+    using index_type = std::conditional_t<Counted, ska::flat_hash_map<T, uint32_t>, ska::flat_hash_set<T>>;
+    // Sorted copy of heap_ for const readers; copies start empty and rebuild on demand.
+    struct snapshot_type {
+        std::vector<Elem> v_;
+        std::atomic<bool> valid_{false};
+        std::mutex mut_;
+        snapshot_type() = default;
+        snapshot_type(const snapshot_type &) {}
+        snapshot_type &operator=(const snapshot_type &) {invalidate(); return *this;}
+        void invalidate() {
+            if(valid_.load(std::memory_order_relaxed)) std::vector<Elem>().swap(v_), valid_.store(false, std::memory_order_relaxed);
+        }
+    };
+    std::vector<Elem> heap_;
+    index_type index_;
+    bool sorted_ = true;
+    Cmp cmp_;
+    mutable snapshot_type snapshot_;
+
+    static const T &key(const T &x) {return x;}
+    template<typename E>
+    static auto key(const E &x) -> const decltype(x.first) & {return x.first;}
+    void place(size_t i, const Elem &e) {
+        heap_[i] = e;
+        set_pos(i, std::integral_constant<bool, Counted>());
+    }
+    void set_pos(size_t i, std::true_type) {index_[key(heap_[i])] = i;}
+    void set_pos(size_t, std::false_type) {}
+    void reindex(std::true_type) {for(size_t i = 0; i < heap_.size(); ++i) index_[key(heap_[i])] = i;}
+    void reindex(std::false_type) {}
+    // Sets record keys as they are added; maps record them as they are placed.
+    void add_key(const T &, std::true_type) {}
+    void add_key(const T &x, std::false_type) {index_.insert(x);}
+    void sift_up(size_t i, Elem e) {
+        while(i) {
+            const size_t parent = (i - 1) >> 1;
+            if(!cmp_(key(e), key(heap_[parent]))) break;
+            place(i, heap_[parent]);
+            i = parent;
+        }
+        place(i, e);
+    }
+    void sift_down(size_t i, Elem e) {
+        const size_t n = heap_.size();
+        for(size_t child; (child = 2 * i + 1) < n; i = child) {
+            if(child + 1 < n && cmp_(key(heap_[child + 1]), key(heap_[child]))) ++child;
+            if(!cmp_(key(heap_[child]), key(e))) break;
+            place(i, heap_[child]);
+        }
+        place(i, e);
+    }
+    template<typename It>
+    void sort_range(It b, It e) const {
+        std::sort(b, e, [this](const Elem &x, const Elem &y) {return cmp_(key(x), key(y));});
+    }
+    // heap_ if it is already sorted, otherwise the snapshot, sorting a copy into it if needed.
+    const std::vector<Elem> &sorted() const {
+        if(sorted_) return heap_;
+        if(!snapshot_.valid_.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(snapshot_.mut_);
+            if(!snapshot_.valid_.load(std::memory_order_relaxed)) {
+                snapshot_.v_ = heap_;
+                sort_range(snapshot_.v_.begin(), snapshot_.v_.end());
+                snapshot_.valid_.store(true, std::memory_order_release);
+            }
+        }
+        return snapshot_.v_;
+    }
+public:
+    using value_type = Elem;
+    using key_compare = Cmp;
+    using const_iterator = typename std::vector<Elem>::const_iterator;
+
+    flat_bottomk(size_t k=0, const Cmp &cmp=Cmp()): cmp_(cmp) {reserve(k);}
+    void reserve(size_t k) {
+        heap_.reserve(k);
+        index_.reserve(k);
+    }
+    size_t size() const {return heap_.size();}
+    bool empty() const {return heap_.empty();}
+    // Threshold element: what begin() would return, without sorting.
+    const Elem &top() const {return heap_.front();}
+    // Elements in heap order, for order-independent scans that should not sort.
+    const std::vector<Elem> &unordered() const {return heap_;}
+    bool contains(const T &x) const {return index_.find(x) != index_.end();}
+    // Counted only: the element with key x, or nullptr. Its count may be changed, but not its key.
+    Elem *find(const T &x) {
+        auto it = index_.find(x);
+        if(it == index_.end()) return nullptr;
+        snapshot_.invalidate();
+        return &heap_[it->second];
+    }
+    // Adds e, whose key must be absent.
+    void push(const Elem &e) {
+        add_key(key(e), std::integral_constant<bool, Counted>());
+        heap_.push_back(e);
+        sift_up(heap_.size() - 1, e);
+        sorted_ = false;
+        snapshot_.invalidate();
+    }
+    // Replaces the threshold element by e, whose key must be absent.
+    void replace_top(const Elem &e) {
+        index_.erase(key(heap_.front()));
+        add_key(key(e), std::integral_constant<bool, Counted>());
+        sift_down(0, e);
+        sorted_ = false;
+        snapshot_.invalidate();
+    }
+    // Removes threshold elements until at most n remain.
+    void truncate(size_t n) {
+        if(heap_.size() <= n) return;
+        sort();
+        const size_t nrm = heap_.size() - n;
+        for(size_t i = 0; i < nrm; ++i) index_.erase(key(heap_[i]));
+        heap_.erase(heap_.begin(), heap_.begin() + nrm);
+        reindex(std::integral_constant<bool, Counted>());
+    }
+    void sort() {
+        if(sorted_) return;
+        sort_range(heap_.begin(), heap_.end());
+        reindex(std::integral_constant<bool, Counted>());
+        sorted_ = true;
+        snapshot_.invalidate();
+    }
+    void clear() {
+        std::vector<Elem>().swap(heap_);
+        index_ = index_type();
+        sorted_ = true;
+        snapshot_.invalidate();
+    }
+    const_iterator begin() const {return sorted().cbegin();}
+    const_iterator end() const {return sorted().cend();}
+    const_iterator cbegin() const {return begin();}
+    const_iterator cend() const {return end();}
+    auto rbegin() const {return std::make_reverse_iterator(end());}
+    auto rend() const {return std::make_reverse_iterator(begin());}
+};
+} // namespace detail
+
 /*
 The sketch is the set of minimizers.
 
@@ -93,35 +250,42 @@ struct RangeMinHash: public AbstractMinHash<T, Cmp> {
 protected:
     Hasher hf_;
     Cmp cmp_;
-    std::set<T, Cmp> minimizers_; // using std::greater<T> so that we can erase from begin()
+    detail::flat_bottomk<T, T, Cmp, false> minimizers_; // begin() is the threshold, with std::greater<T> the largest value
 
 public:
     using final_type = FinalRMinHash<T, Allocator>;
     using Compare = Cmp;
     RangeMinHash(size_t sketch_size, Hasher &&hf=Hasher(), Cmp &&cmp=Cmp()):
-        AbstractMinHash<T, Cmp>(sketch_size), hf_(std::move(hf)), cmp_(std::move(cmp))
+        AbstractMinHash<T, Cmp>(sketch_size), hf_(std::move(hf)), cmp_(cmp), minimizers_(sketch_size, cmp)
     {
     }
     RangeMinHash(std::string) {throw NotImplementedError("");}
     double cardinality_estimate() const {
         return double(std::numeric_limits<T>::max()) / this->max_element() * minimizers_.size();
     }
-    RangeMinHash(gzFile fp) {
+    RangeMinHash(gzFile fp): AbstractMinHash<T, Cmp>(0) {
         if(!fp) throw std::runtime_error("Null file handle!");
         this->read(fp);
     }
     DBSKETCH_READ_STRING_MACROS
     DBSKETCH_WRITE_STRING_MACROS
     ssize_t read(gzFile fp) {
-        ssize_t ret = gzread(fp, this, sizeof(*this));
+        // The header holds this object's bytes with minimizers_ zeroed; keep our own container rather than copying that over it.
+        char tmp[sizeof(*this)];
+        ssize_t ret = gzread(fp, tmp, sizeof(tmp));
+        const size_t off = reinterpret_cast<const char *>(&minimizers_) - reinterpret_cast<const char *>(this);
+        std::memcpy(static_cast<void *>(this), tmp, off);
+        std::memcpy(reinterpret_cast<char *>(this) + off + sizeof(minimizers_), tmp + off + sizeof(minimizers_), sizeof(tmp) - off - sizeof(minimizers_));
+        minimizers_.clear();
         T v;
-        for(ssize_t read; (read = gzread(fp, &v, sizeof(v))) == sizeof(v);minimizers_.insert(v), ret += read);
+        for(ssize_t read; (read = gzread(fp, &v, sizeof(v))) == sizeof(v); ret += read)
+            if(!minimizers_.contains(v)) minimizers_.push(v);
         return ret;
     }
     RangeMinHash &operator+=(const RangeMinHash &o) {
-        minimizers_.insert(o.begin(), o.end());
-        while(minimizers_.size() > this->ss_)
-            minimizers_.erase(minimizers_.begin());
+        for(const auto v: o)
+            if(!minimizers_.contains(v)) minimizers_.push(v);
+        minimizers_.truncate(this->ss_);
         return *this;
     }
     RangeMinHash operator+(const RangeMinHash &o) const {
@@ -142,12 +306,14 @@ public:
     }
     auto rbegin() const {return minimizers_.rbegin();}
     auto rbegin() {return minimizers_.rbegin();}
+    auto rend() const {return minimizers_.rend();}
+    auto rend() {return minimizers_.rend();}
     T max_element() const {
 #if 0
         for(const auto e: *this)
             assert(*begin() >= e);
 #endif
-        return *begin();
+        return minimizers_.top();
     }
     T min_element() const {
         return *rbegin();
@@ -157,12 +323,9 @@ public:
     }
     INLINE void add(T val) {
         if(minimizers_.size() == this->ss_) {
-            if(cmp_(max_element(), val)) {
-                minimizers_.insert(val);
-                if(minimizers_.size() > this->ss_)
-                    minimizers_.erase(minimizers_.begin());
-            }
-        } else minimizers_.insert(val);
+            if(cmp_(max_element(), val) && !minimizers_.contains(val))
+                minimizers_.replace_top(val);
+        } else if(!minimizers_.contains(val)) minimizers_.push(val);
     }
     template<typename T2>
     INLINE void addh(T2 val) {
@@ -210,7 +373,7 @@ public:
         return Container(std::rbegin(minimizers_), std::rend(minimizers_.end()));
     }
     void clear() {
-        decltype(minimizers_)().swap(minimizers_);
+        minimizers_.clear();
     }
     void free() {clear();}
     final_type cfinalize() const {
@@ -274,23 +437,9 @@ struct FinalRMinHash {
         return isz::intersection_size(first, o.first);
     }
     double jaccard_index(const FinalRMinHash &o) const {
-        auto lit = begin(), rit = o.begin(), lend = end(), rend = o.end();
+        // Shared elements among the first size() elements of the union
         const size_t n = size();
-        size_t nused = 0, shared = 0;
-        while(nused++ < n) {
-            if(*lit == *rit) {
-                ++shared;
-                if(++lit == lend) break;
-                if(++rit == rend) break;
-            } else {
-                if(*lit < *rit) {
-                    if(++lit == lend) break;
-                } else {
-                    if(++rit == rend) break;
-                }
-            }
-        }
-        return double(shared) / n;
+        return double(isz::count_common_prefix(first.data(), n, o.first.data(), o.size(), n)) / n;
         //double is = intersection_size(o);
         //return is / ((size() << 1) - is);
     }
@@ -405,7 +554,7 @@ struct FinalRMinHash {
         sort();
     }
     template<typename Hasher, bool is_bottom>
-    FinalRMinHash(const BottomKHasher<Hasher, T, is_bottom> &bk): FinalRMinHash(bk.mpq_.getq().begin(), bk.mpq_.getq().end()) {}
+    FinalRMinHash(const BottomKHasher<Hasher, T, is_bottom> &bk): FinalRMinHash(bk.values().begin(), bk.values().end()) {}
     FinalRMinHash(FinalRMinHash &&o): first(std::move(o.first)) {sort();}
     ssize_t read(gzFile fp) {
         uint64_t sz;
@@ -431,7 +580,7 @@ struct FinalRMinHash {
         return ret;
     }
     template<typename Hasher, bool ismax>
-    FinalRMinHash(BottomKHasher<Hasher, T, ismax> &&prefinal): FinalRMinHash(std::move(prefinal.mpq_.getq())) {
+    FinalRMinHash(BottomKHasher<Hasher, T, ismax> &&prefinal): FinalRMinHash(std::move(prefinal.heap_)) {
         prefinal.clear();
     }
     template<typename Hasher, typename Cmp>
@@ -479,13 +628,14 @@ class CountingRangeMinHash: public AbstractMinHash<T, Cmp> {
         VType &operator=(const VType &o) {
             this->first = o.first;
             this->second = o.second;
+            return *this;
         }
         VType(gzFile fp) {if(gzread(fp, this, sizeof(*this)) != sizeof(*this)) throw ZlibError("Failed to read");}
     };
     Hasher hf_;
     Cmp cmp_;
     mutable CountType cached_sum_sq_ = 0, cached_sum_ = 0;
-    std::set<VType> minimizers_; // using std::greater<T> so that we can erase from begin()
+    detail::flat_bottomk<T, VType, Cmp, true> minimizers_; // begin() is the threshold, with std::greater<T> the largest value
 public:
     const auto &min() const {return minimizers_;}
     using size_type = CountType;
@@ -500,31 +650,33 @@ public:
     auto rend() {return minimizers_.rend();}
     auto rend() const {return minimizers_.rend();}
     void free() {
-        std::set<VType> tmp;
-        std::swap(tmp, minimizers_);
+        minimizers_.clear();
     }
-    CountingRangeMinHash(size_t n, Hasher &&hf=Hasher(), Cmp &&cmp=Cmp()): AbstractMinHash<T, Cmp>(n), hf_(std::move(hf)), cmp_(std::move(cmp)) {}
+    CountingRangeMinHash(size_t n, Hasher &&hf=Hasher(), Cmp &&cmp=Cmp()): AbstractMinHash<T, Cmp>(n), hf_(std::move(hf)), cmp_(cmp), minimizers_(n, cmp) {}
     CountingRangeMinHash(std::string s): CountingRangeMinHash(0) {throw NotImplementedError("");}
     double cardinality_estimate(MHCardinalityMode mode=ARITHMETIC_MEAN) const {
-        return double(std::numeric_limits<T>::max()) / std::max_element(minimizers_.begin(), minimizers_.end(), [](auto x, auto y) {return x.first < y.first;})->first * minimizers_.size();
+        return double(std::numeric_limits<T>::max()) / largest_value() * minimizers_.size();
+    }
+    // With std::greater the threshold is the largest value; otherwise it is found in one pass over the unsorted heap.
+    T largest_value() const {
+        CONST_IF(std::is_same<Cmp, std::greater<T>>::value) return minimizers_.top().first;
+        const auto &v = minimizers_.unordered();
+        return std::max_element(v.begin(), v.end(), [](const VType &x, const VType &y) {return x.first < y.first;})->first;
     }
     INLINE void add(T val) {
         if(minimizers_.size() == this->ss_) {
-            if(cmp_(begin()->first, val)) {
-                auto it = minimizers_.find(VType(val, 0));
-                if(it == minimizers_.end()) {
-                    minimizers_.erase(begin());
-                    minimizers_.insert(VType(val, CountType(1)));
-                } else ++it->second;
+            if(cmp_(max_element(), val)) {
+                if(auto p = minimizers_.find(val)) ++p->second;
+                else minimizers_.replace_top(VType(val, CountType(1)));
             }
-        } else minimizers_.insert(VType(val, CountType(1)));
+        } else if(!minimizers_.contains(val)) minimizers_.push(VType(val, CountType(1)));
     }
     INLINE void addh(T val) {
         val = hf_(val);
         this->add(val);
     }
     auto max_element() const {
-        return minimizers_.begin()->first;
+        return minimizers_.top().first;
     }
     auto sum_sq() {
         if(cached_sum_sq_) goto end;
@@ -604,13 +756,15 @@ public:
     ssize_t read(gzFile fp) {
         uint64_t n;
         if(gzread(fp, &n, sizeof(n)) != sizeof(n)) throw ZlibError("Failed to read");
-        for(size_t i = n; i--; minimizers_.insert(VType(fp)));
+        for(size_t i = n; i--;) {
+            const VType v(fp);
+            if(!minimizers_.contains(v.first)) minimizers_.push(v);
+        }
         return sizeof(n) + sizeof(VType) * n;
     }
 
     void clear() {
-        decltype(minimizers_) tmp;
-        std::swap(tmp, minimizers_);
+        minimizers_.clear();
     }
     template<typename WeightFn=weight::EqualWeight>
     double tf_idf(const CountingRangeMinHash &o, const WeightFn &fn) const {
@@ -661,8 +815,10 @@ public:
             func(i);
         }
     }
+    // Counts may be edited through func; sorting in place first makes iteration visit the live elements, not a snapshot.
     template<typename Func>
     void for_each(const Func &func) {
+        minimizers_.sort();
         for(auto &i: minimizers_) {
             func(i);
         }
@@ -1161,52 +1317,165 @@ struct BottomKHasher {
     using final_type = FinalRMinHash<VT, Allocator<VT>>;
     using heap_cmp = std::conditional_t<select_bottom,
                                         std::less<void>, std::greater<void>>;
-    struct mpq: std::priority_queue<VT, std::vector<VT, Allocator<VT>>, heap_cmp> {
-        auto &getq() {return this->c;}
-        const auto &getq() const {return this->c;}
-        template<typename X, typename Y>
-        bool cmp(const X &x, const Y &y) const {
-            return this->comp(x, y);
-        }
-    };
-
+    /*
+     * The k retained hashes form a heap topped by the threshold (the largest, when selecting the bottom k),
+     * with capacity for 2k so that merges can append before selecting.
+     * Membership is answered by an open-addressed table of a power of two at least 2k slots over the same hashes,
+     * with linear probing and backward-shift deletion; 0 marks an empty slot, and has_zero_ records whether 0 is held.
+     * Both are allocated on construction (and on copy) and never grow.
+     */
     size_t k_;
     HashStruct hs_;
-    mpq mpq_;
-    ska::flat_hash_set<VT> set_;
+    heap_cmp cmp_;
+    std::vector<VT, Allocator<VT>> heap_;
+    std::vector<VT, Allocator<VT>> table_;
+    unsigned shift_;
+    bool has_zero_ = false;
+
+    void init_table() {
+        size_t sz = 2;
+        shift_ = 63;
+        while(sz < 2 * k_) sz <<= 1, --shift_;
+        table_.assign(sz, VT(0));
+        has_zero_ = false;
+        heap_.reserve(2 * k_);
+    }
+    // Hashes kept by a bottom-k selection have high bits in common, so the slot is taken from a multiplicative rehash.
+    size_t slot(VT v) const {return (uint64_t(v) * 0x9E3779B97F4A7C15ull) >> shift_;}
+    bool contains(VT v) const {
+        if(!v) return has_zero_;
+        const size_t mask = table_.size() - 1;
+        for(size_t i = slot(v); table_[i]; i = (i + 1) & mask)
+            if(table_[i] == v) return true;
+        return false;
+    }
+    void insert_key(VT v) {
+        if(!v) {has_zero_ = true; return;}
+        const size_t mask = table_.size() - 1;
+        size_t i = slot(v);
+        while(table_[i]) i = (i + 1) & mask;
+        table_[i] = v;
+    }
+    void erase_key(VT v) {
+        if(!v) {has_zero_ = false; return;}
+        const size_t mask = table_.size() - 1;
+        size_t i = slot(v);
+        while(table_[i] != v) i = (i + 1) & mask;
+        // Pull back later entries of the cluster which may no longer be reached past the hole.
+        for(size_t j = i;;) {
+            j = (j + 1) & mask;
+            if(!table_[j]) break;
+            const size_t h = slot(table_[j]);
+            if(((j - h) & mask) >= ((j - i) & mask)) table_[i] = table_[j], i = j;
+        }
+        table_[i] = 0;
+    }
+    void replace_top(VT v) {
+        const size_t n = heap_.size();
+        size_t i = 0;
+        for(size_t child; (child = 2 * i + 1) < n; i = child) {
+            if(child + 1 < n && cmp_(heap_[child], heap_[child + 1])) ++child;
+            if(!cmp_(v, heap_[child])) break;
+            heap_[i] = heap_[child];
+        }
+        heap_[i] = v;
+    }
+    void rebuild_table() {
+        std::fill(table_.begin(), table_.end(), VT(0));
+        has_zero_ = false;
+        for(const VT v: heap_) insert_key(v);
+    }
 
     void clear() {
-        set_.clear();
-        mpq_.getq().clear();
+        heap_.clear();
+        heap_.reserve(2 * k_);
+        std::fill(table_.begin(), table_.end(), VT(0));
+        has_zero_ = false;
     }
     void reset() {clear();}
+    size_t size() const {return heap_.size();}
+    const auto &values() const {return heap_;}
 
     double cardinality_estimate() const {
+        if(heap_.empty()) return 0.;
         if(select_bottom) {
-            return double(std::numeric_limits<VT>::max()) / this->mpq_.top() * mpq_.size();
+            return double(std::numeric_limits<VT>::max()) / this->heap_.front() * heap_.size();
         } else {
-            return double(std::numeric_limits<VT>::max()) / (std::numeric_limits<VT>::max() - this->mpq_.top()) * mpq_.size();
+            return double(std::numeric_limits<VT>::max()) / (std::numeric_limits<VT>::max() - this->heap_.front()) * heap_.size();
         }
     }
 
-    BottomKHasher(size_t k, HashStruct &&hs=HashStruct()): k_(k), hs_(std::move(hs)) {}
+    BottomKHasher(size_t k, HashStruct &&hs=HashStruct()): k_(k), hs_(std::move(hs)) {
+        if(!k_) throw std::runtime_error("BottomKHasher requires k > 0");
+        init_table();
+    }
+    // A copied vector's capacity is only its size, so copies restore the 2k headroom merges append into.
+    BottomKHasher(const BottomKHasher &o):
+        k_(o.k_), hs_(o.hs_), cmp_(o.cmp_), heap_(o.heap_), table_(o.table_), shift_(o.shift_), has_zero_(o.has_zero_)
+    {
+        heap_.reserve(2 * k_);
+    }
+    BottomKHasher &operator=(const BottomKHasher &o) {
+        k_ = o.k_; hs_ = o.hs_; cmp_ = o.cmp_;
+        heap_ = o.heap_; table_ = o.table_; shift_ = o.shift_; has_zero_ = o.has_zero_;
+        heap_.reserve(2 * k_);
+        return *this;
+    }
+    // Moved-from sketches keep k and get fresh storage, so they remain usable.
+    BottomKHasher(BottomKHasher &&o):
+        k_(o.k_), hs_(std::move(o.hs_)), cmp_(o.cmp_), heap_(std::move(o.heap_)), table_(std::move(o.table_)), shift_(o.shift_), has_zero_(o.has_zero_)
+    {
+        o.heap_.clear();
+        o.init_table();
+    }
+    BottomKHasher &operator=(BottomKHasher &&o) {
+        if(this != &o) {
+            k_ = o.k_; hs_ = std::move(o.hs_); cmp_ = o.cmp_;
+            heap_ = std::move(o.heap_); table_ = std::move(o.table_); shift_ = o.shift_; has_zero_ = o.has_zero_;
+            o.heap_.clear();
+            o.init_table();
+        }
+        return *this;
+    }
     void addh(uint64_t v) {add(hs_(v));}
     void add(uint64_t hv) {
-        if(set_.find(hv) != set_.end()) return;
-        if(mpq_.size() < k_) {
-            mpq_.push(hv);
-            set_.insert(hv);
-        } else if(mpq_.cmp(hv, mpq_.top())) {
-            set_.erase(mpq_.top());
-            mpq_.pop(), mpq_.push(hv);
-            set_.insert(hv);
+        const VT v = hv;
+        if(heap_.size() < k_) {
+            if(contains(v)) return;
+            insert_key(v);
+            heap_.push_back(v);
+            std::push_heap(heap_.begin(), heap_.end(), cmp_);
+        } else if(cmp_(v, heap_.front()) && !contains(v)) {
+            erase_key(heap_.front());
+            insert_key(v);
+            replace_top(v);
         }
     }
+    // Keeps the k selected hashes of the union, in time linear in k.
+    BottomKHasher &operator+=(const BottomKHasher &o) {
+        if(k_ != o.k_) throw std::runtime_error("Non-matching parameters for BottomKHasher merge");
+        const size_t before = heap_.size();
+        for(const VT v: o.heap_) if(!contains(v)) heap_.push_back(v);
+        if(heap_.size() > k_) {
+            std::nth_element(heap_.begin(), heap_.begin() + k_, heap_.end(), cmp_);
+            heap_.resize(k_);
+            rebuild_table();
+        } else for(size_t i = before; i < heap_.size(); ++i) insert_key(heap_[i]);
+        std::make_heap(heap_.begin(), heap_.end(), cmp_);
+        return *this;
+    }
+    BottomKHasher operator+(const BottomKHasher &o) const {
+        BottomKHasher ret(*this);
+        ret += o;
+        return ret;
+    }
     final_type finalize() const & {
-        return final_type(mpq_.getq());
+        return final_type(heap_);
     }
     final_type finalize() && {
-        return final_type(std::move(mpq_.getq()));
+        final_type ret(std::move(heap_));
+        clear();
+        return ret;
     }
     void write(std::string path) const {
         this->finalize().write(path);
@@ -1216,22 +1485,24 @@ struct BottomKHasher {
     }
     ssize_t read(std::string s) {
         FinalRMinHash<VT> ret(s.data());
-        k_ = ret.first.size();
-        set_.reserve(k_);
-        for(const auto v: ret.first) {
-            set_.insert(v);
-            mpq_.push(v);
-        }
-        return sizeof(ret.first[0]) * ret.first.size() + sizeof(ret);
+        return load(ret);
     }
     ssize_t read(gzFile fp) {
         FinalRMinHash<VT> ret(fp);
+        return load(ret);
+    }
+private:
+    ssize_t load(const FinalRMinHash<VT> &ret) {
+        if(ret.first.empty()) throw std::runtime_error("Cannot load an empty sketch: BottomKHasher requires k > 0");
         k_ = ret.first.size();
-        set_.reserve(k_);
-        for(const auto v: ret.first) {
-            set_.insert(v);
-            mpq_.push(v);
+        heap_.clear();
+        init_table();
+        for(const VT v: ret.first) {
+            if(contains(v)) continue;
+            insert_key(v);
+            heap_.push_back(v);
         }
+        std::make_heap(heap_.begin(), heap_.end(), cmp_);
         return sizeof(ret.first[0]) * ret.first.size() + sizeof(ret);
     }
 };
@@ -0,0 +1,161 @@
+#ifndef SKETCH_PAIRWISE_H__
+#define SKETCH_PAIRWISE_H__
+#include "common.h"
+#include "pool.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace sketch {
+inline namespace pairwise {
+
+// Similarity metrics may also provide upper_bound(|X|, |Y|), the largest value attainable for sets
+// of those cardinalities, which lets searches skip comparisons that cannot make the cut.
+struct jaccard_metric {
+    template<typename S> double operator()(const S &x, const S &y) const {return x.jaccard_index(y);}
+    static double upper_bound(double x, double y) {
+        const double mx = std::max(x, y);
+        return mx > 0. ? std::min(x, y) / mx: 1.;
+    }
+};
+struct union_size_metric {
+    template<typename S> double operator()(const S &x, const S &y) const {return x.union_size(y);}
+};
+struct containment_metric {
+    template<typename S> double operator()(const S &x, const S &y) const {return x.containment_index(y);}
+    static double upper_bound(double x, double y) {return x > y ? y / x: 1.;}
+};
+
+namespace detail {
+template<size_t N> struct prio: prio<N - 1> {};
+template<> struct prio<0> {};
+
+// Bytes streamed per comparison, used to size tiles.
+template<typename S>
+auto sketch_nbytes(const S &s, prio<3>) -> decltype(s.core().size() * sizeof(s.core()[0])) {return s.core().size() * sizeof(s.core()[0]);}
+template<typename S>
+auto sketch_nbytes(const S &s, prio<2>) -> decltype(s.view().second * sizeof(*s.view().first)) {return s.view().second * sizeof(*s.view().first);}
+template<typename S>
+auto sketch_nbytes(const S &s, prio<1>) -> decltype(s.size() * sizeof(*s.data())) {return s.size() * sizeof(*s.data());}
+template<typename S>
+size_t sketch_nbytes(const S &, prio<0>) {return sizeof(S);}
+
+// Cache lazily-computed cardinalities up front, so that the comparisons only read shared state.
+template<typename S>
+auto prepare(const S &s, prio<1>) -> decltype(s.csum(), void()) {s.csum();}
+template<typename S>
+void prepare(const S &, prio<0>) {}
+} // namespace detail
+
+/*
+ * All-pairs comparison of n sketches under Metric, visiting the upper triangle tile by tile.
+ * A tile pairs a block of rows with a block of columns, each sized so both fit together in L2;
+ * every column sketch in a tile is then compared against the whole row block before being evicted,
+ * instead of being re-streamed from memory once per row.
+ */
+template<typename Sketch, typename Metric=jaccard_metric, typename ResultT=float>
+class pairwise_matrix {
+    std::vector<const Sketch *> ptrs_;
+    Metric                    metric_;
+    size_t                     block_;
+public:
+    static constexpr size_t DEFAULT_TILE_BYTES = 1 << 18;
+
+    pairwise_matrix(std::vector<const Sketch *> ptrs, Metric metric=Metric(), size_t block=0):
+        ptrs_(std::move(ptrs)), metric_(std::move(metric)), block_(block)
+    {
+        if(!block_) {
+            const size_t nb = ptrs_.empty() ? 1: std::max(detail::sketch_nbytes(*ptrs_.front(), detail::prio<3>()), size_t(1));
+            block_ = std::max(DEFAULT_TILE_BYTES / (2 * nb), size_t(1));
+        }
+        for(const auto p: ptrs_) detail::prepare(*p, detail::prio<1>());
+    }
+    pairwise_matrix(const Sketch *data, size_t n, Metric metric=Metric(), size_t block=0):
+        pairwise_matrix(to_ptrs(data, n), std::move(metric), block) {}
+    template<typename Alloc>
+    pairwise_matrix(const std::vector<Sketch, Alloc> &sketches, Metric metric=Metric(), size_t block=0):
+        pairwise_matrix(sketches.data(), sketches.size(), std::move(metric), block) {}
+
+    size_t size() const {return ptrs_.size();}
+    size_t block_size() const {return block_;}
+    size_t condensed_size() const {return size() * (size() - 1) / 2;}
+    static size_t condensed_index(size_t i, size_t j, size_t n) {
+        assert(i < j);
+        return i * (2 * n - i - 1) / 2 + j - i - 1;
+    }
+
+    // Calls func(i, j, value) for every i < j.
+    // With more than one thread, func is called concurrently, though never twice for the same pair.
+    // nthreads only takes effect when built with OpenMP; the thread_pool overloads parallelize regardless.
+    template<typename Func>
+    void for_each(const Func &func, int nthreads=1) const {
+        const size_t n = size(), nblocks = (n + block_ - 1) / block_, ntiles = nblocks * (nblocks + 1) / 2;
+        (void)nthreads;
+        OMP_PRAGMA("omp parallel for schedule(dynamic) num_threads(nthreads > 0 ? nthreads: omp_get_max_threads())")
+        for(size_t t = 0; t < ntiles; ++t) {
+            // Tiles are enumerated row-major through the upper triangle of the block grid.
+            size_t bi = 0, rem = t;
+            while(rem >= nblocks - bi) rem -= nblocks - bi++;
+            run_tile(bi, bi + rem, func);
+        }
+    }
+    // As above, with tiles distributed over pool's workers.
+    template<typename Func>
+    void for_each(const Func &func, thread_pool &pool) const {
+        const size_t nblocks = (size() + block_ - 1) / block_;
+        // Tiles are enumerated row-major through the upper triangle of the block grid, as block rows.
+        pool.parallel_for(0, nblocks, [&](size_t bi) {
+            pool.parallel_for(bi, nblocks, [&](size_t bj) {run_tile(bi, bj, func);}, 1);
+        }, 1);
+    }
+    // Writes the condensed upper triangle (as scipy's squareform) into out, which must hold condensed_size() values.
+    void condensed(ResultT *out, int nthreads=1) const {
+        const size_t n = size();
+        for_each([out,n](size_t i, size_t j, double v) {out[condensed_index(i, j, n)] = v;}, nthreads);
+    }
+    void condensed(ResultT *out, thread_pool &pool) const {
+        const size_t n = size();
+        for_each([out,n](size_t i, size_t j, double v) {out[condensed_index(i, j, n)] = v;}, pool);
+    }
+    std::vector<ResultT> condensed(int nthreads=1) const {
+        std::vector<ResultT> ret(condensed_size());
+        condensed(ret.data(), nthreads);
+        return ret;
+    }
+    std::vector<ResultT> condensed(thread_pool &pool) const {
+        std::vector<ResultT> ret(condensed_size());
+        condensed(ret.data(), pool);
+        return ret;
+    }
+private:
+    static std::vector<const Sketch *> to_ptrs(const Sketch *data, size_t n) {
+        std::vector<const Sketch *> ret(n);
+        for(size_t i = 0; i < n; ++i) ret[i] = data + i;
+        return ret;
+    }
+    template<typename Func>
+    void run_tile(size_t bi, size_t bj, const Func &func) const {
+        const size_t n = size();
+        const size_t ibeg = bi * block_, iend = std::min(ibeg + block_, n),
+                     jbeg = bj * block_, jend = std::min(jbeg + block_, n);
+        for(size_t i = ibeg; i < iend; ++i) {
+            const Sketch &lhs = *ptrs_[i];
+            for(size_t j = std::max(jbeg, i + 1); j < jend; ++j)
+                func(i, j, metric_(lhs, *ptrs_[j]));
+        }
+    }
+};
+
+template<typename Sketch, typename Metric=jaccard_metric, typename ResultT=float>
+std::vector<ResultT> pairwise_condensed(const std::vector<Sketch> &sketches, Metric metric=Metric(), int nthreads=1) {
+    return pairwise_matrix<Sketch, Metric, ResultT>(sketches, std::move(metric)).condensed(nthreads);
+}
+template<typename Sketch, typename Metric=jaccard_metric, typename ResultT=float>
+std::vector<ResultT> pairwise_condensed(const std::vector<Sketch> &sketches, thread_pool &pool, Metric metric=Metric()) {
+    return pairwise_matrix<Sketch, Metric, ResultT>(sketches, std::move(metric)).condensed(pool);
+}
+
+} // inline namespace pairwise
+} // namespace sketch
+
+#endif /* SKETCH_PAIRWISE_H__ */
@@ -0,0 +1,320 @@
+#ifndef SKETCH_POOL_H__
+#define SKETCH_POOL_H__
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace sketch {
+inline namespace pool {
+
+/*
+ * Persistent work-stealing thread pool.
+ *
+ * Each worker owns a deque: it pushes and pops its own tasks at the back (LIFO, for locality),
+ * while idle workers steal from the front of others' deques (FIFO, taking the largest pending pieces of split work),
+ * trying workers on their own NUMA node first. Tasks submitted from outside the pool go to a shared queue.
+ * With pin set, workers are pinned to CPUs allowed by the process's affinity mask, spread evenly across NUMA nodes,
+ * unless there are more workers than CPUs. Pinning is off by default, as pools pinned independently,
+ * e.g., by two processes, all start from the same CPUs.
+ *
+ * Parallelism nests: a task may start a task_group or parallel_for of its own, and while a worker waits for it,
+ * it runs other tasks instead of blocking. Threads outside the pool block while they wait.
+ */
+namespace detail {
+
+// Parses a Linux cpulist, e.g., "0-3,8,10-11".
+inline std::vector<unsigned> parse_cpulist(const std::string &s) {
+    std::vector<unsigned> ret;
+    size_t pos = 0;
+    while(pos < s.size()) {
+        size_t end = s.find(',', pos);
+        if(end == std::string::npos) end = s.size();
+        const std::string range = s.substr(pos, end - pos);
+        const size_t dash = range.find('-');
+        if(!range.empty() && range[0] >= '0' && range[0] <= '9') {
+            const unsigned lo = std::stoul(range), hi = dash == std::string::npos ? lo: std::stoul(range.substr(dash + 1));
+            for(unsigned c = lo; c <= hi; ++c) ret.push_back(c);
+        }
+        pos = end + 1;
+    }
+    return ret;
+}
+
+// CPUs this process may run on, grouped by NUMA node. Unknown topology yields a single group.
+inline std::vector<std::vector<unsigned>> numa_cpus() {
+    std::vector<std::vector<unsigned>> ret;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for(unsigned node = 0;; ++node) {
+            std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if(!ifs) break;
+            std::string line;
+            std::getline(ifs, line);
+            std::vector<unsigned> cpus;
+            for(const unsigned c: parse_cpulist(line))
+                if(c < CPU_SETSIZE && CPU_ISSET(c, &allowed)) cpus.push_back(c);
+            if(!cpus.empty()) ret.push_back(std::move(cpus));
+        }
+        if(ret.empty()) {
+            ret.emplace_back();
+            for(unsigned c = 0; c < CPU_SETSIZE; ++c) if(CPU_ISSET(c, &allowed)) ret.back().push_back(c);
+        }
+    }
+#endif
+    if(ret.empty()) {
+        ret.emplace_back(std::max(std::thread::hardware_concurrency(), 1u));
+        for(unsigned c = 0; c < ret[0].size(); ++c) ret[0][c] = c;
+    }
+    return ret;
+}
+
+} // namespace detail
+
+class thread_pool {
+public:
+    using task_type = std::function<void()>;
+private:
+    struct worker_t {
+        std::mutex mut;
+        std::deque<task_type> tasks;
+        unsigned node = 0;
+        int cpu = -1;
+    };
+    struct self_t {
+        const thread_pool *pool;
+        unsigned index;
+    };
+    std::vector<std::unique_ptr<worker_t>> workers_;
+    std::vector<std::thread> threads_;
+    std::mutex inject_mut_;
+    std::deque<task_type> injected_;
+    std::atomic<size_t> nqueued_{0};
+    std::atomic<unsigned> nsleeping_{0};
+    std::atomic<bool> stop_{false};
+    std::mutex sleep_mut_;
+    std::condition_variable sleep_cv_;
+
+    static self_t &self() {
+        static thread_local self_t s{nullptr, 0};
+        return s;
+    }
+    static bool take(std::mutex &mut, std::deque<task_type> &q, task_type &t, bool back, bool block) {
+        std::unique_lock<std::mutex> lock(mut, std::defer_lock);
+        if(block) lock.lock();
+        else if(!lock.try_lock()) return false;
+        if(q.empty()) return false;
+        if(back) t = std::move(q.back()), q.pop_back();
+        else     t = std::move(q.front()), q.pop_front();
+        return true;
+    }
+    // Own deque, then the shared queue, then steals: same-node victims first.
+    bool pop(task_type &t) {
+        const auto &me = self();
+        const bool worker = me.pool == this;
+        const unsigned n = workers_.size(), start = worker ? me.index + 1: 0, mynode = worker ? workers_[me.index]->node: 0;
+        bool found = (worker && take(workers_[me.index]->mut, workers_[me.index]->tasks, t, true, true))
+                  || take(inject_mut_, injected_, t, false, true);
+        for(unsigned pass = 0; pass < 2 && !found; ++pass) {
+            for(unsigned k = 0; k < n && !found; ++k) {
+                const unsigned v = (start + k) % n;
+                if((worker && v == me.index) || ((workers_[v]->node == mynode) != (pass == 0))) continue;
+                found = take(workers_[v]->mut, workers_[v]->tasks, t, false, false);
+            }
+        }
+        if(found) --nqueued_;
+        return found;
+    }
+    void worker_main(unsigned i) {
+        self() = self_t{this, i};
+#ifdef __linux__
+        if(workers_[i]->cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(workers_[i]->cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+#endif
+        task_type t;
+        for(;;) {
+            if(pop(t)) {
+                t();
+                continue;
+            }
+            bool pending = false;
+            for(unsigned s = 0; s < 64 && !pending; ++s) {
+                std::this_thread::yield();
+                pending = nqueued_.load() > 0;
+            }
+            if(pending) continue;
+            std::unique_lock<std::mutex> lock(sleep_mut_);
+            ++nsleeping_;
+            sleep_cv_.wait(lock, [this]() {return stop_.load() || nqueued_.load() > 0;});
+            --nsleeping_;
+            if(stop_.load() && nqueued_.load() == 0) return;
+        }
+    }
+public:
+    explicit thread_pool(unsigned nthreads=std::thread::hardware_concurrency(), bool pin=false) {
+        nthreads = std::max(nthreads, 1u);
+        const auto nodes = detail::numa_cpus();
+        size_t ncpus = 0;
+        for(const auto &cpus: nodes) ncpus += cpus.size();
+        pin = pin && nthreads <= ncpus;
+        // Worker i goes to node i % nnodes, taking that node's CPUs in order, so any prefix of workers is balanced across nodes.
+        std::vector<size_t> next(nodes.size());
+        for(unsigned i = 0; i < nthreads; ++i) {
+            workers_.emplace_back(new worker_t);
+            unsigned node = i % nodes.size();
+            if(pin) {
+                while(next[node] == nodes[node].size()) node = (node + 1) % nodes.size();
+                workers_.back()->cpu = nodes[node][next[node]++];
+            }
+            workers_.back()->node = node;
+        }
+        threads_.reserve(nthreads);
+        for(unsigned i = 0; i < nthreads; ++i) threads_.emplace_back(&thread_pool::worker_main, this, i);
+    }
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mut_);
+            stop_.store(true);
+        }
+        sleep_cv_.notify_all();
+        for(auto &t: threads_) t.join();
+    }
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    size_t size() const {return workers_.size();}
+    // Index of the calling thread among this pool's workers, or -1 for other threads.
+    int worker_index() const {return self().pool == this ? int(self().index): -1;}
+    // CPU a worker is pinned to, or -1.
+    int worker_cpu(size_t i) const {return workers_.at(i)->cpu;}
+    unsigned worker_node(size_t i) const {return workers_.at(i)->node;}
+
+    // Queues t: on the calling worker's own deque, or on the shared queue for other threads.
+    void submit(task_type t) {
+        ++nqueued_;
+        const auto &me = self();
+        if(me.pool == this) {
+            std::lock_guard<std::mutex> lock(workers_[me.index]->mut);
+            workers_[me.index]->tasks.push_back(std::move(t));
+        } else {
+            std::lock_guard<std::mutex> lock(inject_mut_);
+            injected_.push_back(std::move(t));
+        }
+        if(nsleeping_.load()) {
+            std::lock_guard<std::mutex> lock(sleep_mut_);
+            sleep_cv_.notify_one();
+        }
+    }
+    // Returns once done() holds, running queued tasks meanwhile. Meant for workers; other threads should block instead.
+    template<typename Pred>
+    void help_until(const Pred &done) {
+        task_type t;
+        while(!done()) {
+            if(pop(t)) t();
+            else std::this_thread::yield();
+        }
+    }
+
+    template<typename Func>
+    void parallel_for_range(size_t begin, size_t end, const Func &func, size_t grain=0);
+    // Calls func(i) for i in [begin, end), in chunks of at most grain indices (by default, about 8 chunks per worker).
+    template<typename Func>
+    void parallel_for(size_t begin, size_t end, const Func &func, size_t grain=0) {
+        parallel_for_range(begin, end, [&func](size_t b, size_t e) {for(;b < e; ++b) func(b);}, grain);
+    }
+};
+
+/*
+ * A set of tasks run on a thread_pool which can be waited for together.
+ * The first exception thrown by a task is rethrown by wait().
+ */
+class task_group {
+    thread_pool &pool_;
+    std::atomic<size_t> pending_{0};
+    std::mutex mut_;
+    std::condition_variable cv_;
+    std::exception_ptr error_;
+    std::atomic<bool> failed_{false};
+public:
+    explicit task_group(thread_pool &pool): pool_(pool) {}
+    ~task_group() {
+        try {wait();} catch(...) {}
+    }
+    thread_pool &pool() const {return pool_;}
+    template<typename Func>
+    void run(Func &&func) {
+        ++pending_;
+        pool_.submit([this, func=std::forward<Func>(func)]() mutable {
+            try {
+                func();
+            } catch(...) {
+                if(!failed_.exchange(true)) error_ = std::current_exception();
+            }
+            // Decremented under the lock so that a waiter cannot destroy the group before notification completes.
+            std::lock_guard<std::mutex> lock(mut_);
+            if(--pending_ == 0) cv_.notify_all();
+        });
+    }
+    void wait() {
+        if(pool_.worker_index() >= 0) {
+            pool_.help_until([this]() {return pending_.load() == 0;});
+            // Synchronize with the last task's unlock before returning.
+            std::lock_guard<std::mutex> lock(mut_);
+        } else {
+            std::unique_lock<std::mutex> lock(mut_);
+            cv_.wait(lock, [this]() {return pending_.load() == 0;});
+        }
+        if(failed_.exchange(false)) {
+            auto e = error_;
+            error_ = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+};
+
+namespace detail {
+template<typename Func>
+void split_range(task_group &g, size_t begin, size_t end, size_t grain, const Func &func) {
+    // Hands off upper halves to be stolen and keeps the lowest piece, so chunks stay large until the pool is busy.
+    while(end - begin > grain) {
+        const size_t mid = begin + (end - begin) / 2;
+        g.run([&g, mid, end, grain, &func]() {split_range(g, mid, end, grain, func);});
+        end = mid;
+    }
+    func(begin, end);
+}
+} // namespace detail
+
+// Calls func(b, e) over disjoint subranges covering [begin, end), each of at most grain indices.
+template<typename Func>
+void thread_pool::parallel_for_range(size_t begin, size_t end, const Func &func, size_t grain) {
+    if(begin >= end) return;
+    if(!grain) grain = std::max((end - begin) / (8 * size()), size_t(1));
+    task_group g(*this);
+    if(worker_index() >= 0) detail::split_range(g, begin, end, grain, func);
+    else g.run([&g, begin, end, grain, &func]() {detail::split_range(g, begin, end, grain, func);});
+    g.wait();
+}
+
+} // inline namespace pool
+} // namespace sketch
+
+#endif // SKETCH_POOL_H__
@@ -110,6 +110,55 @@ static inline FT jmle_simple(const uint64_t lhgt, const uint64_t rhgt, const siz
     static constexpr double INVMUL64 = 5.42101086242752217e-20;
 #endif
 
+namespace detail {
+/*
+ * Lower bound on the first exponential sample, -scale * log(x), where x = rv / 2^64
+ * (or, for long double sketches, x with 32 more random low bits), via -log(x) >= 1 - x.
+ * The absolute and relative slack terms cover rounding in x and in the library log,
+ * so an item whose bound exceeds the sketch's limit is one update() would reject.
+ */
+static inline double first_sample_lower_bound(uint64_t rv, double scale) {
+    return (1. - rv * INVMUL64 - std::numeric_limits<double>::epsilon()) * (scale * (1. - 9.094947017729282379e-13 /* 2^-40 */));
+}
+
+// wy::wyhash64_stateless(&id) for a copy of id, with the 128-bit product assembled from 32-bit halves
+// so that loops over it vectorize.
+static inline uint64_t wyhash64_first(uint64_t id) {
+    const uint64_t seed = id + UINT64_C(0x60bee2bee120fc15), x = seed ^ UINT64_C(0xe7037ed1a0b428db);
+    const uint64_t xl = x & 0xFFFFFFFFu, xh = x >> 32, yl = seed & 0xFFFFFFFFu, yh = seed >> 32;
+    const uint64_t ll = xl * yl, lh = xl * yh, hl = xh * yl, hh = xh * yh;
+    const uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFFu) + (hl & 0xFFFFFFFFu);
+    const uint64_t lo = (mid << 32) | (ll & 0xFFFFFFFFu), hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    return lo ^ hi;
+}
+
+/*
+ * Calls update(ids[i]) for i in [0, n), skipping items whose first sample alone exceeds limit().
+ * limit() only shrinks as items are added, so the bound, checked for a block at a time against the limit
+ * at the start of the block, never drops an item the serial path would keep; results match serial updates exactly.
+ * Returns the number of items skipped.
+ */
+template<typename Update, typename Limit>
+size_t filtered_update_batch(const uint64_t *ids, size_t n, double scale, const Update &update, const Limit &limit) {
+    static constexpr size_t BLOCK = 64;
+    uint64_t rvs[BLOCK];
+    size_t nskipped = 0;
+    for(size_t i = 0; i < n; i += BLOCK) {
+        const size_t nb = std::min(BLOCK, n - i);
+        const double lim = limit();
+        for(size_t k = 0; k < nb; ++k)
+            rvs[k] = wyhash64_first(ids[i + k]);
+        uint64_t pass = 0;
+        for(size_t k = 0; k < nb; ++k)
+            pass |= uint64_t(first_sample_lower_bound(rvs[k], scale) <= lim) << k;
+        nskipped += nb - popcount(pass);
+        for(; pass; pass &= pass - 1)
+            update(ids[i + ctz(pass)]);
+    }
+    return nskipped;
+}
+} // namespace detail
+
 // Implementations of set sketch
 
 template<typename FT>
@@ -418,6 +467,14 @@ public:
             }
         }
     }
+    // Equivalent to update(ids[i]) for each i, but rejects items that cannot change the sketch in bulk.
+    void update_batch(const uint64_t *ids, size_t n) {
+        const size_t nskipped = detail::filtered_update_batch(ids, n, 1. / m_, [this](uint64_t id) {update(id);}, [this]() {return double(max());});
+        total_updates_ += nskipped;
+        if(nskipped) mycard_ = -1.;
+    }
+    template<typename Alloc>
+    void update_batch(const std::vector<uint64_t, Alloc> &ids) {update_batch(ids.data(), ids.size());}
     bool operator==(const CSetSketch<FT> &o) const {
         return same_params(o) && std::equal(data(), data() + m_, o.data());
     }
@@ -993,6 +1050,13 @@ public:
             rv = wy::wyhash64_stateless(&hid);
         }
     }
+    // Equivalent to update(ids[i]) for each i, but rejects items that cannot change the sketch in bulk.
+    void update_batch(const uint64_t *ids, size_t n) {
+        if(detail::filtered_update_batch(ids, n, double(ainv_) / m_, [this](uint64_t id) {update(id);}, [this]() {return double(lowkh_.explim());}))
+            mycard_ = -1.;
+    }
+    template<typename Alloc>
+    void update_batch(const std::vector<uint64_t, Alloc> &ids) {update_batch(ids.data(), ids.size());}
     bool operator==(const SetSketch<ResT, FT> &o) const {
         return same_params(o) && std::equal(data(), data() + m_, o.data());
     }
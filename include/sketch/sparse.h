@@ -365,6 +365,229 @@ inline std::array<double, 3> flatten_and_query(std::vector<uint32_t, Allocator>
     return std::array<double, 3>{std::max(myrep - is, 0.), std::max(orep - is, 0.), std::max(is, 0.)};
 }
 
+/*
+ * HyperLogLog which starts as a list of SparseHLL32 encodings (index, value) and promotes itself
+ * to dense hllbase_t registers once the list would take as much memory as the registers (2^p / 4 entries).
+ * The list is kept as a sorted, one-entry-per-index prefix plus an unsorted tail of recent insertions,
+ * which is merged into the prefix once it outgrows it, or before any query.
+ * Registers match those of an hllbase_t<HashStruct> with the same p fed the same items, as do its estimates.
+ * Merges and comparisons accept any mix of sparse and dense operands; comparisons never densify a sparse operand.
+ * Queries may merge the pending tail, so they are not safe to call concurrently with each other on one sketch.
+ */
+template<typename HashStruct=hash::WangHash>
+class AdaptiveHLL {
+public:
+    using dense_type = hll::hllbase_t<HashStruct>;
+private:
+    uint32_t p_;
+    mutable std::vector<uint32_t> vals_;
+    mutable size_t nsorted_ = 0;
+    std::unique_ptr<dense_type> dense_;
+    HashStruct hf_;
+
+    static constexpr uint32_t sparse_index(uint32_t v) {return SparseHLL32::get_index(v);}
+    // Sorts the tail and merges it into the prefix, keeping the maximum value for each index.
+    void canonicalize() const {
+        if(nsorted_ == vals_.size()) return;
+        std::sort(vals_.begin() + nsorted_, vals_.end());
+        std::inplace_merge(vals_.begin(), vals_.begin() + nsorted_, vals_.end());
+        // Encodings sort by index, then value, so the last of each run of equal indices is its maximum.
+        size_t nfilled = 0;
+        for(size_t i = 0; i < vals_.size(); ++i) {
+            if(i + 1 < vals_.size() && sparse_index(vals_[i]) == sparse_index(vals_[i + 1])) continue;
+            vals_[nfilled++] = vals_[i];
+        }
+        vals_.resize(nfilled);
+        nsorted_ = nfilled;
+    }
+    std::array<uint32_t, 64> sparse_counts() const {
+        std::array<uint32_t, 64> ret{0};
+        for(const auto v: vals_) ++ret[SparseHLL32::get_value(v)];
+        ret[0] = m() - vals_.size();
+        return ret;
+    }
+    // Register histograms of the two operands and of their union.
+    void joint_counts(const AdaptiveHLL &o, std::array<uint32_t, 64> &lsum, std::array<uint32_t, 64> &rsum, std::array<uint32_t, 64> &usum) const {
+        if(p_ != o.p_) throw std::invalid_argument("AdaptiveHLL comparisons require equal p");
+        if(dense_ && o.is_sparse()) {
+            o.joint_counts(*this, rsum, lsum, usum);
+            return;
+        }
+        if(dense_) {
+            // Both dense
+            lsum = hll::detail::sum_counts(dense_->core());
+            rsum = hll::detail::sum_counts(o.dense_->core());
+            usum = std::array<uint32_t, 64>{0};
+            const uint8_t *lp = dense_->data(), *rp = o.dense_->data();
+            for(size_t i = 0; i < m(); ++i) ++usum[std::max(lp[i], rp[i])];
+            return;
+        }
+        lsum = sparse_counts();
+        if(!o.is_sparse()) {
+            // Sparse against dense: start from the dense histogram and move each register the sparse side raises.
+            rsum = usum = hll::detail::sum_counts(o.dense_->core());
+            const uint8_t *rp = o.dense_->data();
+            for(const auto v: vals_) {
+                const uint8_t rv = rp[sparse_index(v)], lv = SparseHLL32::get_value(v);
+                if(lv > rv) --usum[rv], ++usum[lv];
+            }
+            return;
+        }
+        rsum = o.sparse_counts();
+        usum = std::array<uint32_t, 64>{0};
+        size_t nunion = 0;
+        auto il = vals_.cbegin(), ir = o.vals_.cbegin();
+        const auto el = vals_.cend(), er = o.vals_.cend();
+        while(il != el && ir != er) {
+            const uint32_t li = sparse_index(*il), ri = sparse_index(*ir);
+            if(li < ri)      ++usum[SparseHLL32::get_value(*il++)];
+            else if(ri < li) ++usum[SparseHLL32::get_value(*ir++)];
+            else             ++usum[std::max(SparseHLL32::get_value(*il++), SparseHLL32::get_value(*ir++))];
+            ++nunion;
+        }
+        for(;il != el; ++il, ++nunion) ++usum[SparseHLL32::get_value(*il)];
+        for(;ir != er; ++ir, ++nunion) ++usum[SparseHLL32::get_value(*ir)];
+        usum[0] = m() - nunion;
+    }
+    double estimate(const std::array<uint32_t, 64> &counts) const {
+        return hll::detail::ertl_ml_estimate(counts, p_, q());
+    }
+public:
+    template<typename... Args>
+    explicit AdaptiveHLL(unsigned p, Args &&... args): p_(p), hf_(std::forward<Args>(args)...) {
+        if(p < 4 || p > SparseHLL32::max_p()) throw std::invalid_argument(std::string("p must be between 4 and ") + std::to_string(SparseHLL32::max_p()));
+    }
+    AdaptiveHLL(const AdaptiveHLL &o): p_(o.p_), vals_(o.vals_), nsorted_(o.nsorted_), dense_(o.dense_ ? new dense_type(*o.dense_): nullptr), hf_(o.hf_) {}
+    // Moved-from sketches are left empty and sparse, so they remain usable.
+    AdaptiveHLL(AdaptiveHLL &&o): p_(o.p_), vals_(std::move(o.vals_)), nsorted_(o.nsorted_), dense_(std::move(o.dense_)), hf_(std::move(o.hf_)) {
+        o.clear();
+    }
+    AdaptiveHLL &operator=(const AdaptiveHLL &o) {
+        if(this != &o) {
+            p_ = o.p_; vals_ = o.vals_; nsorted_ = o.nsorted_; hf_ = o.hf_;
+            dense_.reset(o.dense_ ? new dense_type(*o.dense_): nullptr);
+        }
+        return *this;
+    }
+    AdaptiveHLL &operator=(AdaptiveHLL &&o) {
+        if(this != &o) {
+            p_ = o.p_; vals_ = std::move(o.vals_); nsorted_ = o.nsorted_; hf_ = std::move(o.hf_);
+            dense_ = std::move(o.dense_);
+            o.clear();
+        }
+        return *this;
+    }
+
+    unsigned p() const {return p_;}
+    unsigned q() const {return 64 - p_;}
+    uint64_t m() const {return uint64_t(1) << p_;}
+    bool is_sparse() const {return !dense_;}
+    // Number of sparse entries past which the dense registers take less memory.
+    size_t sparse_limit() const {return m() / sizeof(uint32_t);}
+    // Bytes used by the current representation's data.
+    size_t nbytes() const {return dense_ ? size_t(m()): vals_.capacity() * sizeof(uint32_t);}
+    const dense_type *dense() const {return dense_.get();}
+
+    INLINE void addh(uint64_t element) {add(hf_(element));}
+    INLINE void add(uint64_t hashval) {
+        if(dense_) {
+            dense_->add(hashval);
+            return;
+        }
+        const uint32_t index = hashval >> q();
+        const uint8_t lzt = clz(((hashval << 1)|1) << (p_ - 1)) + 1;
+        vals_.push_back(SparseHLL32::encode_value(index, lzt));
+        if(vals_.size() - nsorted_ > std::max(nsorted_, size_t(32)) || vals_.size() >= sparse_limit()) {
+            canonicalize();
+            if(vals_.size() >= sparse_limit()) densify();
+        }
+    }
+    // Switches to dense registers.
+    void densify() {
+        if(dense_) return;
+        canonicalize();
+        dense_.reset(new dense_type(p_));
+        auto &core = dense_->mutable_core();
+        for(const auto v: vals_) core[sparse_index(v)] = SparseHLL32::get_value(v);
+        std::vector<uint32_t>().swap(vals_);
+        nsorted_ = 0;
+    }
+    void clear() {
+        dense_.reset();
+        std::vector<uint32_t>().swap(vals_);
+        nsorted_ = 0;
+    }
+    // Sorted (index, value) encodings of the nonzero registers of a sparse sketch.
+    const std::vector<uint32_t> &sparse_values() const {
+        if(dense_) throw std::runtime_error("sparse_values() requires a sparse sketch");
+        canonicalize();
+        return vals_;
+    }
+    std::array<uint32_t, 64> sum_counts() const {
+        if(dense_) return hll::detail::sum_counts(dense_->core());
+        canonicalize();
+        return sparse_counts();
+    }
+    double report() const {return estimate(sum_counts());}
+    double cardinality_estimate() const {return report();}
+
+    AdaptiveHLL &operator+=(const AdaptiveHLL &o) {
+        if(p_ != o.p_) throw std::invalid_argument("AdaptiveHLL merges require equal p");
+        if(!o.dense_) {
+            o.canonicalize();
+            if(dense_) {
+                auto &core = dense_->mutable_core();
+                for(const auto v: o.vals_) {
+                    const uint32_t index = sparse_index(v);
+                    core[index] = std::max(core[index], SparseHLL32::get_value(v));
+                }
+                dense_->not_ready();
+            } else {
+                canonicalize();
+                vals_.insert(vals_.end(), o.vals_.begin(), o.vals_.end());
+                canonicalize();
+                if(vals_.size() >= sparse_limit()) densify();
+            }
+        } else {
+            densify();
+            *dense_ += *o.dense_;
+        }
+        return *this;
+    }
+    AdaptiveHLL operator+(const AdaptiveHLL &o) const {
+        AdaptiveHLL ret(*this);
+        ret += o;
+        return ret;
+    }
+    double union_size(const AdaptiveHLL &o) const {
+        std::array<uint32_t, 64> lsum, rsum, usum;
+        canonicalize(); o.canonicalize();
+        joint_counts(o, lsum, rsum, usum);
+        return estimate(usum);
+    }
+    // Estimated sizes of this \ o, o \ this, and their intersection.
+    std::array<double, 3> full_set_comparison(const AdaptiveHLL &o) const {
+        std::array<uint32_t, 64> lsum, rsum, usum;
+        canonicalize(); o.canonicalize();
+        joint_counts(o, lsum, rsum, usum);
+        const double l = estimate(lsum), r = estimate(rsum), u = estimate(usum), is = std::max(l + r - u, 0.);
+        return std::array<double, 3>{std::max(l - is, 0.), std::max(r - is, 0.), is};
+    }
+    double jaccard_index(const AdaptiveHLL &o) const {
+        std::array<uint32_t, 64> lsum, rsum, usum;
+        canonicalize(); o.canonicalize();
+        joint_counts(o, lsum, rsum, usum);
+        const double u = estimate(usum);
+        // Two empty sketches are identical.
+        if(u == 0.) return 1.;
+        return std::max(estimate(lsum) + estimate(rsum) - u, 0.) / u;
+    }
+    double containment_index(const AdaptiveHLL &o) const {
+        const auto fsc = full_set_comparison(o);
+        return fsc[2] / (fsc[0] + fsc[2]);
+    }
+};
+
 } // sparse
 
 } // sketch
@@ -6,17 +6,39 @@
 #include <atomic>
 #include <cstdio>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "xxHash/xxh3.h"
 #include "flat_hash_map/flat_hash_map.hpp"
 #include "sketch/div.h"
 #include "sketch/integral.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
 namespace sketch {
 using std::uint64_t;
 using std::uint32_t;
 
+inline namespace pool {
+class thread_pool; // See pool.h, which callers of the overloads taking one include.
+}
+
 namespace lsh {
+namespace detail {
+// Overloads taking a thread_pool are templates restricted to it, so that only its declaration is needed here.
+template<typename Pool>
+using if_thread_pool_t = std::enable_if_t<std::is_same<Pool, thread_pool>::value>;
+} // namespace detail
+
 static inline constexpr uint64_t _wymum(uint64_t x, uint64_t y) {
     __uint128_t l = x;
     l *= y;
@@ -30,6 +52,284 @@ static inline constexpr uint64_t wyhash64_stateless(uint64_t *seed) {
 }
 
 
+/*
+ * Immutable, CSR-style form of a SetSketchIndex's tables, produced by SetSketchIndex::freeze().
+ *
+ * All tables share two arrays: entries, (key, offset) pairs sorted by key within each table, and ids,
+ * each bucket's ids stored contiguously from its offset to the next entry's. A per-table directory on
+ * the top bits of the key (one slot per four keys) narrows each lookup to a cache line or so of entries,
+ * so a probe costs a directory read, an entry read and the ids, instead of a hash slot plus a separately
+ * allocated vector.
+ * Keys are stored next to their offsets, rather than in a separate array, to save a cache miss per probe.
+ *
+ * The in-memory and on-disk forms are the same buffer, so an index can be written once and mmap'd later.
+ * Layout (native byte order, every section starting on an 8-byte boundary):
+ *   header (ssi_frozen_header_t)
+ *   dir_bits       [ntables]       uint8_t   directory size of each table, as log2(entries - 1)
+ *   regs_per_reg   [nsettings]     uint64_t
+ *   setting_begin  [nsettings + 1] uint64_t  first table of each registers-per-key setting
+ *   key_begin      [ntables + 1]   uint64_t  first key of each table
+ *   dir_begin      [ntables + 1]   uint64_t  first directory entry of each table
+ *   dir            [ndir]          uint32_t  key index (relative to the table) of each top-bits prefix
+ *   entries        [nkeys + 1]     entry_type, the last holding only the total number of ids
+ *   ids            [nids]          IdT
+ */
+struct ssi_frozen_header_t {
+    char     magic_[8];
+    uint32_t version_;
+    uint8_t  key_bytes_, id_bytes_, bottomk_, pad_;
+    uint64_t m_;
+    uint64_t nsettings_;
+    uint64_t ntables_;
+    uint64_t nkeys_;
+    uint64_t nids_;
+    uint64_t total_ids_;
+};
+static_assert(sizeof(ssi_frozen_header_t) == 64, "frozen SetSketchIndex header must occupy one cache line");
+static constexpr char SSI_FROZEN_MAGIC[8] {'S', 'K', 'S', 'S', 'I', 'F', 'Z', '\0'};
+static constexpr uint32_t SSI_FROZEN_VERSION = 1;
+
+template<typename KeyT, typename IdT>
+class FrozenTables {
+    static_assert(std::is_integral<KeyT>::value && std::is_unsigned<KeyT>::value, "Frozen tables require unsigned integral keys");
+    static constexpr unsigned KEYBITS = sizeof(KeyT) * CHAR_BIT;
+    std::vector<uint64_t>   buf_; // owned storage, when not mapped
+    const uint8_t          *map_ = nullptr;
+    size_t                mapsz_ = 0;
+    const ssi_frozen_header_t *hdr_ = nullptr;
+public:
+    // With a KeyT narrower than 8 bytes, entries are padded. Members are stored one at a time into the zeroed buffer,
+    // never by copying a whole entry, so the padding stays zero and identical indexes are written identically.
+    struct entry_type {
+        KeyT     key;
+        uint64_t offset;
+    };
+private:
+    const uint64_t *regs_per_reg_ = nullptr, *setting_begin_ = nullptr, *key_begin_ = nullptr, *dir_begin_ = nullptr;
+    const uint8_t  *dir_bits_ = nullptr;
+    const uint32_t *dir_ = nullptr;
+    const entry_type *entries_ = nullptr;
+    const IdT      *ids_ = nullptr;
+    size_t          ndir_ = 0;
+
+    static size_t align8(size_t x) {return (x + 7) & ~size_t(7);}
+    // Sets section pointers from the header and dir_bits, checking that every section lies within nbytes.
+    void bind(const uint8_t *data, size_t nbytes) {
+        if(nbytes < sizeof(ssi_frozen_header_t)) throw std::runtime_error("Too small to be a frozen SetSketchIndex");
+        hdr_ = reinterpret_cast<const ssi_frozen_header_t *>(data);
+        if(std::memcmp(hdr_->magic_, SSI_FROZEN_MAGIC, sizeof(SSI_FROZEN_MAGIC)))
+            throw std::runtime_error("Not a frozen SetSketchIndex (bad magic)");
+        if(hdr_->version_ != SSI_FROZEN_VERSION)
+            throw std::runtime_error("Unsupported frozen SetSketchIndex version " + std::to_string(hdr_->version_));
+        if(hdr_->key_bytes_ != sizeof(KeyT) || hdr_->id_bytes_ != sizeof(IdT))
+            throw std::runtime_error("Frozen SetSketchIndex key/id widths do not match the requested types");
+        size_t off = sizeof(ssi_frozen_header_t);
+        auto section = [&](size_t count, size_t width) {
+            const size_t start = off;
+            if(count > (nbytes - std::min(off, nbytes)) / width) throw std::runtime_error("Truncated or corrupt frozen SetSketchIndex");
+            off = align8(off + count * width);
+            return data + start;
+        };
+        const uint64_t nset = hdr_->nsettings_, ntab = hdr_->ntables_;
+        dir_bits_      = section(ntab, 1);
+        ndir_ = 0;
+        for(size_t t = 0; t < ntab; ++t) {
+            if(dir_bits_[t] > 30) throw std::runtime_error("Corrupt frozen SetSketchIndex directory");
+            ndir_ += (size_t(1) << dir_bits_[t]) + 1;
+        }
+        regs_per_reg_  = reinterpret_cast<const uint64_t *>(section(nset, 8));
+        setting_begin_ = reinterpret_cast<const uint64_t *>(section(nset + 1, 8));
+        key_begin_     = reinterpret_cast<const uint64_t *>(section(ntab + 1, 8));
+        dir_begin_     = reinterpret_cast<const uint64_t *>(section(ntab + 1, 8));
+        dir_           = reinterpret_cast<const uint32_t *>(section(ndir_, 4));
+        entries_       = reinterpret_cast<const entry_type *>(section(hdr_->nkeys_ + 1, sizeof(entry_type)));
+        ids_           = reinterpret_cast<const IdT *>(section(hdr_->nids_, sizeof(IdT)));
+    }
+    void validate() const {
+        const uint64_t nset = hdr_->nsettings_, ntab = hdr_->ntables_;
+        if(setting_begin_[nset] != ntab || key_begin_[ntab] != hdr_->nkeys_ || dir_begin_[ntab] != ndir_ || entries_[hdr_->nkeys_].offset != hdr_->nids_)
+            throw std::runtime_error("Truncated or corrupt frozen SetSketchIndex");
+    }
+    void release() {
+        if(map_) ::munmap(const_cast<uint8_t *>(map_), mapsz_);
+        map_ = nullptr; mapsz_ = 0; hdr_ = nullptr;
+        buf_.clear(); buf_.shrink_to_fit();
+    }
+public:
+    FrozenTables() {}
+    FrozenTables(const FrozenTables &) = delete;
+    FrozenTables &operator=(const FrozenTables &) = delete;
+    FrozenTables(FrozenTables &&o) noexcept {*this = std::move(o);}
+    FrozenTables &operator=(FrozenTables &&o) noexcept {
+        // Owned buffers do not move in memory when the vector is moved, so section pointers stay valid.
+        std::swap(buf_, o.buf_); std::swap(map_, o.map_); std::swap(mapsz_, o.mapsz_); std::swap(hdr_, o.hdr_);
+        std::swap(regs_per_reg_, o.regs_per_reg_); std::swap(setting_begin_, o.setting_begin_);
+        std::swap(key_begin_, o.key_begin_); std::swap(dir_begin_, o.dir_begin_);
+        std::swap(dir_bits_, o.dir_bits_); std::swap(dir_, o.dir_); std::swap(entries_, o.entries_); std::swap(ids_, o.ids_); std::swap(ndir_, o.ndir_);
+        return *this;
+    }
+    ~FrozenTables() {release();}
+
+    /*
+     * Builds from tables[s][j], a list of (key, bucket) pairs for table j of setting s.
+     * Buckets are consumed (cleared) as they are copied, to bound peak memory.
+     */
+    template<typename Bucket>
+    FrozenTables(size_t m, const std::vector<uint64_t> &regs_per_reg, std::vector<std::vector<std::vector<std::pair<KeyT, Bucket>>>> &tables, size_t total_ids, bool bottomk) {
+        const size_t nset = tables.size();
+        size_t ntab = 0, nkeys = 0, nids = 0, ndir = 0;
+        std::vector<uint8_t> bits;
+        for(auto &settab: tables) {
+            for(auto &tab: settab) {
+                std::sort(tab.begin(), tab.end(), [](const auto &x, const auto &y) {return x.first < y.first;});
+                if(tab.size() > std::numeric_limits<uint32_t>::max())
+                    throw std::runtime_error("Frozen SetSketchIndex tables are limited to 2^32 keys each");
+                const unsigned b = tab.size() > 8 ? std::min(unsigned(ilog2(tab.size())) - 3, std::min(KEYBITS, 30u)): 0u;
+                bits.push_back(b);
+                ndir += (size_t(1) << b) + 1;
+                nkeys += tab.size();
+                for(const auto &pair: tab) nids += pair.second.size();
+                ++ntab;
+            }
+        }
+        size_t nbytes = sizeof(ssi_frozen_header_t);
+        for(const size_t sec: {ntab, nset * 8, (nset + 1) * 8, (ntab + 1) * 8, (ntab + 1) * 8, ndir * 4, (nkeys + 1) * sizeof(entry_type), nids * sizeof(IdT)})
+            nbytes = align8(nbytes + sec);
+        buf_.assign(nbytes / 8, uint64_t(0));
+        uint8_t *data = reinterpret_cast<uint8_t *>(buf_.data());
+        ssi_frozen_header_t hdr;
+        std::memset(&hdr, 0, sizeof(hdr));
+        std::memcpy(hdr.magic_, SSI_FROZEN_MAGIC, sizeof(SSI_FROZEN_MAGIC));
+        hdr.version_ = SSI_FROZEN_VERSION;
+        hdr.key_bytes_ = sizeof(KeyT); hdr.id_bytes_ = sizeof(IdT); hdr.bottomk_ = bottomk;
+        hdr.m_ = m; hdr.nsettings_ = nset; hdr.ntables_ = ntab; hdr.nkeys_ = nkeys; hdr.nids_ = nids; hdr.total_ids_ = total_ids;
+        std::memcpy(data, &hdr, sizeof(hdr));
+        std::memcpy(data + sizeof(hdr), bits.data(), ntab);
+        bind(data, nbytes);
+        uint64_t *rpr = const_cast<uint64_t *>(regs_per_reg_), *setting_begin = const_cast<uint64_t *>(setting_begin_),
+                 *key_begin = const_cast<uint64_t *>(key_begin_), *dir_begin = const_cast<uint64_t *>(dir_begin_);
+        setting_begin[0] = key_begin[0] = dir_begin[0] = 0;
+        for(size_t t = 0, ti = 0; t < nset; ++t) {
+            rpr[t] = regs_per_reg[t];
+            setting_begin[t + 1] = setting_begin[t] + tables[t].size();
+            for(const auto &tab: tables[t]) {
+                key_begin[ti + 1] = key_begin[ti] + tab.size();
+                dir_begin[ti + 1] = dir_begin[ti] + (size_t(1) << bits[ti]) + 1;
+                ++ti;
+            }
+        }
+        uint32_t *dir = const_cast<uint32_t *>(dir_);
+        entry_type *entries = const_cast<entry_type *>(entries_);
+        IdT *ids = const_cast<IdT *>(ids_);
+        size_t ki = 0, ii = 0, ti = 0;
+        for(auto &settab: tables) {
+            for(auto &tab: settab) {
+                const unsigned b = bits[ti];
+                uint32_t *tdir = dir + dir_begin_[ti];
+                size_t slot = 0;
+                for(size_t k = 0; k < tab.size(); ++k) {
+                    const size_t prefix = b ? size_t(uint64_t(tab[k].first) >> (KEYBITS - b)): 0;
+                    while(slot <= prefix) tdir[slot++] = k;
+                    entries[ki].key = tab[k].first, entries[ki++].offset = ii;
+                    for(const auto id: tab[k].second) ids[ii++] = id;
+                    Bucket().swap(tab[k].second);
+                }
+                while(slot <= (size_t(1) << b)) tdir[slot++] = tab.size();
+                std::vector<std::pair<KeyT, Bucket>>().swap(tab);
+                ++ti;
+            }
+        }
+        entries[nkeys].key = KeyT(0), entries[nkeys].offset = nids;
+        assert(ki == nkeys && ii == nids);
+    }
+    // Maps a file written by write(). The mapping is released with this object.
+    explicit FrozenTables(const std::string &path, bool populate=false) {
+        int fd = ::open(path.data(), O_RDONLY);
+        if(fd < 0) throw std::runtime_error(std::string("Could not open file at '") + path + "' for reading");
+        struct stat st;
+        if(::fstat(fd, &st)) {
+            ::close(fd);
+            throw std::runtime_error(std::string("Could not stat ") + path);
+        }
+        mapsz_ = st.st_size;
+        if(mapsz_ < sizeof(ssi_frozen_header_t)) {
+            ::close(fd);
+            throw std::runtime_error(path + " is too small to be a frozen SetSketchIndex");
+        }
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        if(populate) flags |= MAP_POPULATE;
+#endif
+        void *ptr = ::mmap(nullptr, mapsz_, PROT_READ, flags, fd, 0);
+        ::close(fd);
+        if(ptr == MAP_FAILED) throw std::runtime_error(std::string("Failed to mmap ") + path);
+        map_ = static_cast<const uint8_t *>(ptr);
+        try {
+            bind(map_, mapsz_);
+            validate();
+        } catch(const std::runtime_error &e) {
+            release();
+            throw std::runtime_error(path + ": " + e.what());
+        }
+    }
+    void write(const std::string &path) const {
+        std::FILE *fp = std::fopen(path.data(), "wb");
+        if(fp == nullptr) throw std::runtime_error(std::string("Could not open file at '") + path + "' for writing");
+        const size_t nb = nbytes();
+        const bool ok = std::fwrite(data(), 1, nb, fp) == nb;
+        if(std::fclose(fp) || !ok) throw std::runtime_error(std::string("Failed to write to ") + path);
+    }
+
+    explicit operator bool() const {return hdr_ != nullptr;}
+    const uint8_t *data() const {return map_ ? map_: reinterpret_cast<const uint8_t *>(buf_.data());}
+    size_t nbytes() const {return map_ ? mapsz_: buf_.size() * sizeof(uint64_t);}
+    size_t m() const {return hdr_->m_;}
+    size_t total_ids() const {return hdr_->total_ids_;}
+    bool bottomk() const {return hdr_->bottomk_;}
+    size_t nsettings() const {return hdr_->nsettings_;}
+    size_t nkeys() const {return hdr_->nkeys_;}
+    size_t nids() const {return hdr_->nids_;}
+    uint64_t regs_per_reg(size_t i) const {return regs_per_reg_[i];}
+    size_t nsubtables(size_t i) const {return setting_begin_[i + 1] - setting_begin_[i];}
+
+    // Ids stored under key in table j of setting i, as a [begin, end) range.
+    std::pair<const IdT *, const IdT *> find(size_t i, size_t j, KeyT key) const {
+        const uint32_t *slot = dir_slot(setting_begin_[i] + j, key);
+        return search(setting_begin_[i] + j, slot, key);
+    }
+    /*
+     * find() for keys[j] in table j of setting i, for each j < nsubtables(i).
+     * Probes are independent but each is a chain of dependent loads (directory, entries, ids),
+     * so they are advanced in stages across a group of tables, prefetching the next level for all of them.
+     */
+    void find_all(size_t i, const KeyT *keys, std::pair<const IdT *, const IdT *> *out) const {
+        static constexpr size_t GROUP = 16;
+        const uint32_t *slots[GROUP];
+        const size_t tb = setting_begin_[i], n = nsubtables(i);
+        for(size_t gb = 0; gb < n; gb += GROUP) {
+            const size_t ge = std::min(gb + GROUP, n);
+            for(size_t j = gb; j < ge; ++j)
+                __builtin_prefetch(slots[j - gb] = dir_slot(tb + j, keys[j]));
+            for(size_t j = gb; j < ge; ++j)
+                __builtin_prefetch(entries_ + key_begin_[tb + j] + *slots[j - gb]);
+            for(size_t j = gb; j < ge; ++j)
+                __builtin_prefetch((out[j] = search(tb + j, slots[j - gb], keys[j])).first);
+        }
+    }
+private:
+    const uint32_t *dir_slot(size_t t, KeyT key) const {
+        const unsigned b = dir_bits_[t];
+        return dir_ + dir_begin_[t] + (b ? size_t(uint64_t(key) >> (KEYBITS - b)): size_t(0));
+    }
+    std::pair<const IdT *, const IdT *> search(size_t t, const uint32_t *slot, KeyT key) const {
+        const entry_type *tentries = entries_ + key_begin_[t];
+        const entry_type *eb = tentries + slot[0], *ee = tentries + slot[1];
+        const entry_type *it = std::lower_bound(eb, ee, key, [](const entry_type &e, KeyT k) {return e.key < k;});
+        if(it == ee || it->key != key) return {ids_, ids_};
+        return {ids_ + it->offset, ids_ + it[1].offset};
+    }
+};
+
 template<typename KeyT=uint64_t, typename IdT=uint32_t>
 struct SetSketchIndex {
     /*
@@ -40,16 +340,100 @@ private:
     size_t m_;
     using HashMap = ska::flat_hash_map<KeyT, std::vector<IdT>>;
     using HashV = std::vector<HashMap>;
-    std::vector<HashV> packed_maps_;
+    using HashV2 = std::vector<HashV>;
+    HashV2 packed_maps_;
     std::vector<uint64_t> regs_per_reg_;
     std::atomic<size_t> total_ids_;
     bool is_bottomk_only_ = false;
+    // Concurrent mode: each logical table is split into nshards_ maps by key,
+    // and each map is guarded by one of a striped pool of locks.
+    size_t nshards_ = 1;
+    unsigned shard_shift_ = 64;
+    std::vector<size_t> table_offsets_;
+    std::unique_ptr<std::mutex[]> locks_;
+    size_t lock_mask_ = 0;
+    // Set by freeze() or when loading a frozen index; packed_maps_ is then empty.
+    FrozenTables<KeyT, IdT> frozen_;
+    void check_mutable() const {
+        if(frozen()) throw std::runtime_error("Cannot modify a frozen SetSketchIndex");
+    }
 public:
     using key_type = KeyT;
     using id_type = IdT;
     size_t m() const {return m_;}
     size_t size() const {return total_ids_.load();}
-    size_t ntables() const {return packed_maps_.size();}
+    size_t ntables() const {return regs_per_reg_.size();}
+    size_t nshards() const {return nshards_;}
+    bool concurrent() const {return locks_ != nullptr;}
+    bool frozen() const {return bool(frozen_);}
+    // Number of tables for the i-th registers-per-key setting.
+    size_t nsubtables(size_t i) const {return frozen() ? frozen_.nsubtables(i): packed_maps_[i].size() / nshards_;}
+
+    /*
+     * Converts the index into a read-only CSR layout (see FrozenTables), releasing the hash tables.
+     * Queries return the same results as before, with ids in the same order.
+     * Afterwards, updates throw, and the index can be saved with write_frozen().
+     */
+    void freeze() {
+        if(frozen()) return;
+        std::vector<std::vector<std::vector<std::pair<KeyT, std::vector<IdT>>>>> tables(packed_maps_.size());
+        for(size_t i = 0; i < packed_maps_.size(); ++i) {
+            const size_t nsubs = nsubtables(i);
+            tables[i].resize(nsubs);
+            for(size_t j = 0; j < nsubs; ++j) {
+                for(size_t sh = 0; sh < nshards_; ++sh) {
+                    auto &map = packed_maps_[i][j * nshards_ + sh];
+                    for(auto &pair: map) tables[i][j].emplace_back(pair.first, std::move(pair.second));
+                    HashMap().swap(map);
+                }
+            }
+        }
+        frozen_ = FrozenTables<KeyT, IdT>(m_, regs_per_reg_, tables, size(), is_bottomk_only_);
+        HashV2().swap(packed_maps_);
+        locks_.reset();
+        table_offsets_.clear();
+        nshards_ = 1; shard_shift_ = 64;
+    }
+    size_t frozen_nbytes() const {return frozen() ? frozen_.nbytes(): size_t(0);}
+    void write_frozen(const std::string &path) const {
+        if(!frozen()) throw std::runtime_error("write_frozen requires a frozen SetSketchIndex; call freeze() first");
+        frozen_.write(path);
+    }
+    // Maps a frozen index written by write_frozen. The file must not be modified while in use.
+    explicit SetSketchIndex(const std::string &path, bool populate=false): frozen_(path, populate) {
+        m_ = frozen_.m();
+        total_ids_.store(frozen_.total_ids());
+        is_bottomk_only_ = frozen_.bottomk();
+        for(size_t i = 0; i < frozen_.nsettings(); ++i) regs_per_reg_.push_back(frozen_.regs_per_reg(i));
+    }
+
+    /*
+     * Allows update, update_query and query_candidates to be called from many threads at once.
+     * Each table is split into nshards maps by key, so threads only contend when touching the same shard of the same table.
+     * Must not itself be called concurrently with other operations. Existing entries are redistributed.
+     */
+    void make_concurrent(size_t nshards=64, size_t nlocks=size_t(1) << 14) {
+        check_mutable();
+        if(!nshards || (nshards & (nshards - 1)) || !nlocks || (nlocks & (nlocks - 1)))
+            throw std::invalid_argument("nshards and nlocks must be powers of two");
+        const size_t oldnshards = nshards_;
+        shard_shift_ = 64 - ilog2(nshards);
+        for(auto &subtab: packed_maps_) {
+            const size_t ntabs = subtab.size() / oldnshards;
+            HashV newsubtab(ntabs * nshards);
+            for(size_t j = 0; j < ntabs; ++j)
+                for(size_t os = 0; os < oldnshards; ++os)
+                    for(auto &pair: subtab[j * oldnshards + os])
+                        newsubtab[j * nshards + shard_of(pair.first)].emplace(pair.first, std::move(pair.second));
+            subtab = std::move(newsubtab);
+        }
+        nshards_ = nshards;
+        table_offsets_.resize(packed_maps_.size());
+        for(size_t i = 0, off = 0; i < packed_maps_.size(); off += packed_maps_[i++].size())
+            table_offsets_[i] = off;
+        locks_.reset(new std::mutex[nlocks]);
+        lock_mask_ = nlocks - 1;
+    }
     template<typename IT, typename Alloc, typename OIT, typename OAlloc>
     SetSketchIndex(size_t m, const std::vector<IT, Alloc> &nperhashes, const std::vector<OIT, OAlloc> &nperrows): m_(m) {
         if(nperhashes.size() != nperrows.size()) throw std::invalid_argument("SetSketchIndex requires nperrows and nperhashes have the same size");
@@ -97,6 +481,7 @@ public:
     std::tuple<std::vector<IdT>, std::vector<uint32_t>, std::vector<uint32_t>>
     update_query(const Sketch &item, size_t maxcand, size_t starting_idx = size_t(-1)) {
         if(item.size() < m_) throw std::invalid_argument(std::string("Item has wrong size: ") + std::to_string(item.size()) + ", expected" + std::to_string(m_));
+        check_mutable();
         if(starting_idx == size_t(-1) || starting_idx > regs_per_reg_.size()) starting_idx = regs_per_reg_.size();
         const size_t my_id = std::atomic_fetch_add(&total_ids_, size_t(1));
         //std::fprintf(stderr, "Inserting id = %zu\n", my_id);
@@ -106,12 +491,11 @@ public:
         std::vector<uint32_t> items_per_row;
         rset.reserve(maxcand); passing_ids.reserve(maxcand); items_per_row.reserve(starting_idx);
         for(size_t i = 0; i < n_subtable_lists; ++i) {
-            auto &subtab = packed_maps_[i];
-            const size_t nsubs = subtab.size();
+            const size_t nsubs = nsubtables(i);
             for(size_t j = 0; j < nsubs; ++j) {
-                assert(j < subtab.size());
-                auto &table = subtab[j];
                 KeyT myhash = hash_index(item, i, j);
+                auto &table = submap(i, j, myhash);
+                auto lock = lock_submap(i, j, myhash);
                 auto it = table.find(myhash);
                 if(it == table.end()) {
                     table.emplace(myhash, std::vector<IdT>{static_cast<IdT>(my_id)});
@@ -145,11 +529,13 @@ public:
     }
     template<typename Sketch>
     std::tuple<std::vector<IdT>, std::vector<uint32_t>, std::vector<uint32_t>> update_query_bottomk(const Sketch &item, size_t maxtoquery=-1) {
+        check_mutable();
         std::fprintf(stderr, "Warning: bottom-k update-query is untested\n");
         std::map<IdT, uint32_t> matches;
-        auto &map = packed_maps_.front().front();
         const size_t my_id = std::atomic_fetch_add(&total_ids_, size_t(1));
         for(const auto v: item) {
+            auto &map = submap(0, 0, v);
+            auto lock = lock_submap(0, 0, v);
             auto it = map.find(v);
             if(it == map.end()) map.emplace(v, std::vector<IdT>{static_cast<IdT>(my_id)});
             else {
@@ -174,32 +560,62 @@ public:
     }
     template<typename Sketch>
     void insert_bottomk(const Sketch &item, size_t my_id) {
-        auto &map = packed_maps_.front().front();
+        check_mutable();
         for(const auto v: item) {
+            auto &map = submap(0, 0, v);
+            auto lock = lock_submap(0, 0, v);
             auto it = map.find(v);
             if(it == map.end()) {
                 map.emplace(v, std::vector<IdT>{IdT(my_id)});
             } else it->second.emplace_back(my_id);
         }
     }
+    // Returns the id assigned to item.
     template<typename Sketch>
-    void update(const Sketch &item) {
-        if(item.size() < m_) throw std::invalid_argument(std::string("Item has wrong size: ") + std::to_string(item.size()) + ", expected" + std::to_string(m_));
+    size_t update(const Sketch &item) {
+        check_mutable();
+        check_size(item);
         const size_t my_id = std::atomic_fetch_add(&total_ids_, size_t(1));
-        if(is_bottomk_only_) {
-            insert_bottomk(item, my_id);
-            return;
-        }
-        const size_t n_subtable_lists = regs_per_reg_.size();
-        for(size_t i = 0; i < n_subtable_lists; ++i) {
-            auto &subtab = packed_maps_[i];
-            const size_t nsubs = subtab.size();
-            for(size_t j = 0; j < nsubs; ++j) {
-                KeyT myhash = hash_index(item, i, j);
-                assert(j < subtab.size());
-                subtab[j][myhash].push_back(my_id);
-            }
-        }
+        insert(item, my_id);
+        return my_id;
+    }
+    /*
+     * Inserts items[0, n) over pool's workers, with ids first, first + 1, ... in item order, and returns first.
+     * Requires make_concurrent(); as with concurrent update calls, ids within a bucket may be in any order.
+     */
+    template<typename Sketch, typename Pool, typename=detail::if_thread_pool_t<Pool>>
+    size_t update_batch(const Sketch *items, size_t n, Pool &pool) {
+        check_mutable();
+        if(!concurrent()) throw std::runtime_error("update_batch requires a concurrent SetSketchIndex; call make_concurrent() first");
+        for(size_t i = 0; i < n; ++i) check_size(items[i]);
+        const size_t first = std::atomic_fetch_add(&total_ids_, n);
+        pool.parallel_for(0, n, [&](size_t i) {insert(items[i], first + i);});
+        return first;
+    }
+    template<typename Sketch, typename Alloc, typename Pool, typename=detail::if_thread_pool_t<Pool>>
+    size_t update_batch(const std::vector<Sketch, Alloc> &items, Pool &pool) {
+        return update_batch(items.data(), items.size(), pool);
+    }
+    size_t shard_of(KeyT key) const {
+        // Must be independent of the maps' own fibonacci hashing, or each shard's keys would share bucket bits.
+        const uint64_t k = uint64_t(key);
+        return shard_shift_ >= 64 ? 0: ((k ^ (k >> 31)) * 0xD6E8FEB86659FD93ull) >> shard_shift_;
+    }
+    // Map holding key in table j of the i-th setting, and the (possibly empty) lock guarding it.
+    HashMap &submap(size_t i, size_t j, KeyT key) {return packed_maps_[i][j * nshards_ + shard_of(key)];}
+    const HashMap &submap(size_t i, size_t j, KeyT key) const {return packed_maps_[i][j * nshards_ + shard_of(key)];}
+    std::unique_lock<std::mutex> lock_submap(size_t i, size_t j, KeyT key) const {
+        if(!locks_) return std::unique_lock<std::mutex>();
+        return std::unique_lock<std::mutex>(locks_[(table_offsets_[i] + j * nshards_ + shard_of(key)) & lock_mask_]);
+    }
+    // Ids stored under key in table j of the i-th setting, as a [begin, end) range.
+    // In concurrent mode, hold lock_submap(i, j, key) while reading them.
+    std::pair<const IdT *, const IdT *> bucket(size_t i, size_t j, KeyT key) const {
+        if(frozen()) return frozen_.find(i, j, key);
+        const auto &table = submap(i, j, key);
+        auto it = table.find(key);
+        if(it == table.end()) return {nullptr, nullptr};
+        return {it->second.data(), it->second.data() + it->second.size()};
     }
     template<typename Sketch>
     KeyT hash_index(const Sketch &item, size_t i, size_t j) const {
@@ -218,41 +634,126 @@ public:
             XXH64_update(&state, &item[div.mod(wyhash64_stateless(&seed))], ITEMSIZE);
         return XXH64_digest(&state);
     }
+    using candidate_type = std::tuple<std::vector<IdT>, std::vector<uint32_t>, std::vector<uint32_t>>;
     template<typename Sketch>
-    std::tuple<std::vector<IdT>, std::vector<uint32_t>, std::vector<uint32_t>>
-    query_candidates(const Sketch &item, size_t maxcand, size_t starting_idx = size_t(-1)) const {
-        if(starting_idx == size_t(-1) || starting_idx > regs_per_reg_.size()) starting_idx = regs_per_reg_.size();
+    candidate_type query_candidates(const Sketch &item, size_t maxcand, size_t starting_idx = size_t(-1)) const {
         /*
          *  Returns ids matching input minhash sketches, in order from most specific/least sensitive
          *  to least specific/most sensitive
          *  Can be then used, along with sketches, to select nearest neighbors
          *  */
         ska::flat_hash_map<IdT, uint32_t> rset;
+        rset.reserve(maxcand);
+        return query_candidates_impl(item, maxcand, starting_idx, [&rset](IdT id) -> uint32_t & {return rset[id];}, [](IdT) {});
+    }
+    /*
+     * query_candidates for each of nitems sketches, returning the same tuples.
+     * Each thread counts matches in a dense array indexed by id instead of a hash map,
+     * resetting only the entries a query touched, so the array is allocated once per thread rather than per query.
+     * Queries are distributed over nthreads threads when built with OpenMP.
+     */
+    template<typename Sketch>
+    std::vector<candidate_type> query_candidates_batch(const Sketch *items, size_t nitems, size_t maxcand, size_t starting_idx = size_t(-1), int nthreads=1) const {
+        std::vector<candidate_type> ret(nitems);
+        (void)nthreads;
+        OMP_PRAGMA("omp parallel num_threads(nthreads > 0 ? nthreads: omp_get_max_threads())")
+        {
+            std::vector<uint32_t> counts(size());
+            OMP_PRAGMA("omp for schedule(dynamic)")
+            for(size_t i = 0; i < nitems; ++i)
+                ret[i] = query_candidates_dense(items[i], maxcand, starting_idx, counts);
+        }
+        return ret;
+    }
+    template<typename Sketch, typename Alloc>
+    std::vector<candidate_type> query_candidates_batch(const std::vector<Sketch, Alloc> &items, size_t maxcand, size_t starting_idx = size_t(-1), int nthreads=1) const {
+        return query_candidates_batch(items.data(), items.size(), maxcand, starting_idx, nthreads);
+    }
+    // As above, with queries distributed over pool's workers, each chunk of them sharing one count array.
+    template<typename Sketch, typename Pool, typename=detail::if_thread_pool_t<Pool>>
+    std::vector<candidate_type> query_candidates_batch(const Sketch *items, size_t nitems, size_t maxcand, Pool &pool, size_t starting_idx = size_t(-1)) const {
+        std::vector<candidate_type> ret(nitems);
+        pool.parallel_for_range(0, nitems, [&](size_t b, size_t e) {
+            std::vector<uint32_t> counts(size());
+            for(; b < e; ++b) ret[b] = query_candidates_dense(items[b], maxcand, starting_idx, counts);
+        });
+        return ret;
+    }
+    template<typename Sketch, typename Alloc, typename Pool, typename=detail::if_thread_pool_t<Pool>>
+    std::vector<candidate_type> query_candidates_batch(const std::vector<Sketch, Alloc> &items, size_t maxcand, Pool &pool, size_t starting_idx = size_t(-1)) const {
+        return query_candidates_batch(items.data(), items.size(), maxcand, pool, starting_idx);
+    }
+private:
+    template<typename Sketch>
+    void check_size(const Sketch &item) const {
+        if(item.size() < m_) throw std::invalid_argument(std::string("Item has wrong size: ") + std::to_string(item.size()) + ", expected" + std::to_string(m_));
+    }
+    template<typename Sketch>
+    void insert(const Sketch &item, size_t my_id) {
+        if(is_bottomk_only_) {
+            insert_bottomk(item, my_id);
+            return;
+        }
+        const size_t n_subtable_lists = regs_per_reg_.size();
+        for(size_t i = 0; i < n_subtable_lists; ++i) {
+            const size_t nsubs = nsubtables(i);
+            for(size_t j = 0; j < nsubs; ++j) {
+                KeyT myhash = hash_index(item, i, j);
+                auto &table = submap(i, j, myhash);
+                auto lock = lock_submap(i, j, myhash);
+                table[myhash].push_back(my_id);
+            }
+        }
+    }
+    // query_candidates counting matches in counts, a dense array indexed by id which is all zeros before and after.
+    template<typename Sketch>
+    candidate_type query_candidates_dense(const Sketch &item, size_t maxcand, size_t starting_idx, std::vector<uint32_t> &counts) const {
+        // Ids inserted concurrently with the batch may exceed the snapshot size.
+        auto counter = [&counts](IdT id) -> uint32_t & {
+            if(size_t(id) >= counts.size()) counts.resize(size_t(id) + 1);
+            return counts[id];
+        };
+        return query_candidates_impl(item, maxcand, starting_idx, counter, [&counts](IdT id) {counts[id] = 0;});
+    }
+    // counter(id) returns a reference to id's match count, zero the first time id is seen;
+    // reset(id) is called for every returned id once its count has been read.
+    template<typename Sketch, typename Counter, typename Reset>
+    candidate_type query_candidates_impl(const Sketch &item, size_t maxcand, size_t starting_idx, const Counter &counter, const Reset &reset) const {
+        if(starting_idx == size_t(-1) || starting_idx > regs_per_reg_.size()) starting_idx = regs_per_reg_.size();
         std::vector<IdT> passing_ids;
         std::vector<uint32_t> items_per_row;
-        rset.reserve(maxcand); passing_ids.reserve(maxcand); items_per_row.reserve(starting_idx);
+        passing_ids.reserve(std::min(maxcand, size())); items_per_row.reserve(starting_idx);
+        auto count = [&](std::pair<const IdT *, const IdT *> ids) {
+            for(const IdT *idp = ids.first; idp != ids.second; ++idp) {
+                if(!counter(*idp)++) passing_ids.push_back(*idp);
+            }
+        };
+        std::vector<KeyT> keys;
+        std::vector<std::pair<const IdT *, const IdT *>> ranges;
         for(std::ptrdiff_t i = starting_idx;--i >= 0;) {
-            auto &m = packed_maps_[i];
-            const size_t nsubs = m.size();
+            const size_t nsubs = nsubtables(i);
             const size_t items_before = passing_ids.size();
-            for(size_t j = 0; j < nsubs; ++j) {
-                KeyT myhash = hash_index(item, i, j);
-                auto it = m[j].find(myhash);
-                if(it == m[j].end()) continue;
-                for(const auto id: it->second) {
-                    auto rit2 = rset.find(id);
-                    if(rit2 == rset.end()) {
-                        rset.emplace(id, 1);
-                        passing_ids.push_back(id);
-                    } else ++rit2->second;
+            if(frozen()) {
+                keys.resize(nsubs); ranges.resize(nsubs);
+                for(size_t j = 0; j < nsubs; ++j) keys[j] = hash_index(item, i, j);
+                frozen_.find_all(i, keys.data(), ranges.data());
+                for(const auto &r: ranges) count(r);
+            } else {
+                for(size_t j = 0; j < nsubs; ++j) {
+                    KeyT myhash = hash_index(item, i, j);
+                    auto lock = lock_submap(i, j, myhash);
+                    count(bucket(i, j, myhash));
                 }
             }
             items_per_row.push_back(passing_ids.size() - items_before);
-            if(rset.size() >= maxcand) break;
+            if(passing_ids.size() >= maxcand) break;
         }
         std::vector<uint32_t> passing_counts(passing_ids.size());
-        std::transform(passing_ids.begin(), passing_ids.end(), passing_counts.begin(), [&rset](auto x) {return rset[x];});
-        return std::make_tuple(passing_ids, passing_counts, items_per_row);
+        for(size_t i = 0; i < passing_ids.size(); ++i) {
+            passing_counts[i] = counter(passing_ids[i]);
+            reset(passing_ids[i]);
+        }
+        return std::make_tuple(std::move(passing_ids), std::move(passing_counts), std::move(items_per_row));
     }
 };
 
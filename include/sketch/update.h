@@ -12,15 +12,20 @@ struct Increment {
             ref = static_cast<IntType>(ref) + 1;
         //ref += (ref < maxval);
     }
+    // Sets the n counters at indices ref[0, n), which hold equal values, to that value plus one.
     template<typename T, typename Container, typename IntType>
-    void operator()(std::vector<T> &ref, Container &con, IntType nbits) const {
+    void operator()(const T *ref, size_t n, Container &con, IntType nbits) const {
             int64_t count = con[ref[0]];
             ++count;
             if(range_check<typename std::decay_t<decltype(*(std::declval<Container>().cbegin()))>>(nbits, count) == 0) {
-                for(const auto el: ref)
-                    con[el] = count;
+                for(size_t i = 0; i < n; ++i)
+                    con[ref[i]] = count;
             }
     }
+    template<typename T, typename Container, typename IntType>
+    void operator()(std::vector<T> &ref, Container &con, IntType nbits) const {
+        (*this)(ref.data(), ref.size(), con, nbits);
+    }
     template<typename... Args>
     Increment(Args &&... args) {}
     static uint64_t est_count(uint64_t val) {
@@ -51,25 +56,29 @@ struct PowerOfTwo {
             gen_ >>= oldref, nbits_ -= oldref;
         }
     }
-    template<typename T, typename Container, typename IntType, typename Alloc>
-    void operator()(std::vector<T, Alloc> &ref, Container &con, IntType nbits) {
+    template<typename T, typename Container, typename IntType>
+    void operator()(const T *ref, size_t n, Container &con, IntType nbits) {
         uint64_t val = con[ref[0]];
         if(val == 0) {
-            for(const auto el: ref)
-                con[el] = 1;
+            for(size_t i = 0; i < n; ++i)
+                con[ref[i]] = 1;
         } else {
             if(HEDLEY_UNLIKELY(nbits_ < val)) gen_ = rng_(), nbits_ = 64;
             auto oldval = val;
             if((gen_ & (UINT64_C(-1) >> (64 - val))) == 0) {
                 ++val;
                 if(range_check(nbits, val) == 0)
-                    for(const auto el: ref)
-                        con[el] = val;
+                    for(size_t i = 0; i < n; ++i)
+                        con[ref[i]] = val;
             }
             gen_ >>= oldval;
             nbits_ -= oldval;
         }
     }
+    template<typename T, typename Container, typename IntType, typename Alloc>
+    void operator()(std::vector<T, Alloc> &ref, Container &con, IntType nbits) {
+        (*this)(ref.data(), ref.size(), con, nbits);
+    }
     template<typename T1, typename T2>
     static auto combine(const T1 &i, const T2 &j) {
         using RetType = std::common_type_t<T1, T2>;
@@ -10,6 +10,7 @@
 #include <iterator>
 #include <type_traits>
 #include <cstdint>
+#include <cstring>
 #include <array>
 #ifndef NO_BLAZE
 #include "blaze/Math.h"
@@ -153,13 +154,19 @@ struct SIMDTypes;
 #else
     #define DECMAX64 \
     static INLINE typename SIMDTypes<ValueType>::Type max(typename SIMDTypes<ValueType>::Type ret, typename SIMDTypes<ValueType>::Type rhs) { \
+        uint64_t l[sizeof(Type) / sizeof(uint64_t)], r[sizeof(Type) / sizeof(uint64_t)]; \
+        std::memcpy(l, &ret, sizeof(l)); std::memcpy(r, &rhs, sizeof(r)); \
         for(unsigned i = 0; i < sizeof(Type) / sizeof(uint64_t); ++i) \
-            ((uint64_t *)&ret)[i] = std::max(((uint64_t *)&ret)[i], ((uint64_t *)&rhs)[i]); \
+            l[i] = std::max(l[i], r[i]); \
+        std::memcpy(&ret, l, sizeof(l)); \
         return ret; \
     } \
     static INLINE typename SIMDTypes<ValueType>::Type min(typename SIMDTypes<ValueType>::Type ret, typename SIMDTypes<ValueType>::Type rhs) { \
+        uint64_t l[sizeof(Type) / sizeof(uint64_t)], r[sizeof(Type) / sizeof(uint64_t)]; \
+        std::memcpy(l, &ret, sizeof(l)); std::memcpy(r, &rhs, sizeof(r)); \
         for(unsigned i = 0; i < sizeof(Type) / sizeof(uint64_t); ++i) \
-            ((uint64_t *)&ret)[i] = std::min(((uint64_t *)&ret)[i], ((uint64_t *)&rhs)[i]); \
+            l[i] = std::min(l[i], r[i]); \
+        std::memcpy(&ret, l, sizeof(l)); \
         return ret; \
     }
 #endif
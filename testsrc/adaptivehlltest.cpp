@@ -0,0 +1,70 @@
+#include "sparse.h"
+
+using namespace sketch;
+using namespace sparse;
+
+int main() {
+    // Registers and estimates match a dense hll_t fed the same items, across the sparse-to-dense transition.
+    const unsigned p = 12;
+    std::vector<AdaptiveHLL<>> sketches;
+    std::vector<hll::hll_t> dense;
+    for(const size_t n: {0u, 10u, 300u, 1000u, 5000u, 100000u}) {
+        AdaptiveHLL<> a(p);
+        hll::hll_t h(p);
+        for(size_t i = 0; i < n; ++i) a.addh(i * 7 + n), h.addh(i * 7 + n);
+        // Promotion happens exactly when the number of nonzero registers reaches the break-even point.
+        assert(a.is_sparse() == (a.m() - hll::detail::sum_counts(h.core())[0] < a.sparse_limit()));
+        assert(a.report() == h.report());
+        if(a.is_sparse()) assert(a.nbytes() <= a.m() * 2);
+        else              assert(*a.dense() == h);
+        sketches.push_back(std::move(a));
+        dense.push_back(std::move(h));
+    }
+    // Comparisons between any mix of representations agree with the dense computation, and leave sparse operands sparse.
+    for(size_t i = 0; i < sketches.size(); ++i) {
+        for(size_t j = 0; j < sketches.size(); ++j) {
+            const auto &a = sketches[i], &b = sketches[j];
+            const bool was_sparse = a.is_sparse();
+            const double us = a.union_size(b), expected_us = dense[i].union_size(dense[j]);
+            assert(std::abs(us - expected_us) <= 1e-9 * expected_us);
+            if(i > 0 && j > 0) {
+                const double ji = a.jaccard_index(b), expected_ji = dense[i].jaccard_index(dense[j]);
+                assert(std::abs(ji - expected_ji) <= 1e-9 || !std::fprintf(stderr, "%zu/%zu: %g vs %g\n", i, j, ji, expected_ji));
+                assert(a.jaccard_index(b) == b.jaccard_index(a));
+            }
+            assert(a.is_sparse() == was_sparse);
+            AdaptiveHLL<> merged(a);
+            merged += b;
+            assert(merged.report() == (dense[i] + dense[j]).report());
+            assert(merged.is_sparse() == (a.is_sparse() && b.is_sparse() && merged.m() - merged.sum_counts()[0] < merged.sparse_limit()));
+        }
+    }
+    // Empty sketches are identical to each other and disjoint from anything else.
+    assert(sketches[0].jaccard_index(AdaptiveHLL<>(p)) == 1.);
+    assert(sketches[0].jaccard_index(sketches[1]) == 0.);
+    AdaptiveHLL<> x(p), y(p);
+    for(uint64_t i = 0; i < 1000; ++i) x.addh(i), y.addh(i + 500);
+    assert(x.is_sparse() && y.is_sparse());
+    assert(x.sparse_values().size() + y.sparse_values().size() > x.sparse_limit());
+    x += y;
+    assert(!x.is_sparse());
+    // Moved-from sketches are empty and accept further updates and queries.
+    for(const size_t n: {100u, 5000u}) {
+        AdaptiveHLL<> src(p), dst(p);
+        for(uint64_t i = 0; i < n; ++i) src.addh(i);
+        const double expected = src.report();
+        AdaptiveHLL<> moved(std::move(src));
+        assert(moved.report() == expected);
+        assert(src.is_sparse() && src.report() == 0.);
+        for(uint64_t i = 0; i < n; ++i) src.addh(i);
+        assert(src.report() == expected);
+        dst = std::move(src);
+        assert(dst.report() == expected);
+        assert(src.is_sparse() && src.report() == 0.);
+        src.addh(uint64_t(1));
+        assert(src.sum_counts()[0] == src.m() - 1);
+    }
+    bool threw = false;
+    try {x += AdaptiveHLL<>(p + 1);} catch(const std::invalid_argument &) {threw = true;}
+    assert(threw);
+}
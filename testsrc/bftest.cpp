@@ -35,6 +35,66 @@ int main(int argc, char *argv[]) {
         s2c += (count > 1);
     }
     std::fprintf(stderr, "Counts above 1 for s1: %" PRIu64 ". Counts above 1 for s2: %" PRIu64 ". Counts of zero for s1: %" PRIu64 "\n", s1c, s2c, s1f);
+    {
+        // Blocked mode: no false negatives, a sane false positive rate, and a round trip through the standard header.
+        auto bfb = bf_t::blocked(20, 7, 137);
+        assert(bfb.is_blocked() && !bf1.is_blocked());
+        size_t nbf = 0;
+        std::vector<uint64_t> inserted(s1.begin(), s1.end());
+        inserted.resize(std::min(inserted.size(), size_t(50000)));
+        for(const auto el: inserted) bfb.addh(el);
+        for(const auto el: inserted) assert(bfb.may_contain(el));
+        for(const auto el: s2) nbf += bfb.may_contain(el);
+        std::fprintf(stderr, "Blocked error rate: %lf\n", static_cast<double>(nbf) / s2.size());
+        const double blocked_est = bfb.cardinality_estimate();
+        std::fprintf(stderr, "Blocked cardinality estimate: %lf for %zu keys\n", blocked_est, inserted.size());
+        assert(std::abs(blocked_est - double(inserted.size())) < .02 * inserted.size());
+        assert(nbf < s2.size() / 20);
+        std::vector<uint64_t> mask;
+        bfb.may_contain(inserted, mask);
+        for(size_t i = 0; i < inserted.size(); ++i) assert(mask[i >> 6] >> (i & 63) & 1);
+        bfb.write("__bfblocked.bf");
+        bf_t bfr("__bfblocked.bf");
+        assert(bfr.is_blocked() && bfr == bfb && bfr.same_params(bfb));
+        for(const auto el: inserted) assert(bfr.may_contain(el));
+        bf1.write("__bfstandard.bf");
+        bf_t bf1r("__bfstandard.bf");
+        assert(!bf1r.is_blocked() && bf1r == bf1);
+        std::remove("__bfblocked.bf");
+        std::remove("__bfstandard.bf");
+    }
+    for(const unsigned nh: {1u, 7u, 40u}) {
+        // Batched insertion and queries agree with the per-key paths, including multi-seed and blocked filters.
+        for(const bool blocked: {false, true}) {
+            if(blocked && nh > bf_t::MAX_BLOCKED_HASHES) continue;
+            bf_t serial = blocked ? bf_t::blocked(16, nh, 137): bf_t(16, nh, 137), batch = serial;
+            std::vector<uint64_t> keys(s1.begin(), s1.end()), queries(s2.begin(), s2.end());
+            keys.resize(std::min(keys.size(), size_t(10001)));
+            queries.resize(std::min(queries.size(), size_t(30011)));
+            queries.insert(queries.end(), keys.begin(), keys.end());
+            for(const auto el: keys) serial.addh(el);
+            batch.addh_batch(keys);
+            batch.addh_batch(std::vector<uint64_t>());
+            assert(serial == batch);
+            std::vector<uint64_t> mask;
+            serial.may_contain(queries, mask);
+            assert(mask.size() == (queries.size() + 63) / 64);
+            for(size_t i = 0; i < queries.size(); ++i)
+                assert(bool(mask[i >> 6] >> (i & 63) & 1) == serial.may_contain(queries[i]));
+        }
+    }
+    {
+        // Counts grow roughly logarithmically in the number of insertions and saturate at the top level.
+        cbf_t counter(8, 20, 4, 137);
+        unsigned last = 0;
+        for(unsigned i = 0; i < 4096; ++i) last = counter.addh(1337);
+        assert(last == 128 && counter.est_count(1337) == 128);
+        for(unsigned i = 0; i < 16; ++i) counter.addh(7331);
+        assert(counter.est_count(7331) >= 2 && counter.est_count(7331) <= 32);
+        assert(counter.est_count(42) == 0 && !counter.may_contain(42));
+        assert(counter.addh(42) == 1 && counter.est_count(42) == 1);
+        assert(counter.size() == 8 && counter.p() == 20 && counter.filter_size() == size_t(1) << 20);
+    }
     bf_t bfl(8, 1, 137);
     for(size_t i = 0; i < 100; ++i)
         bfl.addh(i);
@@ -0,0 +1,201 @@
+#include "mh.h"
+#include <cstdio>
+#include <map>
+#include <thread>
+
+using namespace sketch;
+
+// RangeMinHash and CountingRangeMinHash hold the same elements, in the same order and with the same counts,
+// as the std::set-based bottom-k updates they replace, for either comparator and with many duplicate insertions.
+template<typename Cmp>
+struct RefRange {
+    size_t k;
+    Cmp cmp;
+    std::set<uint64_t, Cmp> s;
+    void add(uint64_t val) {
+        if(s.size() == k) {
+            if(cmp(*s.begin(), val)) {
+                s.insert(val);
+                if(s.size() > k) s.erase(s.begin());
+            }
+        } else s.insert(val);
+    }
+};
+template<typename Cmp>
+struct RefCounting {
+    size_t k;
+    Cmp cmp;
+    std::map<uint64_t, uint32_t, Cmp> s;
+    void add(uint64_t val) {
+        if(s.size() == k) {
+            if(cmp(s.begin()->first, val)) {
+                auto it = s.find(val);
+                if(it == s.end()) {
+                    s.erase(s.begin());
+                    s.emplace(val, 1);
+                } else ++it->second;
+            }
+        } else s.emplace(val, 1);
+    }
+};
+
+template<typename Cmp>
+void check(size_t k, size_t n, uint64_t range, uint64_t seed) {
+    RangeMinHash<uint64_t, Cmp> rmh(k), rmh2(k);
+    CountingRangeMinHash<uint64_t, Cmp> crmh(k);
+    RefRange<Cmp> ref{k, Cmp(), {}}, ref2{k, Cmp(), {}};
+    RefCounting<Cmp> cref{k, Cmp(), {}};
+    wy::WyRand<uint64_t> rng(seed);
+    for(size_t i = 0; i < n; ++i) {
+        const uint64_t v = rng() % range + 1;
+        rmh.add(v); ref.add(v);
+        crmh.add(v); cref.add(v);
+        const uint64_t v2 = rng() % range + 1;
+        rmh2.add(v2); ref2.add(v2);
+        if(i % 997 == 0 || i + 1 == n) {
+            // Reads mid-stream see Cmp order without reordering the heap, which later insertions carry on from.
+            assert(std::equal(rmh.begin(), rmh.end(), ref.s.begin(), ref.s.end()));
+            assert(std::equal(crmh.begin(), crmh.end(), cref.s.begin(), cref.s.end(),
+                              [](const auto &x, const auto &y) {return x.first == y.first && x.second == y.second;}));
+        }
+    }
+    // Iteration is read-only, and reads of a changed sketch leave it as is, so threads may share it.
+    static_assert(std::is_same<decltype(rmh.begin()), decltype(static_cast<const RangeMinHash<uint64_t, Cmp> &>(rmh).begin())>::value,
+                  "begin() must return a const_iterator");
+    for(size_t i = 0; i < n / 4; ++i) {
+        const uint64_t v = rng() % range + 1;
+        rmh.add(v); ref.add(v);
+    }
+    const auto &crmh_const = rmh;
+    std::vector<std::thread> readers;
+    for(unsigned t = 0; t < 4; ++t)
+        readers.emplace_back([&]() {assert(std::equal(crmh_const.begin(), crmh_const.end(), ref.s.begin(), ref.s.end()));});
+    for(auto &t: readers) t.join();
+    for(size_t i = 0; i < n / 4; ++i) {
+        const uint64_t v = rng() % range + 1;
+        rmh.add(v); ref.add(v);
+    }
+    readers.clear();
+    for(unsigned t = 0; t < 4; ++t)
+        readers.emplace_back([&]() {assert(std::equal(rmh.begin(), rmh.end(), ref.s.begin(), ref.s.end()));});
+    for(auto &t: readers) t.join();
+    assert(rmh.size() == ref.s.size());
+    assert(rmh.max_element() == *ref.s.begin());
+    assert(rmh.min_element() == *ref.s.rbegin());
+    assert(crmh.size() == cref.s.size());
+    assert(crmh.max_element() == cref.s.begin()->first);
+    // The estimate divides by the largest retained value, for either comparator.
+    const uint64_t largest = std::max(cref.s.begin()->first, cref.s.rbegin()->first);
+    assert(crmh.cardinality_estimate() == double(std::numeric_limits<uint64_t>::max()) / largest * crmh.size());
+    // Counts edited through for_each land in the sketch itself, as a copy (which starts with no snapshot) shows.
+    crmh.add(rng() % range + 1);
+    uint64_t total = 0, doubled = 0;
+    crmh.for_each([&](auto &p) {total += p.second; p.second *= 2;});
+    const auto crmh_copy = crmh;
+    crmh_copy.for_each([&](const auto &p) {doubled += p.second;});
+    assert(doubled == 2 * total);
+    assert(std::equal(rmh.rbegin(), rmh.rend(), ref.s.rbegin(), ref.s.rend()));
+    auto fin = rmh.cfinalize();
+    std::vector<uint64_t> expected(ref.s.begin(), ref.s.end());
+    expected.resize(k, std::numeric_limits<uint64_t>::max());
+    std::sort(expected.begin(), expected.end());
+    assert(std::equal(fin.begin(), fin.end(), expected.begin(), expected.end()));
+    // Merging keeps the k first elements of the union, in Cmp order.
+    auto merged = rmh + rmh2;
+    std::set<uint64_t, Cmp> un(ref.s);
+    un.insert(ref2.s.begin(), ref2.s.end());
+    while(un.size() > k) un.erase(un.begin());
+    assert(std::equal(merged.begin(), merged.end(), un.begin(), un.end()));
+}
+
+// BottomKHasher keeps the k distinct extreme values, merges to those of the union and never reallocates.
+template<bool select_bottom>
+void check_bottomk_hasher(size_t k, uint64_t range, uint64_t seed) {
+    using cmp = std::conditional_t<select_bottom, std::less<uint64_t>, std::greater<uint64_t>>;
+    BottomKHasher<WangHash, uint64_t, select_bottom> bk(k), bk2(k);
+    const uint64_t *const heap = bk.heap_.data(), *const table = bk.table_.data();
+    assert(bk.cardinality_estimate() == 0.);
+    std::set<uint64_t, cmp> ref, ref2;
+    wy::WyRand<uint64_t> rng(seed);
+    for(size_t i = 0; i < 20000; ++i) {
+        // 0 is a legal hash, which the table stores out of band
+        const uint64_t v = rng() % (range + 1), v2 = rng() % (range + 1);
+        bk.add(v); bk2.add(v2);
+        ref.insert(v); ref2.insert(v2);
+        if(ref.size() > k) ref.erase(std::prev(ref.end()));
+        if(ref2.size() > k) ref2.erase(std::prev(ref2.end()));
+    }
+    auto same = [](const auto &s, auto x) {std::sort(x.begin(), x.end(), cmp()); return std::equal(s.begin(), s.end(), x.begin(), x.end());};
+    assert(same(ref, bk.values()));
+    std::set<uint64_t, cmp> un(ref);
+    un.insert(ref2.begin(), ref2.end());
+    while(un.size() > k) un.erase(std::prev(un.end()));
+    // Copies keep room for a merge, so operator+ merges into its copy in place.
+    auto cp = bk2;
+    const uint64_t *const cpheap = cp.heap_.data();
+    cp += bk;
+    assert(cp.heap_.data() == cpheap && same(un, cp.values()));
+    assert(same(un, (bk + bk2).values()));
+    bk += bk2;
+    assert(same(un, bk.values()));
+    for(size_t i = 0; i < 1000; ++i) bk.add(rng() % (range + 1));
+    assert(bk.heap_.data() == heap && bk.table_.data() == table);
+    for(const auto v: bk2.values()) assert(bk2.contains(v));
+}
+
+int main() {
+    for(const size_t k: {size_t(1), size_t(7), size_t(64), size_t(1000)}) {
+        for(const uint64_t range: {uint64_t(50), uint64_t(5000), uint64_t(-2)}) {
+            check_bottomk_hasher<true>(k, range, k + range);
+            check_bottomk_hasher<false>(k, range, k ^ range);
+        }
+    }
+    for(const size_t k: {size_t(1), size_t(7), size_t(64), size_t(1000)}) {
+        for(const uint64_t range: {uint64_t(50), uint64_t(5000), uint64_t(-2)}) {
+            check<std::greater<uint64_t>>(k, 20000, range, k * 31 + range);
+            check<std::less<uint64_t>>(k, 20000, range, k * 37 + range);
+        }
+    }
+    // A serialized sketch reads back into the same contents.
+    RangeMinHash<uint64_t> rmh(100);
+    for(uint64_t i = 0; i < 10000; ++i) rmh.addh(i);
+    rmh.write("bottomktest.tmp.gz");
+    gzFile fp = gzopen("bottomktest.tmp.gz", "rb");
+    RangeMinHash<uint64_t> back(fp);
+    gzclose(fp);
+    std::remove("bottomktest.tmp.gz");
+    assert(back.sketch_size() == rmh.sketch_size());
+    assert(std::equal(back.begin(), back.end(), rmh.begin(), rmh.end()));
+    back.addh(uint64_t(10001));
+    BottomKHasher<> bk(100);
+    for(uint64_t i = 0; i < 10000; ++i) bk.addh(i);
+    bk.write("bottomktest.tmp.gz");
+    BottomKHasher<> bkback(1);
+    bkback.read(std::string("bottomktest.tmp.gz"));
+    std::remove("bottomktest.tmp.gz");
+    assert(bkback.size() == 100 && bkback.finalize().first == bk.finalize().first);
+    bool threw = false;
+    try {BottomKHasher<> zero(0);} catch(const std::runtime_error &) {threw = true;}
+    assert(threw);
+    // Reading an empty sketch would leave k == 0, so it is rejected and the target is left as it was.
+    BottomKHasher<>(1).write("bottomktest.tmp.gz");
+    threw = false;
+    try {bkback.read(std::string("bottomktest.tmp.gz"));} catch(const std::runtime_error &) {threw = true;}
+    std::remove("bottomktest.tmp.gz");
+    assert(threw && bkback.size() == 100);
+    // Finalizing an rvalue empties the sketch, so hashes it held are accepted again.
+    auto fin = std::move(bkback).finalize();
+    assert(fin.size() == 100 && bkback.size() == 0);
+    bkback.add(fin.first.front());
+    assert(bkback.size() == 1);
+    // Moved-from sketches are empty and accept further updates.
+    BottomKHasher<> moved(std::move(bk));
+    assert(moved.size() == 100 && bk.size() == 0);
+    for(uint64_t i = 0; i < 10000; ++i) bk.addh(i);
+    assert(bk.finalize().first == moved.finalize().first);
+    bkback = std::move(bk);
+    assert(bkback.size() == 100 && bk.size() == 0);
+    bk.addh(uint64_t(1));
+    assert(bk.size() == 1 && bk.contains(bk.values()[0]));
+    std::fprintf(stderr, "Flat bottom-k sketches match the std::set reference\n");
+}
@@ -0,0 +1,56 @@
+#include "ccm.h"
+
+using namespace sketch;
+
+// The conservative-update add() from before it became allocation-free, which built two std::vectors per item
+// and handed them to the updaters' std::vector overloads.
+template<typename Base>
+struct legacy_t: public Base {
+    template<typename... Args> legacy_t(Args &&... args): Base(std::forward<Args>(args)...) {}
+    ssize_t legacy_add(const uint64_t val) {
+        std::vector<uint64_t> indices, best_indices;
+        indices.reserve(this->nhashes_);
+        for(unsigned nhdone = 0; nhdone < this->nhashes_; ++nhdone)
+            indices.push_back(this->subtbl_sz_ * nhdone + (this->hash(val, nhdone) & this->mask_));
+        best_indices.push_back(indices[0]);
+        ssize_t minval = this->data_.operator[](indices[0]);
+        for(size_t i(1); i < indices.size(); ++i) {
+            unsigned score;
+            if((score = this->data_.operator[](indices[i])) == minval) {
+                best_indices.push_back(indices[i]);
+            } else if(score < minval) {
+                best_indices.clear();
+                best_indices.push_back(indices[i]);
+                minval = score;
+            }
+        }
+        this->updater_(best_indices, this->data_, this->nbits_);
+        return minval + Base::is_increment;
+    }
+    const auto &data() const {return this->data_;}
+};
+
+// Feeds one stream through the pointer + n path and the legacy path and requires identical counters and estimates.
+template<typename Base>
+void check(int nbits, int l2sz, int nhashes, size_t n, uint64_t seed) {
+    legacy_t<Base> legacy(nbits, l2sz, nhashes), current(nbits, l2sz, nhashes);
+    // Zipf-like, so that rows tie for the minimum and small counters saturate.
+    wy::WyRand<uint64_t> rng(seed);
+    for(size_t i = 0; i < n; ++i) {
+        const uint64_t x = rng() % (uint64_t(1) << (rng() % 20));
+        const ssize_t lret = legacy.legacy_add(x), cret = current.add(x);
+        assert(lret == cret);
+    }
+    assert(std::equal(legacy.data().cbegin(), legacy.data().cend(), current.data().cbegin()));
+}
+
+int main() {
+    // Up to 16 rows fit the stack buffers; 17 and 24 take the heap fallback.
+    for(const int nhashes: {1, 2, 3, 4, 7, 8, 16, 17, 24}) {
+        for(const int nbits: {4, 16}) {
+            check<cm::ccm_t>(nbits, 12, nhashes, 200000, nhashes * 31 + nbits);
+            check<cm::pccm_t>(nbits, 12, nhashes, 200000, nhashes * 37 + nbits);
+        }
+    }
+    std::fprintf(stderr, "Allocation-free conservative updates match the legacy path\n");
+}
@@ -0,0 +1,48 @@
+#include "hll.h"
+#include <numeric>
+#include <thread>
+
+using namespace sketch;
+
+int main() {
+    const unsigned p = 12, nthreads = 4;
+    const size_t nelem = 1 << 20;
+    concurrent_hll_t chll(p, nthreads);
+    hll_t serial(p);
+    for(size_t i = 0; i < nelem; ++i) serial.addh(i);
+    std::vector<std::thread> threads;
+    for(unsigned t = 0; t < nthreads; ++t) {
+        threads.emplace_back([&chll,t,nelem,nthreads]() {
+            for(size_t i = t; i < nelem; i += nthreads) chll.addh(i, t);
+        });
+    }
+    for(auto &t: threads) t.join();
+    assert(chll.merged() == serial);
+    const double est = chll.report();
+    assert(est == serial.report());
+    // Cached estimate is reused until a shard changes.
+    assert(chll.report() == est);
+    // Concurrent readers each get a consistent estimate.
+    std::vector<std::thread> readers;
+    for(unsigned t = 0; t < nthreads; ++t)
+        readers.emplace_back([&chll,est]() {for(size_t i = 0; i < 1000; ++i) assert(chll.report() == est);});
+    for(auto &t: readers) t.join();
+    std::vector<uint64_t> extra(nelem);
+    std::iota(extra.begin(), extra.end(), uint64_t(nelem));
+    chll.addh_batch(extra.data(), extra.size(), 1);
+    for(const auto v: extra) serial.addh(v);
+    // Copies taken while other threads re-merge see a consistent cached union.
+    readers.clear();
+    for(unsigned t = 0; t < nthreads; ++t)
+        readers.emplace_back([&chll,&serial,t]() {
+            if(t & 1) assert(chll.merged() == serial);
+            else assert(concurrent_hll_t(chll).merged() == serial);
+        });
+    for(auto &t: readers) t.join();
+    assert(chll.merged() == serial);
+    assert(chll.report() > est);
+    serial.not_ready();
+    std::fprintf(stderr, "concurrent estimate: %lf. serial: %lf\n", chll.report(), serial.report());
+    chll.clear();
+    assert(chll.report() == 0.);
+}
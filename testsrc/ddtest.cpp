@@ -1,4 +1,168 @@
 #include "dd.h"
+#include <cassert>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <thread>
+
+using namespace sketch;
+
+// Quantiles stay within relative error alpha of the exact ones, and ranks bracket the exact ones within a bin.
+template<typename Sketch>
+void check_accuracy(const std::vector<double> &values, double alpha, size_t maxbins=2048) {
+    Sketch sk(alpha, maxbins);
+    for(const auto v: values) sk.addh(v);
+    auto sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    assert(sk.count() == values.size());
+    std::vector<double> qs;
+    for(size_t i = 0; i <= 100; ++i) qs.push_back(i / 100.);
+    const auto batch = sk.quantiles(qs);
+    for(size_t i = 0; i < qs.size(); ++i) {
+        const double exact = sorted[size_t(qs[i] * (sorted.size() - 1))], est = sk.quantile(qs[i]);
+        assert(batch[i] == est);
+        assert(std::abs(est - exact) <= alpha * std::abs(exact) * 1.0001 + 1e-6);
+    }
+    assert(std::isnan(sk.quantile(1.5)));
+    for(size_t i = 0; i < sorted.size(); i += 97) {
+        const double x = sorted[i];
+        if(x <= 0) continue;
+        const uint64_t r = sk.rank(x);
+        const uint64_t lo = std::upper_bound(sorted.begin(), sorted.end(), x) - sorted.begin();
+        const uint64_t hi = std::upper_bound(sorted.begin(), sorted.end(), x * (1. + 2. * alpha / (1. - alpha)) * 1.0001) - sorted.begin();
+        assert(r >= lo && r <= hi);
+        assert(sk.cdf(x) == double(r) / sorted.size());
+    }
+    assert(sk.rank(sorted.back()) == sorted.size());
+}
+
+// The bin-add kernels agree with the scalar loop at every instruction set level, at lengths around the vector widths.
+template<typename T>
+void check_add_bins(std::mt19937_64 &mt) {
+    for(size_t n = 0; n < 70; ++n) {
+        std::vector<T> src(n), dst(n);
+        for(size_t i = 0; i < n; ++i) src[i] = T(mt()), dst[i] = T(mt());
+        auto expected = dst;
+        dd::detail::add_bins_base(expected.data(), src.data(), n);
+        for(const isa_t isa: {isa_t::SCALAR, isa_t::AVX2, isa_t::AVX512}) {
+            if(isa > detect_isa()) continue;
+            auto got = dst;
+            dd::detail::add_bins_isa(got.data(), src.data(), n, isa);
+            assert(got == expected);
+        }
+    }
+}
 
 int main() {
+    std::mt19937_64 mt(1337);
+    std::lognormal_distribution<double> lognorm(0., 2.);
+    std::normal_distribution<double> norm(0., 100.);
+    std::vector<double> pos(100000), mixed(100000);
+    for(auto &v: pos) v = lognorm(mt);
+    for(auto &v: mixed) v = norm(mt);
+    check_accuracy<ddd>(pos, 0.01);
+    // Keys for both signs span about 2 * 1350 bins here, which would otherwise collapse the negative tail.
+    check_accuracy<ddd>(mixed, 0.01, 4096);
+    check_accuracy<ddd>(pos, 0.05);
+    check_accuracy<ddf>(pos, 0.02);
+
+    // The ring grows in both directions, wrapping around, without losing counts.
+    Store<> st(4096);
+    std::map<int64_t, int64_t> ref;
+    for(int64_t k = 0; k < 300; ++k) st.addh(k, k + 1), ref[k] += k + 1;
+    for(int64_t k = 0; k > -300; --k) st.addh(k), ref[k] += 1;
+    for(int64_t k = 1000; k > 500; k -= 7) st.addh(k, 2), ref[k] += 2;
+    assert(st.min_key() == -299 && st.max_key() == 1000);
+    uint64_t total = 0;
+    for(int64_t k = st.min_key(); k <= st.max_key(); ++k) {
+        const int64_t expected = ref.count(k) ? ref[k]: 0;
+        assert(st.count_at(k) == expected);
+        total += expected;
+        assert(st.rank_of_key(k) == total);
+    }
+    assert(st.count() == total);
+
+    // Past maxbins, the lowest keys collapse into the lowest bin kept.
+    Store<> small(64);
+    for(int64_t k = 0; k < 200; ++k) small.addh(k);
+    assert(small.size() == 64 && small.min_key() == 136 && small.count_at(136) == 137);
+    small.addh(-5);
+    assert(small.size() == 64 && small.count_at(136) == 138 && small.count() == 201);
+    assert(small.key_at_rank(138) == 136 && small.key_at_rank(139) == 137 && small.key_at_rank(201) == 199);
+    Store<> low(64), high(64);
+    for(int64_t k = 0; k < 64; ++k) low.addh(k);
+    for(int64_t k = 100; k <= 110; ++k) high.addh(k);
+    low += high;
+    assert(low.min_key() == 47 && low.max_key() == 110 && low.count_at(47) == 48 && low.count() == 75);
+
+    // Merging matches sketching everything at once, both ways round.
+    ddd whole(0.01, 4096), left(0.01, 4096), right(0.01, 4096);
+    for(size_t i = 0; i < mixed.size(); ++i) {
+        whole.addh(mixed[i]);
+        (i < mixed.size() / 3 ? left: right).addh(mixed[i]);
+    }
+    const auto merged = left + right, rmerged = right + left;
+    assert(merged.count() == whole.count() && merged.min() == whole.min() && merged.max() == whole.max());
+    for(size_t i = 0; i <= 1000; ++i) {
+        assert(merged.quantile(i / 1000.) == whole.quantile(i / 1000.));
+        assert(rmerged.quantile(i / 1000.) == whole.quantile(i / 1000.));
+    }
+    // The first queries of a fresh sketch build its index, so several threads may run them at once.
+    const auto shared = left + right;
+    std::vector<std::thread> readers;
+    for(unsigned t = 0; t < 4; ++t)
+        readers.emplace_back([&]() {
+            for(size_t i = 0; i <= 1000; ++i) assert(shared.quantile(i / 1000.) == whole.quantile(i / 1000.));
+        });
+    for(auto &t: readers) t.join();
+    bool threw = false;
+    try {
+        ddd other(0.05, 4096);
+        other += whole;
+    } catch(const std::runtime_error &) {threw = true;}
+    assert(threw);
+
+    check_add_bins<int64_t>(mt);
+    check_add_bins<uint64_t>(mt);
+    check_add_bins<int32_t>(mt);
+    // Merging rings which have wrapped around, in runs, matches adding bin by bin.
+    for(size_t trial = 0; trial < 20; ++trial) {
+        Store<> a(512), b(512);
+        std::map<int64_t, int64_t> ra;
+        for(size_t i = 0; i < 300; ++i) {
+            const int64_t ka = int64_t(mt() % 400) - 200, kb = int64_t(mt() % 300) - int64_t(trial * 10);
+            a.addh(ka), b.addh(kb, 3);
+            ra[ka] += 1, ra[kb] += 3;
+        }
+        a += b;
+        assert(a.count() == 1200 && a.min_key() == ra.begin()->first && a.max_key() == ra.rbegin()->first);
+        for(const auto &p: ra) assert(a.count_at(p.first) == p.second);
+    }
+
+    // Concurrent collectors, flushing every millisecond, merge to the same sketch as one writer.
+    concurrent_ddd cdd(0.01, 4096, 1e-9, std::chrono::milliseconds(1));
+    std::vector<std::thread> threads;
+    const size_t nthreads = 4;
+    for(size_t t = 0; t < nthreads; ++t) {
+        threads.emplace_back([&,t]() {
+            auto c = cdd.collector();
+            for(size_t i = t; i < mixed.size(); i += nthreads) c.addh(mixed[i]);
+        });
+    }
+    for(auto &t: threads) t.join();
+    const auto cmerged = cdd.merged();
+    assert(cmerged.count() == whole.count() && cdd.count() == whole.count() && cdd.nmerges() >= nthreads);
+    for(size_t i = 0; i <= 1000; ++i) assert(cmerged.quantile(i / 1000.) == whole.quantile(i / 1000.));
+    {
+        // A moved-from collector keeps recording, into an empty sketch of its own.
+        concurrent_ddd moved;
+        auto c1 = moved.collector();
+        c1.addh(1.);
+        auto c2 = std::move(c1);
+        assert(c1.local().count() == 0 && c2.local().count() == 1);
+        c1.addh(2.);
+        c1.flush(), c2.flush();
+        assert(moved.count() == 2 && moved.quantile(1.) >= 1.99);
+    }
+    std::fprintf(stderr, "median %f, p99 %f of %zu normal values\n", whole.quantile(.5), whole.quantile(.99), size_t(whole.count()));
 }
@@ -0,0 +1,63 @@
+#include "hll.h"
+#include "pool.h"
+#include <cstdio>
+#include <cstring>
+
+using namespace sketch;
+using namespace sketch::hll;
+
+// The batched estimator matches ertl_ml_estimate at every instruction set level,
+// over histograms of real sketches and their unions, and the edge cases of empty and saturated histograms.
+// The batched lanes never contract multiplies and adds. When this translation unit does not either
+// (-ffp-contract=off, or no FMA), the results must be identical; otherwise they must agree to a tight relative tolerance.
+static bool contracts() {
+    volatile double v = 1. + std::ldexp(1., -30);
+    const double x = v, y = v, z = -(1. + std::ldexp(1., -29));
+    return x * y + z != 0.; // 2^-60 if fused, 0 if the product is rounded first
+}
+static bool matches(const double *out, const double *expected, size_t n, bool exact) {
+    if(exact) return std::memcmp(out, expected, n * sizeof(double)) == 0;
+    return std::equal(out, out + n, expected, [](double x, double y) {return x == y || std::abs(x - y) <= 1e-12 * std::abs(y);});
+}
+
+int main() {
+    const bool exact = !contracts();
+    std::fprintf(stderr, "Detected %s, using %s; comparing %s\n", isa_name(detect_isa()), isa_name(runtime_isa()), exact ? "exactly": "to 1e-12");
+    wy::WyRand<uint64_t> rng(7);
+    for(const unsigned p: {6u, 10u, 14u}) {
+        const unsigned q = 64 - p;
+        std::vector<hll_t> sketches;
+        for(size_t i = 0; i < 37; ++i) {
+            sketches.emplace_back(p);
+            const size_t n = size_t(1) << (rng() % 22);
+            for(size_t j = 0; j < n; ++j) sketches.back().addh(rng());
+        }
+        std::vector<CountArrayType> counts;
+        for(const auto &s: sketches) counts.push_back(hll::detail::sum_counts(s.core()));
+        for(size_t i = 1; i < sketches.size(); ++i) counts.push_back(union_counts(sketches[i - 1], sketches[i]));
+        counts.push_back(CountArrayType{});
+        counts.back()[0] = 1u << p;         // Empty: estimate 0
+        counts.push_back(CountArrayType{});
+        counts.back()[q + 1] = 1u << p;     // Saturated: infinite estimate
+        counts.push_back(CountArrayType{});
+        counts.back()[q] = 1u << p;         // All registers at q
+        std::vector<double> expected(counts.size()), out(counts.size());
+        for(size_t i = 0; i < counts.size(); ++i) expected[i] = hll::detail::ertl_ml_estimate(counts[i], p, q);
+        assert(expected[expected.size() - 3] == 0. && std::isinf(expected[expected.size() - 2]));
+        for(const isa_t isa: {isa_t::SCALAR, isa_t::AVX2, isa_t::AVX512}) {
+            if(isa > detect_isa()) continue;
+            // Every length, so that partial groups are covered.
+            for(size_t n = 0; n <= counts.size(); n += 1 + (n > 20) * 7) {
+                std::fill(out.begin(), out.end(), -1.);
+                hll::detail::ertl_ml_estimate_batch_isa(counts.data(), n, p, q, out.data(), isa);
+                assert(matches(out.data(), expected.data(), n, exact));
+                assert(std::all_of(out.begin() + n, out.end(), [](double x) {return x == -1.;}));
+            }
+        }
+        thread_pool pool(3);
+        std::fill(out.begin(), out.end(), -1.);
+        hll::detail::ertl_ml_estimate_batch(counts.data(), counts.size(), p, q, out.data(), pool);
+        assert(matches(out.data(), expected.data(), out.size(), exact));
+        std::fprintf(stderr, "p = %u: %zu histograms match\n", p, counts.size());
+    }
+}
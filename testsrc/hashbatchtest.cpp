@@ -0,0 +1,54 @@
+#include "common.h"
+#include "hash.h"
+#include <cstdio>
+
+using namespace sketch;
+
+// Every instruction set's kernel and the dispatching entry point agree with the scalar hasher,
+// across lengths that exercise the unrolled loop and both tails, and in place.
+template<typename H>
+void run_kernel(const H &h, const uint64_t *in, uint64_t *out, size_t n, isa_t isa, std::true_type) {batch::kernel_isa(h, in, out, n, isa);}
+template<typename H>
+void run_kernel(const H &, const uint64_t *, uint64_t *, size_t, isa_t, std::false_type) {}
+
+template<typename H>
+void check(const char *name, const H &h) {
+    wy::WyRand<uint64_t> rng(1337);
+    std::vector<uint64_t> in(1031), out(in.size()), expected(in.size());
+    for(auto &x: in) x = rng();
+    for(size_t i = 0; i < in.size(); ++i) expected[i] = h(in[i]);
+    for(const size_t n: {size_t(0), size_t(1), size_t(7), size_t(31), size_t(33), size_t(64), in.size()}) {
+        for(const isa_t isa: {isa_t::SCALAR, isa_t::AVX2, isa_t::AVX512}) {
+            if(!batch::has_kernel<H>::value || isa > detect_isa()) continue;
+            std::fill(out.begin(), out.end(), 0);
+            run_kernel(h, in.data(), out.data(), n, isa, batch::has_kernel<H>());
+            assert(std::equal(out.begin(), out.begin() + n, expected.begin()));
+            assert(std::all_of(out.begin() + n, out.end(), [](auto x) {return x == 0;}));
+        }
+        std::fill(out.begin(), out.end(), 0);
+        hash_batch(h, in.data(), out.data(), n);
+        assert(std::equal(out.begin(), out.begin() + n, expected.begin()));
+    }
+    out = in;
+    h.hash_batch(out.data(), out.data(), out.size());
+    assert(out == expected);
+    std::fprintf(stderr, "%s: batch hashing matches\n", name);
+}
+
+int main() {
+    static_assert(batch::has_kernel<WangHash>::value, "WangHash has a batch kernel");
+    static_assert(batch::has_kernel<MultiplyAddXoRot<33>>::value, "MultiplyAddXoRot has a batch kernel");
+    static_assert(!batch::has_kernel<FusedReversible<InvRShiftXor<33>, InvMul>>::value, "InvRShiftXor has no batch kernel");
+    std::fprintf(stderr, "Detected %s, using %s\n", isa_name(detect_isa()), isa_name(runtime_isa()));
+    check("WangHash", WangHash());
+    check("MurFinHash", MurFinHash());
+    check("CEHasher", CEHasher());
+    check("XorMultiply", XorMultiply(13, 37));
+    check("MultiplyAdd", MultiplyAdd(13, 37));
+    check("MultiplyAddXor", MultiplyAddXor(13, 37));
+    check("MultiplyAddXoRot<31>", MultiplyAddXoRot<31>(13, 37));
+    check("FusedReversible<RotN<17>,InvXor>", FusedReversible<RotN<17>, InvXor>(13, 37));
+    check("FusedReversible3<InvMul,RShiftXor<33>,InvAdd>", FusedReversible3<InvMul, RShiftXor<33>, InvAdd>(13, 37));
+    check("FusedReversible<InvRShiftXor<33>,InvMul>", FusedReversible<InvRShiftXor<33>, InvMul>(13, 37));
+    check("MultiplyAddXorNVec(4)", MultiplyAddXorNVec(4));
+}
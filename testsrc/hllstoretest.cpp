@@ -0,0 +1,80 @@
+#include "hllstore.h"
+#include <cstdio>
+
+using namespace sketch;
+
+int main() {
+    const char *path = "__hllstore.bin";
+    for(const unsigned p: {10u, 14u}) {
+        std::vector<hll_t> hlls;
+        for(size_t i = 0; i < 25; ++i) {
+            hlls.emplace_back(p);
+            for(uint64_t j = i * 1000; j < i * 1000 + 5000 + i * 100; ++j) hlls.back().addh(j);
+        }
+        hll_store::write(path, hlls);
+        hll_store store(path);
+        assert(store.size() == hlls.size());
+        assert(store.p() == p);
+        for(size_t i = 0; i < hlls.size(); ++i) {
+            auto v = store[i];
+            assert(reinterpret_cast<uintptr_t>(v.data()) % 64 == 0);
+            assert(v == hll_view(hlls[i]));
+            assert(v.creport() == hlls[i].creport());
+            assert(hll::detail::sum_counts(v.core()) == hll::detail::sum_counts(hlls[i].core()));
+            assert(v.to_hll() == hlls[i]);
+            for(size_t j = 0; j < hlls.size(); j += 7) {
+                assert(std::abs(v.union_size(store[j]) - hlls[i].union_size(hlls[j])) <= 1e-9 * hlls[i].union_size(hlls[j]));
+                assert(std::abs(v.jaccard_index(store[j]) - hlls[i].jaccard_index(hlls[j])) <= 1e-9);
+            }
+        }
+        bool threw = false;
+        try {store.at(hlls.size());} catch(const std::out_of_range &) {threw = true;}
+        assert(threw);
+        store.prefetch(0, store.size());
+        threw = false;
+        try {store.prefetch(3, 1);} catch(const exception::UnsatisfiedPreconditionError &) {threw = true;}
+        assert(threw);
+    }
+    {
+        // A sketch count chosen so that both register and cardinality offsets wrap back to a valid-looking layout.
+        std::vector<hll_t> hlls(3, hll_t(10));
+        hll_store::write(path, hlls);
+        std::FILE *fp = std::fopen(path, "r+b");
+        const uint64_t n = (uint64_t(1) << 61) + hlls.size();
+        std::fseek(fp, offsetof(hll_store_header_t, n_), SEEK_SET);
+        std::fwrite(&n, sizeof(n), 1, fp);
+        std::fclose(fp);
+        bool threw = false;
+        try {hll_store store(path);} catch(const std::runtime_error &) {threw = true;}
+        assert(threw);
+    }
+    if(std::FILE *fp = std::fopen("/dev/full", "wb")) {
+        // A failed close() still closes the stream; the destructor must not write or close again.
+        std::fclose(fp);
+        hll_t h(10);
+        h.addh(uint64_t(1));
+        hll_store_writer writer("/dev/full", 10);
+        writer.add(h);
+        bool threw = false;
+        try {writer.close();} catch(const std::runtime_error &) {threw = true;}
+        assert(threw);
+    }
+    {
+        // Stored estimates match those hll_view computes, whichever estimator the sketch uses.
+        hll_t h(12, ORIGINAL);
+        for(uint64_t j = 0; j < 100000; ++j) h.addh(j);
+        hll_store::write(path, std::vector<hll_t>{h});
+        hll_store store(path);
+        assert(store.cardinalities()[0] == hll_view(store.registers(0), 12).creport());
+        assert(store.cardinalities()[0] != h.creport());
+    }
+    {
+        std::FILE *fp = std::fopen(path, "wb");
+        std::fputs("not a sketch store, but long enough to hold a header......................", fp);
+        std::fclose(fp);
+        bool threw = false;
+        try {hll_store store(path);} catch(const std::runtime_error &) {threw = true;}
+        assert(threw);
+    }
+    std::remove(path);
+}
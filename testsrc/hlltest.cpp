@@ -85,6 +85,28 @@ int main(int argc, char *argv[]) {
         t.addh(tmpv);
         tmf.addh(tmpv);
         auto mini = t.compress(4);
+    }
+    {
+        // Batched insertion must match scalar insertion exactly, including the unblocked tail.
+        std::vector<uint64_t> keys(100003);
+        std::iota(keys.begin(), keys.end(), uint64_t(13));
+        for(const unsigned p: {10u, 14u, 18u}) {
+            hll::hll_t scalar(p), batched(p), batched_atomic(p);
+            for(const auto k: keys) scalar.addh(k);
+            batched.addh_batch(keys.data(), keys.size(), true);
+            batched_atomic.addh_batch(keys.data(), keys.size(), false);
+            assert(scalar == batched);
+            assert(scalar == batched_atomic);
+            hll::hll_t from_container(p);
+            from_container.addh_batch(keys);
+            from_container.addh_batch(std::vector<uint64_t>());
+            assert(scalar == from_container);
+            hll::hll_t prehashed(p);
+            std::vector<uint64_t> hashes(keys.size());
+            std::transform(keys.begin(), keys.end(), hashes.begin(), [&](auto x) {return prehashed.hash(x);});
+            prehashed.add_batch(hashes.data(), hashes.size());
+            assert(scalar == prehashed);
+        }
     }
 	return EXIT_SUCCESS;
 }
@@ -52,6 +52,11 @@ int main() {
                 assert(hm == sketch::HyperMinHash(hm1p));
                 assert(hm2 == sketch::HyperMinHash(hm2p));
                 double ji4 = hm.jaccard_index(hmh4);
+                // Union statistics computed in place must match those of the materialized union.
+                auto hmu = hm + hmh4;
+                assert(hm.union_sum_counts(hmh4) == hmu.sum_counts());
+                assert(std::abs(hm.union_size(hmh4) - hmu.cardinality_estimate()) <= 1e-9 * hmu.cardinality_estimate());
+                assert(std::abs(ji4 - .25) < .1);
                 //std::fprintf(stderr, "JI for hm and hmh4: %g. (expected 25%% (1/4))\n", ji4);
                 //std::fprintf(stderr, "JI for hll and hll4: %g. (expected 25%% (1/4))\n", hl.jaccard_index(hl4));
                 jhle += std::abs(hl.jaccard_index(hl4) - .25); jhme += std::abs(ji4 - .25);
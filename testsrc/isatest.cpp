@@ -0,0 +1,143 @@
+#include "hll.h"
+#include "count_eq.h"
+#include <cstdio>
+
+using namespace sketch;
+using namespace sketch::hll;
+
+// Every compiled instruction set level of the dispatched kernels agrees with a scalar reference.
+// This test is built for a baseline target (see the Makefile), so the AVX2 and AVX-512 levels run through dispatch.
+static const isa_t levels[] {isa_t::SCALAR, isa_t::AVX2, isa_t::AVX512};
+
+template<typename T>
+std::vector<T> random_vector(size_t n, uint64_t mask, wy::WyRand<uint64_t> &rng) {
+    std::vector<T> ret(n);
+    for(auto &x: ret) x = rng() & mask;
+    return ret;
+}
+
+template<typename T>
+size_t ref_eq(const std::vector<T> &a, const std::vector<T> &b, size_t n) {
+    size_t ret = 0;
+    for(size_t i = 0; i < n; ++i) ret += a[i] == b[i];
+    return ret;
+}
+template<typename T>
+std::pair<uint64_t, uint64_t> ref_gtlt(const std::vector<T> &a, const std::vector<T> &b, size_t n) {
+    std::pair<uint64_t, uint64_t> ret{0, 0};
+    for(size_t i = 0; i < n; ++i) ret.first += a[i] > b[i], ret.second += a[i] < b[i];
+    return ret;
+}
+// Nibbles are packed two per byte.
+size_t ref_eq_nibbles(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b, size_t n) {
+    size_t ret = 0;
+    for(size_t i = 0; i < n; ++i) ret += ((a[i] ^ b[i]) & 0xF) == 0, ret += ((a[i] ^ b[i]) >> 4) == 0;
+    return ret;
+}
+std::pair<uint64_t, uint64_t> ref_gtlt_nibbles(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b, size_t n) {
+    std::pair<uint64_t, uint64_t> ret{0, 0};
+    for(size_t i = 0; i < n; ++i) {
+        for(const unsigned shift: {0, 4}) {
+            const unsigned x = (a[i] >> shift) & 0xF, y = (b[i] >> shift) & 0xF;
+            ret.first += x > y, ret.second += x < y;
+        }
+    }
+    return ret;
+}
+
+#define CHECK_EQ_NS(ns) do {\
+        assert(eq::ns::count_eq_bytes(b1.data(), b2.data(), n) == ref_eq(b1, b2, n));\
+        assert(eq::ns::count_eq_shorts(s1.data(), s2.data(), n) == ref_eq(s1, s2, n));\
+        assert(eq::ns::count_eq_words(w1.data(), w2.data(), n) == ref_eq(w1, w2, n));\
+        assert(eq::ns::count_eq_longs(l1.data(), l2.data(), n) == ref_eq(l1, l2, n));\
+        assert(eq::ns::count_eq_nibbles(b1.data(), b2.data(), n * 2) == ref_eq_nibbles(b1, b2, n));\
+        assert(eq::ns::count_gtlt_bytes(b1.data(), b2.data(), n) == ref_gtlt(b1, b2, n));\
+        assert(eq::ns::count_gtlt_shorts(s1.data(), s2.data(), n) == ref_gtlt(s1, s2, n));\
+        assert(eq::ns::count_gtlt_nibbles(b1.data(), b2.data(), n * 2) == ref_gtlt_nibbles(b1, b2, n));\
+    } while(0)
+
+void test_count_eq(wy::WyRand<uint64_t> &rng) {
+    for(const size_t n: {size_t(0), size_t(3), size_t(64), size_t(1000), size_t(4096)}) {
+        // Small value ranges, so that equal elements are common.
+        auto b1 = random_vector<uint8_t>(n, 0x33, rng), b2 = random_vector<uint8_t>(n, 0x33, rng);
+        auto s1 = random_vector<uint16_t>(n, 3, rng), s2 = random_vector<uint16_t>(n, 3, rng);
+        auto w1 = random_vector<uint32_t>(n, 3, rng), w2 = random_vector<uint32_t>(n, 3, rng);
+        auto l1 = random_vector<uint64_t>(n, 3, rng), l2 = random_vector<uint64_t>(n, 3, rng);
+        CHECK_EQ_NS(build);
+#ifdef SK_EQ_HAS_AVX2_VARIANT
+        if(detect_isa() >= isa_t::AVX2) CHECK_EQ_NS(avx2);
+#endif
+#ifdef SK_EQ_HAS_AVX512_VARIANT
+        if(detect_isa() >= isa_t::AVX512) CHECK_EQ_NS(avx512);
+#endif
+        // Dispatched entry points.
+        assert(eq::count_eq_bytes(b1.data(), b2.data(), n) == ref_eq(b1, b2, n));
+        assert(eq::count_gtlt_shorts(s1.data(), s2.data(), n) == ref_gtlt(s1, s2, n));
+    }
+}
+#undef CHECK_EQ_NS
+
+void test_hll_kernels(wy::WyRand<uint64_t> &rng) {
+    for(const size_t n: {size_t(1), size_t(63), size_t(256), size_t(1000), size_t(1 << 14)}) {
+        // Narrow ranges take the vector path of byte_histogram, wide ones its fallback.
+        for(const uint64_t mask: {uint64_t(0x7), uint64_t(0x3F), uint64_t(0xFF)}) {
+            auto a = random_vector<uint8_t>(n, mask, rng), b = random_vector<uint8_t>(n, mask, rng);
+            std::array<uint64_t, 256> expected{0};
+            for(const auto x: a) ++expected[x];
+            std::vector<uint8_t> expected_max(n);
+            for(size_t i = 0; i < n; ++i) expected_max[i] = std::max(a[i], b[i]);
+            std::array<uint64_t, 256> expected_union{0};
+            for(const auto x: expected_max) ++expected_union[x];
+            joint_counts_t<uint64_t, 256> expected_joint{};
+            for(size_t i = 0; i < n; ++i) {
+                ++expected_joint.lhs[a[i]]; ++expected_joint.rhs[b[i]]; ++expected_joint.un[expected_max[i]];
+                if(a[i] > b[i]) ++expected_joint.lhs_gt[a[i]];
+                else if(b[i] > a[i]) ++expected_joint.rhs_gt[b[i]];
+                else ++expected_joint.eq[a[i]];
+            }
+            for(const isa_t isa: levels) {
+                if(isa > detect_isa()) continue;
+                std::array<uint64_t, 256> counts{0};
+                hll::detail::byte_histogram_isa(a.data(), n, counts, isa);
+                assert(counts == expected);
+                auto c = a;
+                hll::detail::max_bytes_isa(c.data(), b.data(), n, isa);
+                assert(c == expected_max);
+                std::array<uint64_t, 256> ucounts{0};
+                hll::detail::union_histogram_isa(a.data(), b.data(), n, ucounts, isa);
+                assert(std::equal(ucounts.begin(), ucounts.end(), expected_union.begin()));
+                joint_counts_t<uint64_t, 256> jc{};
+                hll::detail::joint_histogram_isa(a.data(), b.data(), n, jc, isa);
+                assert(jc.lhs == expected_joint.lhs && jc.rhs == expected_joint.rhs && jc.un == expected_joint.un);
+                assert(jc.lhs_gt == expected_joint.lhs_gt && jc.rhs_gt == expected_joint.rhs_gt && jc.eq == expected_joint.eq);
+            }
+        }
+    }
+    hll_t h1(12), h2(12), hu(12);
+    for(uint64_t i = 0; i < 100000; ++i) {
+        const uint64_t v = rng();
+        (i & 1 ? h1: h2).addh(v);
+        hu.addh(v);
+    }
+    // The fused histograms match those of the materialized union.
+    const auto jc = joint_counts(h1, h2);
+    assert(union_counts(h1, h2) == hll::detail::sum_counts(hu.core()));
+    assert(jc.un == hll::detail::sum_counts(hu.core()));
+    assert(jc.lhs == hll::detail::sum_counts(h1.core()) && jc.rhs == hll::detail::sum_counts(h2.core()));
+    const auto est = ertl_joint(jc, h1.p(), h1.q());
+    assert(std::abs(est[0] + est[1] + est[2] - hu.report()) < .05 * hu.report());
+    h1 += h2;
+    assert(h1.core() == hu.core());
+    const auto counts = hll::detail::sum_counts(h1.core());
+    std::array<uint32_t, 64> expected{0};
+    for(const auto x: h1.core()) ++expected[x];
+    assert(counts == expected);
+}
+
+int main() {
+    std::fprintf(stderr, "Detected %s, using %s\n", isa_name(detect_isa()), isa_name(runtime_isa()));
+    wy::WyRand<uint64_t> rng(13);
+    test_count_eq(rng);
+    test_hll_kernels(rng);
+    std::fprintf(stderr, "All instruction set levels agree\n");
+}
@@ -0,0 +1,75 @@
+#include "mh.h"
+#include <cstdio>
+
+using namespace sketch;
+
+// The sorted-intersection kernels agree with a scalar merge at every instruction set level,
+// for both element widths, overlaps from none to total, lengths around the block sizes, skewed sizes and padded sketches.
+template<typename T>
+std::pair<uint64_t, uint64_t> reference(const std::vector<T> &a, const std::vector<T> &b, size_t n) {
+    uint64_t all = 0, prefix = 0;
+    size_t i = 0, j = 0, used = 0;
+    while(i < a.size() && j < b.size()) {
+        if(a[i] == b[j]) {
+            ++all;
+            prefix += used < n;
+            ++i, ++j;
+        } else if(a[i] < b[j]) ++i;
+        else ++j;
+        ++used;
+    }
+    return {all, prefix};
+}
+
+template<typename T>
+std::vector<T> sorted_sample(const std::vector<T> &pool, size_t n, wy::WyRand<uint64_t> &rng) {
+    std::vector<T> ret;
+    for(const auto x: pool) if(rng() % pool.size() < n) ret.push_back(x);
+    return ret;
+}
+
+template<typename T>
+void check(wy::WyRand<uint64_t> &rng) {
+    for(const size_t npool: {size_t(0), size_t(5), size_t(17), size_t(100), size_t(1000), size_t(20000)}) {
+        std::set<T> s;
+        while(s.size() < npool) s.insert(T(rng()));
+        const std::vector<T> pool(s.begin(), s.end());
+        for(const size_t na: {npool / 20, npool / 2, npool}) {
+            for(const size_t nb: {size_t(1), npool / 3, npool}) {
+                auto a = sorted_sample(pool, na, rng), b = sorted_sample(pool, nb, rng);
+                if(rng() & 1) {
+                    // Padding, as in unfilled sketches
+                    a.insert(a.end(), rng() % 5, std::numeric_limits<T>::max());
+                    b.insert(b.end(), rng() % 5, std::numeric_limits<T>::max());
+                }
+                for(const size_t n: {size_t(0), size_t(1), a.size() / 2, a.size(), a.size() + b.size()}) {
+                    const auto expected = reference(a, b, n);
+                    for(const isa_t isa: {isa_t::SCALAR, isa_t::AVX2, isa_t::AVX512}) {
+                        if(isa > detect_isa()) continue;
+                        assert(isz::count_common_isa(a.data(), a.size(), b.data(), b.size(), isa) == expected.first);
+                        assert(isz::count_common_isa(b.data(), b.size(), a.data(), a.size(), isa) == expected.first);
+                        assert(isz::count_common_prefix_isa(a.data(), a.size(), b.data(), b.size(), n, isa) == expected.second);
+                    }
+                }
+            }
+        }
+    }
+}
+
+int main() {
+    wy::WyRand<uint64_t> rng(1337);
+    check<uint64_t>(rng);
+    check<uint32_t>(rng);
+    // Bottom-k sketches: intersection_size and jaccard_index match the merge they replace, full or not.
+    for(const size_t nelem: {size_t(100), size_t(100000)}) {
+        RangeMinHash<uint64_t> r1(1024), r2(1024);
+        for(size_t i = 0; i < nelem; ++i) r1.addh(i), r2.addh(i + nelem / 3);
+        auto f1 = r1.cfinalize(), f2 = r2.cfinalize();
+        const std::vector<uint64_t> v1(f1.begin(), f1.end()), v2(f2.begin(), f2.end());
+        const auto expected = reference(v1, v2, v1.size());
+        assert(f1.intersection_size(f2) == expected.first);
+        assert(isz::intersection_size(v1, v2) == expected.first);
+        assert(f1.jaccard_index(f2) == double(expected.second) / v1.size());
+        std::fprintf(stderr, "%zu elements: intersection %zu, Jaccard %f\n", nelem, size_t(expected.first), f1.jaccard_index(f2));
+    }
+}
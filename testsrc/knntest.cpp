@@ -0,0 +1,58 @@
+#include "knn.h"
+#include "hll.h"
+#include "setsketch.h"
+
+using namespace sketch;
+
+template<typename Sketch, typename Metric=jaccard_metric>
+std::vector<std::pair<size_t, double>> brute_force(const Sketch &q, const std::vector<Sketch> &refs, size_t k, Metric metric=Metric()) {
+    std::vector<std::pair<size_t, double>> all;
+    for(size_t i = 0; i < refs.size(); ++i) all.emplace_back(i, metric(q, refs[i]));
+    std::sort(all.begin(), all.end(), [](auto x, auto y) {return x.second > y.second || (x.second == y.second && x.first < y.first);});
+    all.resize(std::min(k, all.size()));
+    return all;
+}
+
+int main() {
+    // References are intervals of varying length and offset, so cardinalities span two orders of magnitude.
+    std::vector<hll_t> refs;
+    std::vector<CSetSketch<double>> csrefs;
+    for(size_t i = 0; i < 300; ++i) {
+        const uint64_t start = (i % 17) * 3000, len = 500 + (i * 7919) % 50000;
+        refs.emplace_back(12);
+        csrefs.emplace_back(512);
+        for(uint64_t j = start; j < start + len; ++j) refs.back().addh(j), csrefs.back().update(j);
+    }
+    std::vector<hll_t> queries;
+    for(const uint64_t len: {1000u, 10000u, 40000u}) {
+        queries.emplace_back(12);
+        for(uint64_t j = 0; j < len; ++j) queries.back().addh(j);
+    }
+    const size_t k = 10;
+    knn_index<hll_t> exhaustive(refs, jaccard_metric(), std::numeric_limits<double>::max() / 2), pruned(refs);
+    knn_stats stats;
+    for(const auto &q: queries) {
+        const auto expected = brute_force(q, refs, k);
+        assert(exhaustive.query(q, k) == expected);
+        assert(pruned.query(q, k, &stats) == expected);
+        assert(knn_search(q, refs, k) == expected);
+    }
+    std::fprintf(stderr, "Compared %zu, pruned %zu\n", stats.compared, stats.pruned);
+    assert(stats.pruned > stats.compared);
+    knn_stats bstats;
+    auto batch = pruned.query_batch(queries, k, 2, &bstats);
+    assert(bstats.compared == stats.compared && bstats.pruned == stats.pruned);
+    for(size_t i = 0; i < queries.size(); ++i) assert(batch[i] == pruned.query(queries[i], k));
+    thread_pool pool(3);
+    knn_stats pstats;
+    assert(pruned.query_batch(queries, k, pool, &pstats) == batch);
+    assert(pstats.compared == stats.compared && pstats.pruned == stats.pruned);
+    assert(pruned.query(queries[0], refs.size() + 10).size() == refs.size());
+    assert(pruned.query(queries[0], 0).empty());
+    // Metrics without a cardinality bound fall back to exhaustive search.
+    knn_index<hll_t, union_size_metric> unbounded(refs);
+    assert(unbounded.query(queries[1], 3) == brute_force(queries[1], refs, 3, union_size_metric()));
+    const auto &csq = csrefs[5];
+    assert(knn_search(csq, csrefs, k) == brute_force(csq, csrefs, k));
+    assert(knn_search(csq, csrefs, 1)[0].first == 5);
+}
@@ -0,0 +1,55 @@
+#include "pairwise.h"
+#include "hll.h"
+#include "bbmh.h"
+#include "setsketch.h"
+
+using namespace sketch;
+
+// The tiled engine must produce exactly what a plain loop over pairs does, for any tile size.
+template<typename Sketch, typename Metric=jaccard_metric>
+void check(const std::vector<Sketch> &sketches, Metric metric=Metric()) {
+    const size_t n = sketches.size();
+    std::vector<float> expected;
+    for(size_t i = 0; i < n; ++i)
+        for(size_t j = i + 1; j < n; ++j)
+            expected.push_back(metric(sketches[i], sketches[j]));
+    for(const size_t block: {size_t(1), size_t(3), size_t(7), n, size_t(0)}) {
+        pairwise_matrix<Sketch, Metric> pm(sketches, metric, block);
+        assert(pm.condensed() == expected);
+        std::vector<size_t> visits(pm.condensed_size());
+        pm.for_each([&](size_t i, size_t j, double) {
+            assert(i < j && j < n);
+            ++visits[pm.condensed_index(i, j, n)];
+        });
+        assert(std::all_of(visits.begin(), visits.end(), [](auto x) {return x == 1;}));
+        static thread_pool pool(3);
+        assert(pm.condensed(pool) == expected);
+    }
+}
+
+int main() {
+    const size_t n = 23;
+    std::vector<hll_t> hlls;
+    std::vector<SetSketch<uint16_t>> sets;
+    std::vector<FinalBBitMinHash> bbs;
+    for(size_t i = 0; i < n; ++i) {
+        hlls.emplace_back(10);
+        sets.emplace_back(256, 1.0006, 20., 62000);
+        BBitMinHasher<uint64_t> bb(10, 16);
+        for(uint64_t j = i * 500; j < i * 500 + 4000; ++j) {
+            hlls.back().addh(j);
+            sets.back().update(j);
+            bb.addh(j);
+        }
+        bbs.push_back(bb.finalize());
+    }
+    check(hlls);
+    check(hlls, union_size_metric());
+    check(sets);
+    check(bbs);
+    auto ji = pairwise_condensed(hlls);
+    assert(std::abs(ji[pairwise_matrix<hll_t>::condensed_index(0, 1, n)] - hlls[0].jaccard_index(hlls[1])) < 1e-6);
+    thread_pool pool(4);
+    assert(pairwise_condensed(hlls, pool) == ji);
+    assert(pairwise_condensed(hlls, pool, union_size_metric()) == pairwise_condensed(hlls, union_size_metric()));
+}
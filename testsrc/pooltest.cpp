@@ -0,0 +1,45 @@
+#include "pool.h"
+#include "hll.h"
+
+using namespace sketch;
+
+int main() {
+    assert(pool::detail::parse_cpulist("0-3,8,10-11\n") == (std::vector<unsigned>{0, 1, 2, 3, 8, 10, 11}));
+    for(const unsigned nthreads: {1u, 4u}) {
+        thread_pool pool(nthreads);
+        assert(pool.size() == nthreads && pool.worker_index() == -1);
+        // Every index is visited exactly once, for any grain.
+        for(const size_t grain: {size_t(0), size_t(1), size_t(7), size_t(5000)}) {
+            std::vector<std::atomic<int>> visits(10007);
+            for(auto &v: visits) v.store(0);
+            pool.parallel_for(0, visits.size(), [&](size_t i) {++visits[i];}, grain);
+            assert(std::all_of(visits.begin(), visits.end(), [](const auto &v) {return v.load() == 1;}));
+        }
+        // Nested parallelism: each outer task runs its own parallel_for on the same pool.
+        std::atomic<uint64_t> total{0};
+        pool.parallel_for(0, 64, [&](size_t i) {
+            assert(pool.worker_index() >= 0);
+            pool.parallel_for(0, 1000, [&](size_t j) {total += i * 1000 + j;});
+        }, 1);
+        assert(total.load() == uint64_t(64000) * 63999 / 2);
+        // Task groups rethrow the first exception after every task has finished.
+        std::atomic<int> ran{0};
+        bool threw = false;
+        {
+            task_group g(pool);
+            for(int i = 0; i < 100; ++i) g.run([&ran,i]() {++ran; if(i == 50) throw std::runtime_error("task failed");});
+            try {g.wait();} catch(const std::runtime_error &) {threw = true;}
+        }
+        assert(threw && ran.load() == 100);
+        // Sketch APIs
+        hll_t serial(16), parallel(16);
+        std::vector<uint64_t> items(1000003);
+        for(size_t i = 0; i < items.size(); ++i) items[i] = i * 0x9E3779B97F4A7C15ull;
+        serial.addh_batch(items);
+        parallel.addh_batch(items.data(), items.size(), pool);
+        assert(serial == parallel);
+        const double expected = serial.report();
+        parallel.parsum(pool, 1024);
+        assert(parallel.report() == expected);
+    }
+}
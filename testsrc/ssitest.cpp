@@ -0,0 +1,121 @@
+#include "sketch/ssi.h"
+#include "sketch/pool.h"
+#include "aesctr/wy.h"
+#include <thread>
+#include <numeric>
+
+using namespace sketch;
+
+using Index = SetSketchIndex<uint64_t, uint32_t>;
+using Candidates = std::map<uint32_t, uint32_t>; // item index -> number of matching tables
+
+// Candidate (item, count) pairs, with ids translated to item indices.
+template<typename Sketch>
+Candidates candidates(const Index &idx, const Sketch &q, const std::vector<uint32_t> &id2item) {
+    auto res = idx.query_candidates(q, idx.size());
+    Candidates ret;
+    for(size_t i = 0; i < std::get<0>(res).size(); ++i)
+        ret[id2item[std::get<0>(res)[i]]] = std::get<1>(res)[i];
+    return ret;
+}
+
+int main() {
+    const size_t m = 32, nitems = 4000, nthreads = 4;
+    // Items are noisy copies of a few hundred centers, so that buckets are shared.
+    std::vector<std::vector<uint64_t>> items(nitems, std::vector<uint64_t>(m));
+    wy::WyRand<uint64_t> rng(13);
+    for(size_t i = 0; i < nitems; ++i)
+        for(size_t j = 0; j < m; ++j)
+            items[i][j] = rng() % 8 ? (i % 300) * m + j: rng();
+    Index serial(m), concurrent(m);
+    std::vector<uint32_t> serial_ids(nitems), concurrent_ids(nitems);
+    for(size_t i = 0; i < nitems; ++i) serial_ids[serial.update(items[i])] = i;
+    concurrent.make_concurrent(16);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < nthreads; ++t) {
+        threads.emplace_back([&,t]() {
+            for(size_t i = t; i < nitems; i += nthreads) {
+                concurrent_ids[concurrent.update(items[i])] = i;
+                // Queries interleaved with other threads' inserts.
+                if(i % 64 == 0) concurrent.query_candidates(items[(i * 7) % nitems], 100);
+            }
+        });
+    }
+    for(auto &t: threads) t.join();
+    assert(concurrent.size() == nitems);
+    for(size_t i = 0; i < nitems; i += 37)
+        assert(candidates(serial, items[i], serial_ids) == candidates(concurrent, items[i], concurrent_ids));
+    // A pool batch assigns ids in item order.
+    thread_pool pool(nthreads);
+    Index pooled(m);
+    pooled.make_concurrent(16);
+    assert(pooled.update_batch(items.data(), nitems / 2, pool) == 0);
+    assert(pooled.update_batch(items.data() + nitems / 2, nitems - nitems / 2, pool) == nitems / 2);
+    assert(pooled.size() == nitems);
+    std::vector<uint32_t> pooled_ids(nitems);
+    std::iota(pooled_ids.begin(), pooled_ids.end(), 0u);
+    for(size_t i = 0; i < nitems; i += 37)
+        assert(candidates(serial, items[i], serial_ids) == candidates(pooled, items[i], pooled_ids));
+    const Candidates cbefore = candidates(concurrent, items[11], concurrent_ids);
+    concurrent.freeze();
+    assert(candidates(concurrent, items[11], concurrent_ids) == cbefore);
+    // Converting a populated index keeps its contents.
+    const Candidates before = candidates(serial, items[5], serial_ids);
+    serial.make_concurrent(8);
+    assert(candidates(serial, items[5], serial_ids) == before);
+    serial.make_concurrent(32);
+    assert(candidates(serial, items[5], serial_ids) == before);
+    // Freezing preserves query results exactly, including id order, in memory and through a file.
+    std::vector<decltype(serial.query_candidates(items[0], 1))> expected;
+    std::vector<std::vector<uint64_t>> queries;
+    for(size_t i = 0; i < nitems; i += 101) {
+        expected.push_back(serial.query_candidates(items[i], 50));
+        queries.push_back(items[i]);
+    }
+    // Batched queries (dense counters) match one-at-a-time queries (hash map counters) exactly.
+    assert(serial.query_candidates_batch(queries, 50) == expected);
+    assert(serial.query_candidates_batch(queries, 50, pool) == expected);
+    assert(serial.query_candidates_batch(queries, nitems, size_t(-1), 2).size() == queries.size());
+    serial.freeze();
+    assert(serial.frozen() && serial.size() == nitems);
+    const char *path = "ssitest.frozen";
+    serial.write_frozen(path);
+    Index loaded(path);
+    assert(loaded.frozen() && loaded.size() == nitems && loaded.m() == m && loaded.ntables() == serial.ntables());
+    for(size_t i = 0, k = 0; i < nitems; i += 101, ++k) {
+        assert(serial.query_candidates(items[i], 50) == expected[k]);
+        assert(loaded.query_candidates(items[i], 50) == expected[k]);
+    }
+    assert(loaded.query_candidates_batch(queries, 50, size_t(-1), 2) == expected);
+    assert(loaded.query_candidates_batch(queries, 50, pool) == expected);
+    // Items never inserted find nothing.
+    std::vector<uint64_t> absent(m);
+    for(auto &v: absent) v = rng();
+    assert(std::get<0>(loaded.query_candidates(absent, 50)).empty());
+    bool threw = false;
+    try {serial.update(items[0]);} catch(const std::runtime_error &) {threw = true;}
+    assert(threw);
+    threw = false;
+    Index nonconcurrent(m);
+    try {nonconcurrent.update_batch(items, pool);} catch(const std::runtime_error &) {threw = true;}
+    assert(threw && nonconcurrent.size() == 0);
+    std::remove(path);
+    {
+        // Entries with 32-bit keys are padded; the padding is written as zeros, so identical indexes give identical files.
+        using Index32 = SetSketchIndex<uint32_t, uint32_t>;
+        std::vector<std::string> contents;
+        for(const char *p: {"ssitest.frozen32.a", "ssitest.frozen32.b"}) {
+            Index32 idx(m);
+            for(size_t i = 0; i < nitems; i += 3) idx.update(items[i]);
+            idx.freeze();
+            idx.write_frozen(p);
+            std::FILE *fp = std::fopen(p, "rb");
+            std::string buf;
+            for(int c; (c = std::fgetc(fp)) != EOF;) buf.push_back(c);
+            std::fclose(fp);
+            std::remove(p);
+            contents.push_back(std::move(buf));
+        }
+        assert(!contents[0].empty() && contents[0] == contents[1]);
+    }
+}
@@ -1,6 +1,7 @@
 #include "setsketch.h"
 #include "hll.h"
 #include <chrono>
+#include <numeric>
 
 using namespace sketch;
 using namespace sketch::setsketch;
@@ -98,4 +99,20 @@ int main(int argc, char **argv) {
     std::fprintf(stderr, "Registers for smallnibbles: Max: %u. min: %u.\n", *std::max_element(nshl.data(), nshl.data() + m), *std::min_element(nshl.data(), nshl.data() + m));
     std::fprintf(stderr, "Registers for bytes: Max: %u. min: %u.\n", *std::max_element(lhb.data(), lhb.data() + m), *std::min_element(lhb.data(), lhb.data() + m));
     std::fprintf(stderr, "Registers for shorts: Max: %u. min: %u.\n", *std::max_element(rhn.data(), rhn.data() + rhn.size()), *std::min_element(rhn.data(), rhn.data() + rhn.size()));
+    {
+        // Bulk updates must leave exactly the registers serial updates do.
+        std::vector<uint64_t> ids(n * 10);
+        std::iota(ids.begin(), ids.end(), uint64_t(0));
+        for(uint64_t id: {uint64_t(0), uint64_t(1) << 63, ~uint64_t(0), uint64_t(0xdeadbeefcafebabeull)}) {
+            const uint64_t expected = wy::wyhash64_stateless(&id);
+            assert(setsketch::detail::wyhash64_first(id - UINT64_C(0x60bee2bee120fc15)) == expected);
+        }
+        SType bcss(m), scss(m);
+        ShortSetS bshort(m, sb, sa), sshort(m, sb, sa);
+        NibbleSetS bnib(m << 1), snib(m << 1);
+        for(const auto id: ids) scss.update(id), sshort.update(id), snib.update(id);
+        bcss.update_batch(ids); bshort.update_batch(ids); bnib.update_batch(ids);
+        assert(bcss == scss && bshort == sshort && bnib == snib);
+        assert(bcss.total_updates() == scss.total_updates());
+    }
 }